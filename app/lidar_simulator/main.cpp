@@ -0,0 +1,589 @@
+// Emulates a LiDAR on a pseudo-terminal, so the server and the SDK's real
+// serial code can be exercised without hardware. It answers the handshake
+// (device info, health, sample rate, lidar conf) and streams measurements of
+// a synthetic room in the answer format of the selected scan mode, paced both
+// by the mode's sample rate and by what the baudrate can carry.
+//
+//   lidar_simulator [--model a1|a3|s2|s3] [--mode <id>] [--baud <bps>] [--rpm <rpm>] [--link <path>]
+//
+// --mode changes the typical scan mode the device reports, which is the one
+// the server starts, so each answer format can be driven end to end.
+// The slave side of the pty is printed on start, and --link makes a symlink
+// to it, e.g.  ultra_simple 1000000 /tmp/lidar0
+
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include "sl_lidar_cmd.h"
+#include "simulated_scan.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+struct ScanModeSpec {
+    uint16_t id;
+    const char* name;
+    uint8_t ansType;
+    float usPerSample;
+    float maxDistanceM;
+};
+
+struct DeviceProfile {
+    const char* name;
+    uint8_t model;
+    uint16_t firmware;
+    uint8_t hardware;
+    uint32_t baudrate;
+    uint16_t typicalMode;
+    uint16_t defaultRpm;
+    std::vector<ScanModeSpec> modes;
+};
+
+// Sample rates are chosen so every mode fits the native baudrate, as on the
+// real devices.
+static const DeviceProfile PROFILES[] = {
+    { "a1", 0x18, 0x011D, 7, 115200, 2, 420, {
+        { 0, "Standard", SL_LIDAR_ANS_TYPE_MEASUREMENT, 508.0f, 12.0f },
+        { 1, "Express", SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED, 254.0f, 12.0f },
+        { 2, "Boost", SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA, 127.0f, 12.0f },
+    } },
+    { "a3", 0x31, 0x011D, 6, 256000, 3, 600, {
+        { 0, "Standard", SL_LIDAR_ANS_TYPE_MEASUREMENT, 250.0f, 25.0f },
+        { 1, "Express", SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED, 125.0f, 25.0f },
+        { 2, "Boost", SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA, 62.5f, 25.0f },
+        { 3, "Sensitivity", SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA, 62.5f, 25.0f },
+        { 4, "Stability", SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA, 100.0f, 25.0f },
+    } },
+    { "s2", 0x71, 0x0102, 0x12, 1000000, 1, 600, {
+        { 0, "Standard", SL_LIDAR_ANS_TYPE_MEASUREMENT, 125.0f, 30.0f },
+        { 1, "DenseBoost", SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED, 31.25f, 30.0f },
+        { 2, "HQ", SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ, 125.0f, 30.0f },
+    } },
+    { "s3", 0x81, 0x0102, 0x12, 1000000, 1, 600, {
+        { 0, "Standard", SL_LIDAR_ANS_TYPE_MEASUREMENT, 125.0f, 40.0f },
+        { 1, "DenseBoost", SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED, 31.25f, 40.0f },
+        { 2, "HQ", SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ, 125.0f, 40.0f },
+    } },
+};
+
+// a UART that falls this far behind is overflowing its FIFO, so packets are dropped
+static const uint64_t MAX_LINK_BACKLOG_US = 100000;
+static const size_t MAX_PTY_BACKLOG = 64 * 1024;
+static const uint64_t STATUS_INTERVAL_US = 5000000;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void signalHandler(int) {
+    stopRequested = 1;
+}
+
+static uint64_t nowUs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+class LidarSimulator {
+public:
+    LidarSimulator(const DeviceProfile& profile, uint16_t typicalMode, uint32_t baudrate, uint16_t rpm)
+        : profile(profile), typicalMode(typicalMode), baudrate(baudrate), rpm(rpm), master(-1), slave(-1)
+        , streaming(false), mode(nullptr), streamStart(false), angleDeg(0), sampleTimeUs(0)
+        , nextPacketUs(0), linkFreeUs(0), samplesSent(0), packetsDropped(0), bytesSent(0), warnedOverrun(false)
+        , windowStartUs(0), windowSamples(0), windowBytes(0) {}
+
+    ~LidarSimulator() {
+        if (master >= 0) close(master);
+        if (slave >= 0) close(slave);
+    }
+
+    bool open(std::string& slavePath) {
+        char name[256];
+        if (openpty(&master, &slave, name, nullptr, nullptr) < 0) return false;
+
+        // raw until the host configures it, so nothing is echoed back at us
+        termios tio;
+        tcgetattr(slave, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+        // holding the slave open keeps the master readable across host reconnects
+        fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+        slavePath = name;
+        return true;
+    }
+
+    void run() {
+        uint64_t nextStatusUs = nowUs() + STATUS_INTERVAL_US;
+
+        while (!stopRequested) {
+            uint64_t now = nowUs();
+            produceMeasurements(now);
+            flushReleased(now);
+
+            if (now >= nextStatusUs) {
+                if (streaming && now > windowStartUs) {
+                    double seconds = (now - windowStartUs) / 1e6;
+                    printf("%s: %.0f samples/s, %.0f bytes/s, %llu packets dropped\n", mode->name,
+                           (samplesSent - windowSamples) / seconds, (bytesSent - windowBytes) / seconds,
+                           (unsigned long long)packetsDropped);
+                    fflush(stdout);
+                }
+                resetStatusWindow(now);
+                nextStatusUs = now + STATUS_INTERVAL_US;
+            }
+
+            uint64_t wakeUs = nextStatusUs;
+            if (streaming && rpm) wakeUs = std::min(wakeUs, nextPacketUs);
+            if (!released.empty()) wakeUs = std::min(wakeUs, released.front().releaseUs);
+
+            pollfd pfd = { master, POLLIN, 0 };
+            if (!ptyBacklog.empty()) pfd.events |= POLLOUT;
+            uint64_t waitUs = wakeUs > now ? wakeUs - now : 0;
+            timespec timeout = { (time_t)(waitUs / 1000000), (long)(waitUs % 1000000) * 1000 };
+            if (ppoll(&pfd, 1, &timeout, nullptr) < 0) {
+                if (errno == EINTR) continue;
+                perror("ppoll");
+                return;
+            }
+
+            if (pfd.revents & POLLIN) readCommands();
+            if (pfd.revents & POLLOUT) writePty();
+        }
+    }
+
+private:
+    struct Packet {
+        uint64_t releaseUs;
+        std::vector<uint8_t> bytes;
+    };
+
+    void resetStatusWindow(uint64_t now) {
+        windowStartUs = now;
+        windowSamples = samplesSent;
+        windowBytes = bytesSent;
+    }
+
+    void readCommands() {
+        uint8_t buffer[512];
+        ssize_t size = read(master, buffer, sizeof(buffer));
+        if (size <= 0) return;
+        rx.insert(rx.end(), buffer, buffer + size);
+
+        while (!rx.empty()) {
+            // the autobaud byte and line noise are skipped like the firmware does
+            if (rx[0] != SL_LIDAR_CMD_SYNC_BYTE) {
+                rx.erase(rx.begin());
+                continue;
+            }
+            if (rx.size() < 2) return;
+
+            uint8_t cmd = rx[1];
+            size_t length = 2;
+            if (cmd & SL_LIDAR_CMDFLAG_HAS_PAYLOAD) {
+                if (rx.size() < 3) return;
+                length = 4 + rx[2];
+                if (rx.size() < length) return;
+
+                uint8_t checksum = 0;
+                for (size_t i = 0; i < length - 1; ++i) checksum ^= rx[i];
+                if (checksum != rx[length - 1]) {
+                    rx.erase(rx.begin());
+                    continue;
+                }
+            }
+
+            std::vector<uint8_t> payload;
+            if (length > 2) payload.assign(rx.begin() + 3, rx.begin() + length - 1);
+            rx.erase(rx.begin(), rx.begin() + length);
+            handleCommand(cmd, payload);
+        }
+    }
+
+    void handleCommand(uint8_t cmd, const std::vector<uint8_t>& payload) {
+        // motor commands are the only ones that leave a running scan alone
+        if (cmd == SL_LIDAR_CMD_HQ_MOTOR_SPEED_CTRL) {
+            if (payload.size() >= sizeof(sl_lidar_payload_hq_spd_ctrl_t)) {
+                rpm = reinterpret_cast<const sl_lidar_payload_hq_spd_ctrl_t*>(&payload[0])->rpm;
+                printf("motor %u rpm\n", rpm);
+            }
+            return;
+        }
+        if (cmd == SL_LIDAR_CMD_SET_MOTOR_PWM) {
+            if (payload.size() >= sizeof(sl_lidar_payload_motor_pwm_t)) {
+                uint16_t pwm = reinterpret_cast<const sl_lidar_payload_motor_pwm_t*>(&payload[0])->pwm_value;
+                rpm = pwm ? profile.defaultRpm : 0;
+                printf("motor pwm %u\n", pwm);
+            }
+            return;
+        }
+
+        stopStream();
+
+        switch (cmd) {
+        case SL_LIDAR_CMD_STOP:
+        case SL_LIDAR_CMD_RESET:
+            break;
+
+        case SL_LIDAR_CMD_GET_DEVICE_INFO: {
+            sl_lidar_response_device_info_t info;
+            info.model = profile.model;
+            info.firmware_version = profile.firmware;
+            info.hardware_version = profile.hardware;
+            for (size_t i = 0; i < sizeof(info.serialnum); ++i) info.serialnum[i] = (uint8_t)(0x50 + i);
+            sendAnswer(SL_LIDAR_ANS_TYPE_DEVINFO, &info, sizeof(info), false);
+            break;
+        }
+        case SL_LIDAR_CMD_GET_DEVICE_HEALTH: {
+            sl_lidar_response_device_health_t health;
+            health.status = SL_LIDAR_STATUS_OK;
+            health.error_code = 0;
+            sendAnswer(SL_LIDAR_ANS_TYPE_DEVHEALTH, &health, sizeof(health), false);
+            break;
+        }
+        case SL_LIDAR_CMD_GET_SAMPLERATE: {
+            sl_lidar_response_sample_rate_t rate;
+            const ScanModeSpec* standard = findMode(SL_LIDAR_ANS_TYPE_MEASUREMENT);
+            const ScanModeSpec* express = findMode(SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED);
+            rate.std_sample_duration_us = (uint16_t)(standard ? standard->usPerSample : 0);
+            rate.express_sample_duration_us = (uint16_t)(express ? express->usPerSample : rate.std_sample_duration_us);
+            sendAnswer(SL_LIDAR_ANS_TYPE_SAMPLE_RATE, &rate, sizeof(rate), false);
+            break;
+        }
+        case SL_LIDAR_CMD_GET_ACC_BOARD_FLAG: {
+            sl_lidar_response_acc_board_flag_t flag;
+            flag.support_flag = SL_LIDAR_RESP_ACC_BOARD_FLAG_MOTOR_CTRL_SUPPORT_MASK;
+            sendAnswer(SL_LIDAR_ANS_TYPE_ACC_BOARD_FLAG, &flag, sizeof(flag), false);
+            break;
+        }
+        case SL_LIDAR_CMD_GET_LIDAR_CONF:
+            handleGetConf(payload);
+            break;
+
+        case SL_LIDAR_CMD_SCAN:
+        case SL_LIDAR_CMD_FORCE_SCAN:
+            startStream(findMode(SL_LIDAR_ANS_TYPE_MEASUREMENT));
+            break;
+        case SL_LIDAR_CMD_EXPRESS_SCAN: {
+            // working mode 0 asks a legacy device for its express mode
+            const ScanModeSpec* selected = nullptr;
+            uint8_t workingMode = payload.empty() ? 0 : payload[0];
+            if (workingMode) selected = findModeById(workingMode);
+            else selected = findMode(SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED);
+            startStream(selected ? selected : findModeById(typicalMode));
+            break;
+        }
+        case SL_LIDAR_CMD_HQ_SCAN:
+            startStream(findMode(SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ));
+            break;
+
+        default:
+            printf("ignoring command 0x%02x\n", cmd);
+            break;
+        }
+    }
+
+    void handleGetConf(const std::vector<uint8_t>& payload) {
+        if (payload.size() < sizeof(uint32_t)) return;
+
+        uint32_t type;
+        memcpy(&type, &payload[0], sizeof(type));
+        uint16_t modeId = 0;
+        if (payload.size() >= sizeof(uint32_t) + sizeof(uint16_t)) memcpy(&modeId, &payload[4], sizeof(modeId));
+        const ScanModeSpec* spec = findModeById(modeId);
+
+        std::vector<uint8_t> reply(sizeof(type));
+        memcpy(&reply[0], &type, sizeof(type));
+        auto put = [&reply](const void* data, size_t size) {
+            reply.insert(reply.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+        };
+
+        // anything not listed gets an empty answer, which the driver treats as
+        // unsupported, e.g. no MAC address means a UART model
+        switch (type) {
+        case SL_LIDAR_CONF_SCAN_MODE_COUNT: {
+            uint16_t count = (uint16_t)profile.modes.size();
+            put(&count, sizeof(count));
+            break;
+        }
+        case SL_LIDAR_CONF_SCAN_MODE_TYPICAL:
+            put(&typicalMode, sizeof(typicalMode));
+            break;
+        case SL_LIDAR_CONF_SCAN_MODE_US_PER_SAMPLE:
+            if (spec) {
+                uint32_t q8 = (uint32_t)(spec->usPerSample * 256.0f);
+                put(&q8, sizeof(q8));
+            }
+            break;
+        case SL_LIDAR_CONF_SCAN_MODE_MAX_DISTANCE:
+            if (spec) {
+                uint32_t q8 = (uint32_t)(spec->maxDistanceM * 256.0f);
+                put(&q8, sizeof(q8));
+            }
+            break;
+        case SL_LIDAR_CONF_SCAN_MODE_ANS_TYPE:
+            if (spec) put(&spec->ansType, sizeof(spec->ansType));
+            break;
+        case SL_LIDAR_CONF_SCAN_MODE_NAME:
+            if (spec) put(spec->name, strlen(spec->name) + 1);
+            break;
+        case SL_LIDAR_CONF_DESIRED_ROT_FREQ: {
+            sl_lidar_response_desired_rot_speed_t speed;
+            speed.rpm = profile.defaultRpm;
+            speed.pwm_ref = 660;
+            put(&speed, sizeof(speed));
+            break;
+        }
+        case SL_LIDAR_CONF_MIN_ROT_FREQ: {
+            uint16_t minRpm = 300;
+            put(&minRpm, sizeof(minRpm));
+            break;
+        }
+        case SL_LIDAR_CONF_MAX_ROT_FREQ: {
+            uint16_t maxRpm = 1200;
+            put(&maxRpm, sizeof(maxRpm));
+            break;
+        }
+        }
+        sendAnswer(SL_LIDAR_ANS_TYPE_GET_LIDAR_CONF, &reply[0], reply.size(), false);
+    }
+
+    const ScanModeSpec* findMode(uint8_t ansType) const {
+        for (const ScanModeSpec& spec : profile.modes) {
+            if (spec.ansType == ansType) return &spec;
+        }
+        return nullptr;
+    }
+
+    const ScanModeSpec* findModeById(uint16_t id) const {
+        for (const ScanModeSpec& spec : profile.modes) {
+            if (spec.id == id) return &spec;
+        }
+        return nullptr;
+    }
+
+    void startStream(const ScanModeSpec* spec) {
+        if (!spec) return;
+
+        mode = spec;
+        streaming = true;
+        streamStart = true;
+        uint64_t now = nowUs();
+        sampleTimeUs = (double)now;
+        resetStatusWindow(now);
+        nextPacketUs = now + (uint64_t)(scanPacketSamples(mode->ansType) * mode->usPerSample);
+        sendAnswer(mode->ansType, nullptr, scanPacketSize(mode->ansType), true);
+
+        double needed = scanPacketSize(mode->ansType) * 10.0 * 1e6 / (scanPacketSamples(mode->ansType) * mode->usPerSample);
+        printf("scanning in %s, %.0f samples/s needing %.0f of %u bps\n", mode->name, 1e6 / mode->usPerSample,
+               needed, baudrate);
+        fflush(stdout);
+    }
+
+    void stopStream() {
+        if (streaming) printf("scan stopped\n");
+        streaming = false;
+        // unsent measurements are lost with the scan, like the firmware's tx FIFO
+        released.clear();
+    }
+
+    SimulatedSample nextSample(bool advance) {
+        double degPerSample = 360.0 * rpm / 60.0 * mode->usPerSample / 1e6;
+        SimulatedSample sample;
+        sample.angleDeg = angleDeg;
+        sample.distMm = simulatedDistanceMm(angleDeg, sampleTimeUs / 1e6, mode->maxDistanceM);
+        sample.sync = angleDeg < degPerSample;
+        if (advance) {
+            angleDeg = fmod(angleDeg + degPerSample, 360.0);
+            sampleTimeUs += mode->usPerSample;
+        }
+        return sample;
+    }
+
+    void produceMeasurements(uint64_t now) {
+        if (!streaming || !rpm) {
+            // a stalled motor produces nothing, pick up from now once it turns
+            nextPacketUs = std::max(nextPacketUs, now);
+            return;
+        }
+
+        while (streaming && nextPacketUs <= now) {
+            size_t count = scanPacketSamples(mode->ansType);
+            std::vector<SimulatedSample> samples(count);
+            for (size_t i = 0; i < count; ++i) samples[i] = nextSample(true);
+
+            std::vector<uint8_t> packet(scanPacketSize(mode->ansType));
+            encodeScanPacket(mode->ansType, &samples[0], nextSample(false), streamStart, (uint64_t)sampleTimeUs, &packet[0]);
+            streamStart = false;
+            samplesSent += count;
+
+            uint64_t due = nextPacketUs;
+            nextPacketUs += (uint64_t)(count * mode->usPerSample);
+            if (linkFreeUs > due + MAX_LINK_BACKLOG_US) {
+                ++packetsDropped;
+                if (!warnedOverrun) {
+                    printf("%s needs more than %u bps, dropping packets\n", mode->name, baudrate);
+                    warnedOverrun = true;
+                }
+                continue;
+            }
+            queueBytes(due, std::move(packet));
+        }
+    }
+
+    void sendAnswer(uint8_t type, const void* payload, size_t size, bool loop) {
+        sl_lidar_ans_header_t header;
+        header.syncByte1 = SL_LIDAR_ANS_SYNC_BYTE1;
+        header.syncByte2 = SL_LIDAR_ANS_SYNC_BYTE2;
+        header.size_q30_subtype = (uint32_t)size | (loop ? (SL_LIDAR_ANS_PKTFLAG_LOOP << SL_LIDAR_ANS_HEADER_SUBTYPE_SHIFT) : 0);
+        header.type = type;
+
+        std::vector<uint8_t> bytes((const uint8_t*)&header, (const uint8_t*)&header + sizeof(header));
+        // a looping answer's size describes each packet that follows, not a payload
+        if (payload) bytes.insert(bytes.end(), (const uint8_t*)payload, (const uint8_t*)payload + size);
+        queueBytes(nowUs(), std::move(bytes));
+    }
+
+    // Bytes reach the host once the UART would have shifted the last one out.
+    void queueBytes(uint64_t readyUs, std::vector<uint8_t> bytes) {
+        uint64_t startUs = std::max(readyUs, linkFreeUs);
+        linkFreeUs = startUs + bytes.size() * 10ULL * 1000000 / baudrate;
+        Packet packet;
+        packet.releaseUs = linkFreeUs;
+        packet.bytes = std::move(bytes);
+        released.push_back(std::move(packet));
+    }
+
+    void flushReleased(uint64_t now) {
+        while (!released.empty() && released.front().releaseUs <= now) {
+            const std::vector<uint8_t>& bytes = released.front().bytes;
+            // nobody reading the pty: drop like a disconnected UART would
+            if (ptyBacklog.size() + bytes.size() <= MAX_PTY_BACKLOG) {
+                ptyBacklog.insert(ptyBacklog.end(), bytes.begin(), bytes.end());
+            }
+            released.pop_front();
+        }
+        writePty();
+    }
+
+    void writePty() {
+        if (ptyBacklog.empty()) return;
+        ssize_t written = write(master, &ptyBacklog[0], ptyBacklog.size());
+        if (written > 0) {
+            ptyBacklog.erase(ptyBacklog.begin(), ptyBacklog.begin() + written);
+            bytesSent += written;
+        }
+    }
+
+    const DeviceProfile& profile;
+    uint16_t typicalMode;
+    uint32_t baudrate;
+    uint16_t rpm;
+    int master;
+    int slave;
+    std::vector<uint8_t> rx;
+
+    bool streaming;
+    const ScanModeSpec* mode;
+    bool streamStart;
+    double angleDeg;
+    double sampleTimeUs;
+    uint64_t nextPacketUs;
+
+    // when the emulated UART is done with everything queued so far
+    uint64_t linkFreeUs;
+    std::deque<Packet> released;
+    std::vector<uint8_t> ptyBacklog;
+
+    uint64_t samplesSent;
+    uint64_t packetsDropped;
+    uint64_t bytesSent;
+    bool warnedOverrun;
+    // start of the interval the next status line reports on
+    uint64_t windowStartUs;
+    uint64_t windowSamples;
+    uint64_t windowBytes;
+};
+
+static void printUsage(const char* program) {
+    fprintf(stderr, "Usage: %s [--model a1|a3|s2|s3] [--mode <id>] [--baud <bps>] [--rpm <rpm>] [--link <path>]\n", program);
+}
+
+int main(int argc, char* argv[]) {
+    const DeviceProfile* profile = &PROFILES[2];
+    uint32_t baudrate = 0;
+    int rpm = -1;
+    int typicalMode = -1;
+    std::string linkPath;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--model") {
+            profile = nullptr;
+            for (const DeviceProfile& candidate : PROFILES) {
+                if (value == candidate.name) profile = &candidate;
+            }
+            if (!profile) {
+                fprintf(stderr, "Unknown model %s\n", value.c_str());
+                return 1;
+            }
+        }
+        else if (arg == "--mode") typicalMode = atoi(value.c_str());
+        else if (arg == "--baud") baudrate = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+        else if (arg == "--rpm") rpm = atoi(value.c_str());
+        else if (arg == "--link") linkPath = value;
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (typicalMode < 0) typicalMode = profile->typicalMode;
+    bool knownMode = false;
+    for (const ScanModeSpec& spec : profile->modes) knownMode = knownMode || spec.id == typicalMode;
+    if (!knownMode) {
+        fprintf(stderr, "%s has no scan mode %d\n", profile->name, typicalMode);
+        return 1;
+    }
+
+    LidarSimulator simulator(*profile, (uint16_t)typicalMode, baudrate ? baudrate : profile->baudrate,
+                             (uint16_t)(rpm >= 0 ? rpm : profile->defaultRpm));
+    std::string slavePath;
+    if (!simulator.open(slavePath)) {
+        perror("openpty");
+        return 1;
+    }
+    if (!linkPath.empty()) {
+        unlink(linkPath.c_str());
+        if (symlink(slavePath.c_str(), linkPath.c_str()) < 0) {
+            perror("symlink");
+            return 1;
+        }
+    }
+
+    printf("Simulating %s on %s at %u bps\n", profile->name, linkPath.empty() ? slavePath.c_str() : linkPath.c_str(),
+           baudrate ? baudrate : profile->baudrate);
+    fflush(stdout);
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+    simulator.run();
+
+    if (!linkPath.empty()) unlink(linkPath.c_str());
+    return 0;
+}
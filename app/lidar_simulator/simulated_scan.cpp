@@ -0,0 +1,174 @@
+#include "simulated_scan.h"
+#include <algorithm>
+#include <cmath>
+#include "sl_lidar_cmd.h"
+#include "sl_crc.h"
+
+uint32_t simulatedDistanceMm(double angleDeg, double timeS, float maxDistanceM) {
+    const double PI = 3.14159265358979;
+    double a = angleDeg * PI / 180.0;
+    double dx = cos(a), dy = sin(a);
+
+    if (angleDeg > 200.0 && angleDeg < 215.0) return 0;
+
+    double best = 1e9;
+    const double walls[4] = { 5.0, -3.0, 4.0, -2.5 };  // x max, x min, y max, y min
+    if (dx > 1e-9) best = std::min(best, walls[0] / dx);
+    if (dx < -1e-9) best = std::min(best, walls[1] / dx);
+    if (dy > 1e-9) best = std::min(best, walls[2] / dy);
+    if (dy < -1e-9) best = std::min(best, walls[3] / dy);
+
+    double orbit = timeS * 2 * PI / 8.0;
+    double cx = 1.0 + 1.5 * cos(orbit), cy = 0.5 + 1.5 * sin(orbit), r = 0.3;
+    double b = cx * dx + cy * dy;
+    double disc = b * b - (cx * cx + cy * cy - r * r);
+    if (disc >= 0 && b - sqrt(disc) > 0) best = std::min(best, b - sqrt(disc));
+
+    // a little surface texture so consecutive scans differ
+    best += 0.004 * sin(angleDeg * 37.0 + timeS);
+    if (best > maxDistanceM) return 0;
+    return (uint32_t)(best * 1000.0);
+}
+
+// Inverse of the SDK's variable bit scale decoding for ultra capsules.
+static uint32_t varbitscaleEncode(uint32_t value, uint32_t& scaleLevel) {
+    static const uint32_t SRC_BASE[] = { 1 << SL_LIDAR_VARBITSCALE_X16_SRC_BIT, 1 << SL_LIDAR_VARBITSCALE_X8_SRC_BIT,
+                                         1 << SL_LIDAR_VARBITSCALE_X4_SRC_BIT, 1 << SL_LIDAR_VARBITSCALE_X2_SRC_BIT, 0 };
+    static const uint32_t DEST_BASE[] = { SL_LIDAR_VARBITSCALE_X16_DEST_VAL, SL_LIDAR_VARBITSCALE_X8_DEST_VAL,
+                                          SL_LIDAR_VARBITSCALE_X4_DEST_VAL, SL_LIDAR_VARBITSCALE_X2_DEST_VAL, 0 };
+    static const uint32_t LEVEL[] = { 4, 3, 2, 1, 0 };
+
+    for (size_t i = 0; i < 5; ++i) {
+        if (value >= SRC_BASE[i]) {
+            scaleLevel = LEVEL[i];
+            return std::min<uint32_t>(DEST_BASE[i] + ((value - SRC_BASE[i]) >> LEVEL[i]), 0xFFF);
+        }
+    }
+    scaleLevel = 0;
+    return 0;
+}
+
+static uint32_t varbitscaleDecode(uint32_t scaled, uint32_t scaleLevel) {
+    static const uint32_t SRC_BASE[] = { 0, 1 << SL_LIDAR_VARBITSCALE_X2_SRC_BIT, 1 << SL_LIDAR_VARBITSCALE_X4_SRC_BIT,
+                                         1 << SL_LIDAR_VARBITSCALE_X8_SRC_BIT, 1 << SL_LIDAR_VARBITSCALE_X16_SRC_BIT };
+    static const uint32_t DEST_BASE[] = { 0, SL_LIDAR_VARBITSCALE_X2_DEST_VAL, SL_LIDAR_VARBITSCALE_X4_DEST_VAL,
+                                          SL_LIDAR_VARBITSCALE_X8_DEST_VAL, SL_LIDAR_VARBITSCALE_X16_DEST_VAL };
+    return SRC_BASE[scaleLevel] + ((scaled - DEST_BASE[scaleLevel]) << scaleLevel);
+}
+
+// 10-bit signed prediction, two values of which are reserved as "no echo"
+static uint32_t ultraPrediction(uint32_t distMm, uint32_t base, uint32_t scaleLevel) {
+    const uint32_t INVALID = 0x1FF;
+    if (!distMm || !base) return INVALID;
+    int delta = ((int)distMm - (int)base) >> scaleLevel;
+    if (delta < -511 || delta > 510) return INVALID;
+    return (uint32_t)delta & 0x3FF;
+}
+
+static void capsuleChecksum(uint8_t* packet, size_t size) {
+    uint8_t checksum = 0;
+    for (size_t i = 2; i < size; ++i) checksum ^= packet[i];
+    packet[0] = (SL_LIDAR_RESP_MEASUREMENT_EXP_SYNC_1 << 4) | (checksum & 0xF);
+    packet[1] = (SL_LIDAR_RESP_MEASUREMENT_EXP_SYNC_2 << 4) | (checksum >> 4);
+}
+
+static uint16_t startAngleQ6(const SimulatedSample& first, bool streamStart) {
+    uint16_t angle = (uint16_t)(first.angleDeg * 64.0) & 0x7FFF;
+    return streamStart ? (angle | SL_LIDAR_RESP_MEASUREMENT_EXP_SYNCBIT) : angle;
+}
+
+size_t scanPacketSize(uint8_t ansType) {
+    switch (ansType) {
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT: return sizeof(sl_lidar_response_measurement_node_t);
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED: return sizeof(sl_lidar_response_capsule_measurement_nodes_t);
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA: return sizeof(sl_lidar_response_ultra_capsule_measurement_nodes_t);
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED: return sizeof(sl_lidar_response_dense_capsule_measurement_nodes_t);
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ: return sizeof(sl_lidar_response_hq_capsule_measurement_nodes_t);
+    }
+    return 0;
+}
+
+size_t scanPacketSamples(uint8_t ansType) {
+    switch (ansType) {
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT: return 1;
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED: return 32;
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA: return 96;
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED: return 40;
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ: return 96;
+    }
+    return 0;
+}
+
+void encodeScanPacket(uint8_t ansType, const SimulatedSample* samples, const SimulatedSample& next,
+                      bool streamStart, uint64_t timestampUs, uint8_t* out) {
+    switch (ansType) {
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT: {
+        sl_lidar_response_measurement_node_t* node = reinterpret_cast<sl_lidar_response_measurement_node_t*>(out);
+        const SimulatedSample& s = samples[0];
+        uint8_t quality = s.distMm ? (uint8_t)std::max(10, 63 - (int)(s.distMm / 500)) : 0;
+        node->sync_quality = (uint8_t)((quality << SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) | (s.sync ? 0x1 : 0x2));
+        node->angle_q6_checkbit = (uint16_t)(((uint16_t)(s.angleDeg * 64.0) << SL_LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT)
+                                             | SL_LIDAR_RESP_MEASUREMENT_CHECKBIT);
+        node->distance_q2 = (uint16_t)std::min<uint32_t>(s.distMm * 4, 0xFFFF);
+        break;
+    }
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED: {
+        sl_lidar_response_capsule_measurement_nodes_t* capsule = reinterpret_cast<sl_lidar_response_capsule_measurement_nodes_t*>(out);
+        capsule->start_angle_sync_q6 = startAngleQ6(samples[0], streamStart);
+        for (size_t i = 0; i < 16; ++i) {
+            capsule->cabins[i].distance_angle_1 = (uint16_t)(std::min<uint32_t>(samples[2 * i].distMm, 0x3FFF) << 2);
+            capsule->cabins[i].distance_angle_2 = (uint16_t)(std::min<uint32_t>(samples[2 * i + 1].distMm, 0x3FFF) << 2);
+            capsule->cabins[i].offset_angles_q3 = 0;
+        }
+        capsuleChecksum(out, sizeof(*capsule));
+        break;
+    }
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA: {
+        sl_lidar_response_ultra_capsule_measurement_nodes_t* capsule = reinterpret_cast<sl_lidar_response_ultra_capsule_measurement_nodes_t*>(out);
+        capsule->start_angle_sync_q6 = startAngleQ6(samples[0], streamStart);
+
+        // the last cabin predicts from the first major of the next capsule
+        uint32_t levels[33], majors[33];
+        for (size_t i = 0; i <= 32; ++i) {
+            majors[i] = varbitscaleEncode(i < 32 ? samples[3 * i].distMm : next.distMm, levels[i]);
+        }
+        for (size_t i = 0; i < 32; ++i) {
+            uint32_t base1 = majors[i] ? varbitscaleDecode(majors[i], levels[i]) : 0;
+            uint32_t level1 = levels[i];
+            uint32_t base2 = majors[i + 1] ? varbitscaleDecode(majors[i + 1], levels[i + 1]) : 0;
+            if (!base1 && base2) {
+                base1 = base2;
+                level1 = levels[i + 1];
+            }
+            uint32_t predict1 = ultraPrediction(samples[3 * i + 1].distMm, base1, level1);
+            uint32_t predict2 = ultraPrediction(samples[3 * i + 2].distMm, base2, levels[i + 1]);
+            capsule->ultra_cabins[i].combined_x3 = majors[i] | (predict1 << 12) | (predict2 << 22);
+        }
+        capsuleChecksum(out, sizeof(*capsule));
+        break;
+    }
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED: {
+        sl_lidar_response_dense_capsule_measurement_nodes_t* capsule = reinterpret_cast<sl_lidar_response_dense_capsule_measurement_nodes_t*>(out);
+        capsule->start_angle_sync_q6 = startAngleQ6(samples[0], streamStart);
+        for (size_t i = 0; i < 40; ++i) {
+            capsule->cabins[i].distance = (uint16_t)std::min<uint32_t>(samples[i].distMm, 0xFFFF);
+        }
+        capsuleChecksum(out, sizeof(*capsule));
+        break;
+    }
+    case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ: {
+        sl_lidar_response_hq_capsule_measurement_nodes_t* capsule = reinterpret_cast<sl_lidar_response_hq_capsule_measurement_nodes_t*>(out);
+        capsule->sync_byte = SL_LIDAR_RESP_MEASUREMENT_HQ_SYNC;
+        capsule->time_stamp = timestampUs;
+        for (size_t i = 0; i < 96; ++i) {
+            const SimulatedSample& s = samples[i];
+            capsule->node_hq[i].angle_z_q14 = (uint16_t)(s.angleDeg * 16384.0 / 90.0);
+            capsule->node_hq[i].dist_mm_q2 = s.distMm * 4;
+            capsule->node_hq[i].quality = s.distMm ? 188 : 0;
+            capsule->node_hq[i].flag = s.sync ? SL_LIDAR_RESP_HQ_FLAG_SYNCBIT : 0;
+        }
+        capsule->crc32 = sl::crc32::getResult(out, sizeof(*capsule) - sizeof(capsule->crc32));
+        break;
+    }
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef SIMULATED_SCAN_H
+#define SIMULATED_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+
+struct SimulatedSample {
+    double angleDeg;
+    uint32_t distMm;
+    bool sync;  // first sample of a revolution
+};
+
+// A rectangular room with a dark window and a pillar circling the sensor.
+// Zero means no echo, like the device reports it.
+uint32_t simulatedDistanceMm(double angleDeg, double timeS, float maxDistanceM);
+
+// Size and sample count of one packet of a looping measurement answer,
+// 0 for answer types the simulator does not produce.
+size_t scanPacketSize(uint8_t ansType);
+size_t scanPacketSamples(uint8_t ansType);
+
+// Encodes scanPacketSamples(ansType) samples the way the device sends them.
+// Ultra capsules also predict from next, the first sample of the following
+// packet, and HQ capsules carry timestampUs. streamStart marks the first
+// capsule of a scan.
+void encodeScanPacket(uint8_t ansType, const SimulatedSample* samples, const SimulatedSample& next,
+                      bool streamStart, uint64_t timestampUs, uint8_t* out);
+
+#endif // SIMULATED_SCAN_H
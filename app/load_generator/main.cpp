@@ -0,0 +1,689 @@
+// Opens many concurrent client connections to the server and drives a mix of
+// GET_SAMPLE polling, SUBSCRIBE streams and START_SCAN/STOP churn, reporting
+// throughput, per-request latency percentiles, connection failures and bytes
+// received. Every client uses the framed protocol, so each reply is matched
+// to its request by id.
+//
+//   load_generator [--host <address>] [--port <port>] [--connections <n>] [--threads <n>]
+//                  [--duration <s>] [--connect-rate <per s>] [--mix <poll>:<subscribe>:<churn>]
+//                  [--poll-interval-ms <ms>] [--pipeline <n>] [--fresh]
+//                  [--churn-interval-ms <ms>] [--format json|binary] [--report-interval <s>]
+//
+// No sensor is needed: serve the simulator or a recording, with the idle
+// timeout off so quiet subscribers are not dropped, e.g.
+//
+//   lidar_simulator --model s2 --link /tmp/lidar0 &
+//   ultra_simple 1000000 /tmp/lidar0 0
+//   ultra_simple 115200 replay:capture.slrc 0
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "event_loop.h"
+#include "latency_trace.h"
+#include "scan_wire_format.h"
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+
+static const uint64_t CONNECT_TIMEOUT_US = 5000000;
+static const uint64_t RECONNECT_DELAY_US = 1000000;
+static const size_t READ_CHUNK_SIZE = 64 * 1024;
+static const int TICK_INTERVAL_MS = 1;
+
+enum RequestKind {
+    REQUEST_CONNECT = 0,     // connect() to the server's CONNECT greeting
+    REQUEST_START_SCAN = 1,
+    REQUEST_STOP = 2,
+    REQUEST_SUBSCRIBE = 3,
+    REQUEST_GET_SAMPLE = 4,
+    REQUEST_KIND_COUNT = 5,
+};
+
+static const char* const REQUEST_NAMES[REQUEST_KIND_COUNT] = {
+    "CONNECT", "START_SCAN", "STOP", "SUBSCRIBE", "GET_SAMPLE"
+};
+
+enum ClientRole {
+    ROLE_POLL = 0,       // START_SCAN once, then GET_SAMPLE in a loop
+    ROLE_SUBSCRIBE = 1,  // SUBSCRIBE and take the pushed scans
+    ROLE_CHURN = 2,      // alternate START_SCAN and STOP
+    ROLE_COUNT = 3,
+};
+
+struct LoadConfig {
+    LoadConfig()
+        : host("127.0.0.1"), port(8002), connections(100), threads(1), durationS(30), connectRate(0)
+        , pollIntervalMs(0), pipeline(1), fresh(false), churnIntervalMs(1000), binary(false), reportIntervalS(1) {
+        mix[ROLE_POLL] = 1;
+        mix[ROLE_SUBSCRIBE] = 0;
+        mix[ROLE_CHURN] = 0;
+    }
+
+    std::string host;
+    int port;
+    int connections;
+    int threads;
+    int durationS;
+    int connectRate;       // new connections per second over all threads, 0 for no limit
+    int mix[ROLE_COUNT];   // relative share of connections per role
+    int pollIntervalMs;
+    int pipeline;          // GET_SAMPLE requests each poller keeps in flight
+    bool fresh;
+    int churnIntervalMs;
+    bool binary;
+    int reportIntervalS;
+};
+
+// Totals shared by every worker thread.
+struct LoadStats {
+    LoadStats() {
+        for (auto& r : replies) r = 0;
+    }
+
+    std::atomic<uint64_t> connectAttempts{0};
+    std::atomic<uint64_t> connectFailures{0};
+    std::atomic<uint64_t> connectionsOpen{0};
+    std::atomic<uint64_t> disconnects{0};
+    std::atomic<uint64_t> requestsSent{0};
+    std::atomic<uint64_t> requestErrors{0};
+    std::atomic<uint64_t> framesReceived{0};
+    std::atomic<uint64_t> bytesReceived{0};
+    std::atomic<uint64_t> replies[REQUEST_KIND_COUNT];
+    LatencyHistogram latency[REQUEST_KIND_COUNT];
+    // reset by every progress report
+    LatencyHistogram intervalLatency[REQUEST_KIND_COUNT];
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void signalHandler(int) {
+    stopRequested = 1;
+}
+
+// A reply is an error when its JSON says so; binary scans are always OK.
+static bool replyFailed(const char* payload, size_t size) {
+    if (size == 0) return true;
+    if (payload[0] != '{') return false;
+
+    // replies end with their status, so only the tail of a scan is searched
+    static const char STATUS[] = "\"status\":\"";
+    std::string tail(payload + (size > 256 ? size - 256 : 0), payload + size);
+    size_t pos = tail.rfind(STATUS);
+    if (pos == std::string::npos) return true;
+    return tail.compare(pos + sizeof(STATUS) - 1, 3, "OK\"") != 0;
+}
+
+class LoadWorker {
+public:
+    LoadWorker(const LoadConfig& config, LoadStats& stats, const sockaddr_in& address)
+        : config(config), stats(stats), address(address), startUs(0), opened(0), connectRate(0), stopping(false) {}
+
+    ~LoadWorker() {
+        for (auto& client : clients) {
+            if (client->fd >= 0) close(client->fd);
+        }
+    }
+
+    void addClient(ClientRole role) {
+        clients.push_back(std::unique_ptr<Client>(new Client(role)));
+    }
+
+    bool start(double threadConnectRate) {
+        if (!loop.init()) return false;
+        connectRate = threadConnectRate;
+        loop.addTimer(TICK_INTERVAL_MS, [this]() { tick(); });
+        thread = std::thread([this]() {
+            startUs = monotonicUs();
+            tick();
+            loop.run();
+        });
+        return true;
+    }
+
+    void stop() {
+        loop.post([this]() {
+            stopping = true;
+            for (auto& client : clients) closeClient(*client, false);
+            loop.quit();
+        });
+        if (thread.joinable()) thread.join();
+    }
+
+private:
+    enum ClientState {
+        CLIENT_IDLE,        // never connected or waiting to reconnect
+        CLIENT_CONNECTING,
+        CLIENT_HANDSHAKE,   // reading the CONNECT and PROTOCOL line replies
+        CLIENT_RUNNING,     // framed
+    };
+
+    struct PendingRequest {
+        RequestKind kind;
+        uint64_t sentUs;
+    };
+
+    struct Client {
+        explicit Client(ClientRole role)
+            : role(role), state(CLIENT_IDLE), fd(-1), connectStartUs(0), nextActionUs(0)
+            , reconnectUs(0), nextRequestId(1), inputOffset(0), scanStarted(false), wantWrite(false) {}
+
+        ClientRole role;
+        ClientState state;
+        int fd;
+        uint64_t connectStartUs;
+        uint64_t nextActionUs;     // 0 while waiting for a reply
+        uint64_t reconnectUs;
+        uint32_t nextRequestId;
+        std::string input;
+        size_t inputOffset;
+        std::string output;
+        std::unordered_map<uint32_t, PendingRequest> inFlight;
+        bool scanStarted;
+        bool wantWrite;
+    };
+
+    void tick() {
+        if (stopping) return;
+        uint64_t now = monotonicUs();
+
+        for (auto& client : clients) {
+            Client& c = *client;
+            switch (c.state) {
+            case CLIENT_IDLE:
+                if (c.reconnectUs == 0) {
+                    // first connect, paced by the connect rate
+                    if (connectRate > 0 && opened >= (now - startUs) / 1e6 * connectRate + 1) break;
+                    ++opened;
+                }
+                else if (now < c.reconnectUs) {
+                    break;
+                }
+                openClient(c, now);
+                break;
+
+            case CLIENT_CONNECTING:
+            case CLIENT_HANDSHAKE:
+                if (now - c.connectStartUs > CONNECT_TIMEOUT_US) dropClient(c);
+                break;
+
+            case CLIENT_RUNNING:
+                if (c.nextActionUs && now >= c.nextActionUs) act(c, now);
+                break;
+            }
+        }
+    }
+
+    void openClient(Client& c, uint64_t now) {
+        stats.connectAttempts++;
+        c.connectStartUs = now;
+        c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (c.fd < 0) {
+            stats.connectFailures++;
+            c.reconnectUs = now + RECONNECT_DELAY_US;
+            return;
+        }
+
+        int noDelay = 1;
+        setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        if (connect(c.fd, (const sockaddr*)&address, sizeof(address)) < 0 && errno != EINPROGRESS) {
+            stats.connectFailures++;
+            closeClient(c, false);
+            return;
+        }
+
+        Client* target = &c;
+        if (!loop.addFd(c.fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP, [this, target](uint32_t events) { onEvent(*target, events); })) {
+            stats.connectFailures++;
+            closeClient(c, false);
+            return;
+        }
+        c.state = CLIENT_CONNECTING;
+        c.wantWrite = true;
+    }
+
+    void closeClient(Client& c, bool unexpected) {
+        if (c.fd >= 0) {
+            loop.removeFd(c.fd);
+            close(c.fd);
+            c.fd = -1;
+        }
+        if (c.state == CLIENT_RUNNING) {
+            stats.connectionsOpen--;
+            if (unexpected) stats.disconnects++;
+        }
+        // requests lost with the connection never got their reply
+        if (unexpected) stats.requestErrors += c.inFlight.size();
+
+        c.state = CLIENT_IDLE;
+        c.reconnectUs = monotonicUs() + RECONNECT_DELAY_US;
+        c.input.clear();
+        c.inputOffset = 0;
+        c.output.clear();
+        c.inFlight.clear();
+        c.scanStarted = false;
+        c.nextActionUs = 0;
+    }
+
+    void onEvent(Client& c, uint32_t events) {
+        if (c.state == CLIENT_CONNECTING) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+                stats.connectFailures++;
+                closeClient(c, false);
+                return;
+            }
+            if (!(events & EPOLLOUT)) return;
+
+            // whatever follows the PROTOCOL line is read as frames
+            c.state = CLIENT_HANDSHAKE;
+            c.output = "PROTOCOL FRAMED\n";
+            // its reply is not waited for, scans simply arrive in binary
+            if (config.binary) appendFrame(c, c.nextRequestId++, "FORMAT BINARY");
+        }
+
+        bool open = (events & EPOLLIN) ? readInput(c) : !(events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP));
+        if (!open) {
+            dropClient(c);
+            return;
+        }
+
+        if (c.fd >= 0) flushOutput(c);
+    }
+
+    // The server went away. Before the handshake finished that is a failed connect.
+    void dropClient(Client& c) {
+        if (c.state != CLIENT_RUNNING) stats.connectFailures++;
+        closeClient(c, true);
+    }
+
+    bool readInput(Client& c) {
+        char buffer[READ_CHUNK_SIZE];
+        while (true) {
+            ssize_t received = recv(c.fd, buffer, sizeof(buffer), 0);
+            if (received > 0) {
+                stats.bytesReceived += received;
+                c.input.append(buffer, received);
+                continue;
+            }
+            if (received == 0) return false;
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+        parseInput(c);
+        return true;
+    }
+
+    void parseInput(Client& c) {
+        uint64_t now = monotonicUs();
+
+        while (c.fd >= 0 && c.state == CLIENT_HANDSHAKE) {
+            size_t end = c.input.find('\n', c.inputOffset);
+            if (end == std::string::npos) break;
+            std::string line = c.input.substr(c.inputOffset, end - c.inputOffset);
+            c.inputOffset = end + 1;
+
+            bool failed = replyFailed(line.data(), line.size());
+            if (line.find("\"command\":\"CONNECT\"") != std::string::npos) {
+                recordReply(REQUEST_CONNECT, now - c.connectStartUs, failed);
+            }
+            else if (line.find("\"command\":\"PROTOCOL\"") != std::string::npos) {
+                if (failed) {
+                    stats.connectFailures++;
+                    closeClient(c, false);
+                    return;
+                }
+                c.state = CLIENT_RUNNING;
+                stats.connectionsOpen++;
+                beginRole(c, now);
+            }
+        }
+
+        while (c.fd >= 0 && c.state == CLIENT_RUNNING) {
+            if (c.input.size() - c.inputOffset < sizeof(CommandFrameHeader)) break;
+
+            CommandFrameHeader header;
+            decodeCommandFrameHeader((const unsigned char*)c.input.data() + c.inputOffset, header);
+            if (c.input.size() - c.inputOffset - sizeof(CommandFrameHeader) < header.payloadBytes) break;
+
+            const char* payload = c.input.data() + c.inputOffset + sizeof(CommandFrameHeader);
+            c.inputOffset += sizeof(CommandFrameHeader) + header.payloadBytes;
+            onReply(c, header.requestId, payload, header.payloadBytes, now);
+        }
+
+        // drop what was consumed once it is worth the copy
+        if (c.inputOffset == c.input.size()) {
+            c.input.clear();
+            c.inputOffset = 0;
+        }
+        else if (c.inputOffset > READ_CHUNK_SIZE) {
+            c.input.erase(0, c.inputOffset);
+            c.inputOffset = 0;
+        }
+    }
+
+    void recordReply(RequestKind kind, uint64_t latencyUs, bool failed) {
+        stats.replies[kind]++;
+        if (failed) stats.requestErrors++;
+        stats.latency[kind].record(latencyUs);
+        stats.intervalLatency[kind].record(latencyUs);
+    }
+
+    void onReply(Client& c, uint32_t requestId, const char* payload, size_t size, uint64_t now) {
+        if (requestId == COMMAND_FRAME_PUSH_ID) {
+            stats.framesReceived++;
+            return;
+        }
+
+        auto itr = c.inFlight.find(requestId);
+        if (itr == c.inFlight.end()) return;
+        PendingRequest request = itr->second;
+        c.inFlight.erase(itr);
+
+        recordReply(request.kind, now - request.sentUs, replyFailed(payload, size));
+
+        switch (c.role) {
+        case ROLE_POLL:
+            if (config.pollIntervalMs == 0) act(c, now);
+            else c.nextActionUs = now + config.pollIntervalMs * 1000ULL;
+            break;
+        case ROLE_CHURN:
+            c.scanStarted = request.kind == REQUEST_START_SCAN;
+            c.nextActionUs = now + config.churnIntervalMs * 1000ULL;
+            break;
+        default:
+            break;
+        }
+    }
+
+    void beginRole(Client& c, uint64_t now) {
+        switch (c.role) {
+        case ROLE_POLL:
+            // the scan reference keeps the device running for the samples
+            queueRequest(c, REQUEST_START_SCAN, "START_SCAN", now);
+            break;
+        case ROLE_SUBSCRIBE:
+            queueRequest(c, REQUEST_SUBSCRIBE, "SUBSCRIBE", now);
+            break;
+        case ROLE_CHURN:
+            queueRequest(c, REQUEST_START_SCAN, "START_SCAN", now);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void act(Client& c, uint64_t now) {
+        c.nextActionUs = 0;
+        if (c.role == ROLE_POLL) {
+            const char* command = config.fresh ? "GET_SAMPLE FRESH" : "GET_SAMPLE";
+            while ((int)c.inFlight.size() < config.pipeline) queueRequest(c, REQUEST_GET_SAMPLE, command, now);
+        }
+        else if (c.role == ROLE_CHURN && c.inFlight.empty()) {
+            if (c.scanStarted) queueRequest(c, REQUEST_STOP, "STOP", now);
+            else queueRequest(c, REQUEST_START_SCAN, "START_SCAN", now);
+        }
+        flushOutput(c);
+    }
+
+    void queueRequest(Client& c, RequestKind kind, const char* command, uint64_t now) {
+        uint32_t requestId = c.nextRequestId++;
+        if (requestId == COMMAND_FRAME_PUSH_ID) requestId = c.nextRequestId++;
+
+        appendFrame(c, requestId, command);
+        PendingRequest request = { kind, now };
+        c.inFlight[requestId] = request;
+        stats.requestsSent++;
+    }
+
+    void appendFrame(Client& c, uint32_t requestId, const char* command) {
+        size_t length = strlen(command);
+        char header[sizeof(CommandFrameHeader)];
+        encodeCommandFrameHeader((uint32_t)length, requestId, header);
+        c.output.append(header, sizeof(header));
+        c.output.append(command, length);
+    }
+
+    void flushOutput(Client& c) {
+        if (c.state == CLIENT_CONNECTING) return;
+
+        size_t sent = 0;
+        while (sent < c.output.size()) {
+            ssize_t n = send(c.fd, c.output.data() + sent, c.output.size() - sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                sent += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            closeClient(c, true);
+            return;
+        }
+        c.output.erase(0, sent);
+
+        // only ask for writability while something is left to send
+        bool wantWrite = !c.output.empty();
+        if (wantWrite != c.wantWrite) {
+            loop.modifyFd(c.fd, EPOLLIN | EPOLLRDHUP | (wantWrite ? EPOLLOUT : 0));
+            c.wantWrite = wantWrite;
+        }
+    }
+
+    const LoadConfig& config;
+    LoadStats& stats;
+    sockaddr_in address;
+    EventLoop loop;
+    std::thread thread;
+    std::vector<std::unique_ptr<Client> > clients;
+    uint64_t startUs;
+    uint64_t opened;
+    double connectRate;
+    bool stopping;
+};
+
+static std::string formatUs(uint64_t us) {
+    char text[32];
+    if (us < 1000) snprintf(text, sizeof(text), "%lluus", (unsigned long long)us);
+    else if (us < 1000000) snprintf(text, sizeof(text), "%.2fms", us / 1000.0);
+    else snprintf(text, sizeof(text), "%.2fs", us / 1e6);
+    return text;
+}
+
+static bool parseMix(const std::string& text, int mix[ROLE_COUNT]) {
+    int values[ROLE_COUNT] = { 0, 0, 0 };
+    if (sscanf(text.c_str(), "%d:%d:%d", &values[0], &values[1], &values[2]) != ROLE_COUNT) return false;
+    if (values[0] < 0 || values[1] < 0 || values[2] < 0 || values[0] + values[1] + values[2] == 0) return false;
+    for (int i = 0; i < ROLE_COUNT; ++i) mix[i] = values[i];
+    return true;
+}
+
+// Thousands of sockets need more descriptors than the usual soft limit.
+static void raiseDescriptorLimit(int needed) {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return;
+    if (limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if (limit.rlim_cur != RLIM_INFINITY && (rlim_t)needed + 16 > limit.rlim_cur) {
+        fprintf(stderr, "warning: %d connections exceed the descriptor limit of %llu\n", needed,
+                (unsigned long long)limit.rlim_cur);
+    }
+}
+
+struct StatsSnapshot {
+    uint64_t requests;
+    uint64_t replies;
+    uint64_t frames;
+    uint64_t bytes;
+};
+
+static StatsSnapshot snapshot(const LoadStats& stats) {
+    StatsSnapshot s = { stats.requestsSent, 0, stats.framesReceived, stats.bytesReceived };
+    for (int i = REQUEST_START_SCAN; i < REQUEST_KIND_COUNT; ++i) s.replies += stats.replies[i];
+    return s;
+}
+
+static void printProgress(LoadStats& stats, const StatsSnapshot& previous, const StatsSnapshot& current,
+                          double elapsedS, double intervalS, int connections) {
+    LatencyHistogram& sample = stats.intervalLatency[REQUEST_GET_SAMPLE];
+    printf("[%5.0fs] open %llu/%d  replies/s %.0f  frames/s %.0f  MB/s %.2f  GET_SAMPLE p50 %s p99 %s  "
+           "connect failures %llu  errors %llu\n",
+           elapsedS, (unsigned long long)stats.connectionsOpen.load(), connections,
+           (current.replies - previous.replies) / intervalS, (current.frames - previous.frames) / intervalS,
+           (current.bytes - previous.bytes) / intervalS / 1e6,
+           formatUs(sample.percentileUs(0.50)).c_str(), formatUs(sample.percentileUs(0.99)).c_str(),
+           (unsigned long long)stats.connectFailures.load(), (unsigned long long)stats.requestErrors.load());
+    fflush(stdout);
+    for (auto& h : stats.intervalLatency) h.reset();
+}
+
+static void printSummary(const LoadStats& stats, double elapsedS) {
+    printf("\n%.1fs, %llu connection attempts, %llu connect failures, %llu disconnects\n", elapsedS,
+           (unsigned long long)stats.connectAttempts.load(), (unsigned long long)stats.connectFailures.load(),
+           (unsigned long long)stats.disconnects.load());
+    printf("%llu requests, %llu errors, %llu pushed scans (%.1f/s), %.1f MB received (%.2f MB/s)\n\n",
+           (unsigned long long)stats.requestsSent.load(), (unsigned long long)stats.requestErrors.load(),
+           (unsigned long long)stats.framesReceived.load(), stats.framesReceived / elapsedS,
+           stats.bytesReceived / 1e6, stats.bytesReceived / elapsedS / 1e6);
+
+    printf("%-12s %10s %10s %10s %10s %10s %10s\n", "request", "count", "per s", "p50", "p99", "p999", "max");
+    for (int i = 0; i < REQUEST_KIND_COUNT; ++i) {
+        const LatencyHistogram& h = stats.latency[i];
+        if (h.count() == 0) continue;
+        printf("%-12s %10llu %10.1f %10s %10s %10s %10s\n", REQUEST_NAMES[i], (unsigned long long)h.count(),
+               h.count() / elapsedS, formatUs(h.percentileUs(0.50)).c_str(), formatUs(h.percentileUs(0.99)).c_str(),
+               formatUs(h.percentileUs(0.999)).c_str(), formatUs(h.maxUs()).c_str());
+    }
+}
+
+static void printUsage(const char* program) {
+    fprintf(stderr, "usage: %s [--host <address>] [--port <port>] [--connections <n>] [--threads <n>]\n"
+                    "       [--duration <s>] [--connect-rate <per s>] [--mix <poll>:<subscribe>:<churn>]\n"
+                    "       [--poll-interval-ms <ms>] [--pipeline <n>] [--fresh]\n"
+                    "       [--churn-interval-ms <ms>] [--format json|binary] [--report-interval <s>]\n", program);
+}
+
+int main(int argc, char* argv[]) {
+    LoadConfig config;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--fresh") {
+            config.fresh = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--host") config.host = value;
+        else if (arg == "--port") config.port = atoi(value.c_str());
+        else if (arg == "--connections") config.connections = atoi(value.c_str());
+        else if (arg == "--threads") config.threads = atoi(value.c_str());
+        else if (arg == "--duration") config.durationS = atoi(value.c_str());
+        else if (arg == "--connect-rate") config.connectRate = atoi(value.c_str());
+        else if (arg == "--poll-interval-ms") config.pollIntervalMs = atoi(value.c_str());
+        else if (arg == "--pipeline") config.pipeline = atoi(value.c_str());
+        else if (arg == "--churn-interval-ms") config.churnIntervalMs = atoi(value.c_str());
+        else if (arg == "--report-interval") config.reportIntervalS = atoi(value.c_str());
+        else if (arg == "--format" && (value == "json" || value == "binary")) config.binary = value == "binary";
+        else if (arg == "--mix" && parseMix(value, config.mix)) continue;
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (config.connections <= 0 || config.threads <= 0 || config.durationS <= 0 || config.pipeline <= 0
+        || config.reportIntervalS <= 0 || config.pollIntervalMs < 0 || config.churnIntervalMs < 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    config.threads = std::min(config.threads, config.connections);
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.host.c_str(), &address.sin_addr) != 1) {
+        fprintf(stderr, "Invalid server address %s\n", config.host.c_str());
+        return 1;
+    }
+
+    signal(SIGINT, signalHandler);
+    signal(SIGPIPE, SIG_IGN);
+    raiseDescriptorLimit(config.connections);
+
+    LoadStats stats;
+    std::vector<std::unique_ptr<LoadWorker> > workers;
+    for (int t = 0; t < config.threads; ++t) {
+        workers.push_back(std::unique_ptr<LoadWorker>(new LoadWorker(config, stats, address)));
+    }
+
+    // deal roles out in blocks of the mix so every thread gets the same blend
+    int mixTotal = config.mix[ROLE_POLL] + config.mix[ROLE_SUBSCRIBE] + config.mix[ROLE_CHURN];
+    int roleCounts[ROLE_COUNT] = { 0, 0, 0 };
+    for (int i = 0; i < config.connections; ++i) {
+        int slot = i % mixTotal;
+        int role = 0;
+        while (slot >= config.mix[role]) slot -= config.mix[role++];
+        workers[i % config.threads]->addClient((ClientRole)role);
+        ++roleCounts[role];
+    }
+
+    printf("%d connections to %s:%d on %d threads: %d polling, %d subscribed, %d churning\n", config.connections,
+           config.host.c_str(), config.port, config.threads, roleCounts[ROLE_POLL], roleCounts[ROLE_SUBSCRIBE],
+           roleCounts[ROLE_CHURN]);
+    fflush(stdout);
+
+    uint64_t startUs = monotonicUs();
+    for (auto& worker : workers) {
+        if (!worker->start((double)config.connectRate / config.threads)) {
+            fprintf(stderr, "Failed to start a worker event loop\n");
+            return 1;
+        }
+    }
+
+    StatsSnapshot previous = snapshot(stats);
+    uint64_t lastReportUs = startUs;
+    uint64_t endUs = startUs + config.durationS * 1000000ULL;
+    while (!stopRequested) {
+        uint64_t now = monotonicUs();
+        if (now >= endUs) break;
+
+        if (now - lastReportUs >= config.reportIntervalS * 1000000ULL) {
+            StatsSnapshot current = snapshot(stats);
+            printProgress(stats, previous, current, (now - startUs) / 1e6, (now - lastReportUs) / 1e6, config.connections);
+            previous = current;
+            lastReportUs = now;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    double elapsedS = (monotonicUs() - startUs) / 1e6;
+    for (auto& worker : workers) worker->stop();
+
+    printSummary(stats, elapsedS);
+    return 0;
+}
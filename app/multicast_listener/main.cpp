@@ -0,0 +1,102 @@
+// Joins the server's scan multicast group, reassembles scans and prints
+// delivery statistics once a second.
+//
+//   multicast_listener <group>:<port> [interface_address]
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "scan_datagram.h"
+#include "scan_wire_format.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void signalHandler(int) {
+    stopRequested = 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s <group>:<port> [interface_address]\n", argv[0]);
+        return 1;
+    }
+
+    std::string target = argv[1];
+    size_t colon = target.rfind(':');
+    if (colon == std::string::npos) {
+        fprintf(stderr, "Expected <group>:<port>, got %s\n", argv[1]);
+        return 1;
+    }
+
+    ip_mreq membership{};
+    if (inet_pton(AF_INET, target.substr(0, colon).c_str(), &membership.imr_multiaddr) != 1) {
+        fprintf(stderr, "Invalid multicast group %s\n", target.substr(0, colon).c_str());
+        return 1;
+    }
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (argc == 3 && inet_pton(AF_INET, argv[2], &membership.imr_interface) != 1) {
+        fprintf(stderr, "Invalid interface address %s\n", argv[2]);
+        return 1;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in bindAddr{};
+    bindAddr.sin_family = AF_INET;
+    bindAddr.sin_addr = membership.imr_multiaddr;
+    bindAddr.sin_port = htons(atoi(target.substr(colon + 1).c_str()));
+    if (bind(fd, (struct sockaddr*)&bindAddr, sizeof(bindAddr)) < 0
+        || setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0) {
+        fprintf(stderr, "Failed to join %s, errno %d\n", argv[1], errno);
+        close(fd);
+        return 1;
+    }
+
+    // wake up regularly so the statistics keep printing when nothing arrives
+    timeval timeout{ 0, 200000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    signal(SIGINT, signalHandler);
+
+    ScanDatagramReassembler reassembler;
+    char datagram[65536];
+    uint32_t lastNodeCount = 0;
+    uint64_t lastCompleted = 0;
+    auto lastReport = std::chrono::steady_clock::now();
+
+    while (!stopRequested) {
+        ssize_t size = recv(fd, datagram, sizeof(datagram), 0);
+        if (size > 0 && reassembler.push(datagram, size) == ScanDatagramReassembler::DATAGRAM_SCAN_COMPLETE) {
+            ScanWireHeader header;
+            const std::string& message = reassembler.message();
+            if (decodeScanWireHeader(message.data(), message.size(), header)) lastNodeCount = header.nodeCount;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastReport >= std::chrono::seconds(1)) {
+            printf("scans/s %llu  last scan %llu (%u nodes)  datagrams %llu  lost %llu  incomplete scans %llu  restarts %llu\n",
+                   (unsigned long long)(reassembler.scansCompleted() - lastCompleted),
+                   (unsigned long long)reassembler.scanSequence(), lastNodeCount,
+                   (unsigned long long)reassembler.datagramsReceived(),
+                   (unsigned long long)reassembler.datagramsLost(),
+                   (unsigned long long)reassembler.scansIncomplete(),
+                   (unsigned long long)reassembler.publisherRestarts());
+            fflush(stdout);
+            lastCompleted = reassembler.scansCompleted();
+            lastReport = now;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
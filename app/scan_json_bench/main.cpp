@@ -0,0 +1,120 @@
+// Compares the streaming scan JSON writer against the nlohmann DOM path the
+// server used before, on full 8192-node scans.
+//
+//   scan_json_bench [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <json.hpp>
+#include "scan_json_writer.h"
+
+static const size_t SCAN_NODES = 8192;
+static const int DEFAULT_ITERATIONS = 200;
+
+// the pre-writer serialization, kept verbatim as the reference
+static std::string legacyScanJson(const std::string& command, const ScanFrame& frame) {
+    nlohmann::json sampleJson = nlohmann::json::array();
+    for (const sl_lidar_response_measurement_node_hq_t& node : frame.nodes) {
+        sampleJson.push_back({
+            {"angle", node.angle_z_q14 * 90.f / (1 << 14)},
+            {"distance", node.dist_mm_q2 / 4.0},
+            {"quality", node.quality >> SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT}
+        });
+    }
+
+    nlohmann::json jsonResponse = {
+        {"command", command},
+        {"response", {
+            {"status", "OK"},
+            {"data", sampleJson}
+        }}
+    };
+    return jsonResponse.dump() + "\n";
+}
+
+static uint32_t nextRandom(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return state;
+}
+
+static ScanFrame makeScan(size_t nodeCount, uint32_t seed) {
+    ScanFrame frame;
+    frame.sequence = 1;
+    frame.timestampUs = 0;
+    frame.scanMode = 0;
+    frame.nodes.resize(nodeCount);
+
+    uint32_t state = seed;
+    for (size_t i = 0; i < nodeCount; ++i) {
+        sl_lidar_response_measurement_node_hq_t& node = frame.nodes[i];
+        node.angle_z_q14 = (uint16_t)(i * 65536 / nodeCount);
+        node.dist_mm_q2 = nextRandom(state) % (40000 * 4);
+        node.quality = (uint8_t)(nextRandom(state) >> 24);
+        node.flag = 0;
+    }
+    return frame;
+}
+
+// every representable angle plus distance/quality edge cases
+static bool verifyAllValues() {
+    ScanFrame frame = makeScan(65536, 1);
+    for (size_t i = 0; i < frame.nodes.size(); ++i) {
+        frame.nodes[i].angle_z_q14 = (uint16_t)i;
+    }
+    frame.nodes[0].dist_mm_q2 = 0;
+    frame.nodes[1].dist_mm_q2 = 1;
+    frame.nodes[2].dist_mm_q2 = 0xFFFFFFFF;
+    frame.nodes[3].quality = 0xFF;
+
+    std::string streamed;
+    writeScanJson("GET_SAMPLE", frame, streamed);
+    if (streamed != legacyScanJson("GET_SAMPLE", frame)) return false;
+
+    ScanFrame empty = makeScan(0, 1);
+    streamed.clear();
+    writeScanJson("SCAN", empty, streamed);
+    return streamed == legacyScanJson("SCAN", empty);
+}
+
+template <typename Fn>
+static double timeIterations(int iterations, size_t& bytes, Fn fn) {
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        bytes += fn().size();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - begin).count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = (argc > 1) ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    if (iterations <= 0) iterations = DEFAULT_ITERATIONS;
+
+    if (!verifyAllValues()) {
+        fprintf(stderr, "streaming writer output differs from the nlohmann path\n");
+        return 1;
+    }
+
+    ScanFrame frame = makeScan(SCAN_NODES, 42);
+
+    size_t legacyBytes = 0;
+    double legacyUs = timeIterations(iterations, legacyBytes, [&]() {
+        return legacyScanJson("GET_SAMPLE", frame);
+    });
+
+    size_t streamedBytes = 0;
+    double streamedUs = timeIterations(iterations, streamedBytes, [&]() {
+        std::string out;
+        writeScanJson("GET_SAMPLE", frame, out);
+        return out;
+    });
+
+    double messageBytes = (double)legacyBytes / iterations;
+    printf("%zu nodes, %d iterations, %.0f bytes per scan\n", SCAN_NODES, iterations, messageBytes);
+    printf("nlohmann dom   %10.1f us/scan %8.1f MB/s\n", legacyUs, messageBytes / legacyUs);
+    printf("stream writer  %10.1f us/scan %8.1f MB/s\n", streamedUs, messageBytes / streamedUs);
+    printf("speedup        %10.1fx\n", legacyUs / streamedUs);
+    return 0;
+}
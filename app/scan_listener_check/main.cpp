@@ -0,0 +1,182 @@
+// Driver-level checks for scan listeners against a real serial link, e.g. the
+// lidar_simulator's pty: listeners get every complete scan in registration
+// order, scans they hold on to stay intact while the decoder keeps going (and
+// after the driver is gone), and unregistering a listener waits out a call
+// still in flight. Prints each failure and exits non-zero if there was any.
+//
+//   scan_listener_check <serial port> [baudrate]
+//
+// e.g.  lidar_simulator --model s2 --link /tmp/lidar0 &
+//       scan_listener_check /tmp/lidar0 1000000
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sl_lidar.h"
+#include "sl_lidar_driver.h"
+
+using namespace sl;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++failures; \
+        } \
+    } while (0)
+
+static const int DEFAULT_BAUDRATE = 1000000;
+static const size_t HELD_SCANS = 4;
+static const int LISTENER_SCANS = 20;
+static const int WAIT_TIMEOUT_MS = 5000;
+
+struct HeldScan {
+    LidarScanPtr scan;
+    uint64_t checksum;
+};
+
+static uint64_t scanChecksum(const LidarScan& scan) {
+    uint64_t sum = scan.sequence * 31 + scan.count;
+    for (size_t i = 0; i < scan.count; ++i) {
+        sum = sum * 131 + scan.nodes[i].angle_z_q14 + ((uint64_t)scan.nodes[i].dist_mm_q2 << 16);
+    }
+    return sum;
+}
+
+static bool validScan(const LidarScan& scan) {
+    return scan.count > 0 && (scan.nodes[0].flag & SL_LIDAR_RESP_HQ_FLAG_SYNCBIT);
+}
+
+template <typename Predicate>
+static bool waitFor(Predicate predicate) {
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(WAIT_TIMEOUT_MS);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <serial port> [baudrate]\n", argv[0]);
+        return 2;
+    }
+    int baudrate = argc > 2 ? atoi(argv[2]) : DEFAULT_BAUDRATE;
+
+    ILidarDriver* drv = *createLidarDriver();
+    IChannel* channel = *createSerialPortChannel(argv[1], baudrate);
+    if (!drv || !channel || SL_IS_FAIL(drv->connect(channel))) {
+        fprintf(stderr, "cannot connect to %s at %d\n", argv[1], baudrate);
+        return 2;
+    }
+
+    std::mutex lock;
+    std::vector<char> callOrder;
+    std::deque<HeldScan> held;
+    std::atomic<int> firstCalls(0);
+    std::atomic<int> secondCalls(0);
+    uint64_t lastSequence = 0;
+    bool sequenceOk = true;
+    bool scansOk = true;
+
+    // keeps the newest few scans, as a listener handing them to its own thread would
+    int first = drv->registerScanListener([&](const LidarScanPtr& scan) {
+        std::lock_guard<std::mutex> l(lock);
+        if (!validScan(*scan)) scansOk = false;
+        if (lastSequence && scan->sequence != lastSequence + 1) sequenceOk = false;
+        lastSequence = scan->sequence;
+        callOrder.push_back('1');
+        held.push_back(HeldScan{ scan, scanChecksum(*scan) });
+        if (held.size() > HELD_SCANS) held.pop_front();
+        ++firstCalls;
+    });
+    int second = drv->registerScanListener([&](const LidarScanPtr&) {
+        std::lock_guard<std::mutex> l(lock);
+        callOrder.push_back('2');
+        ++secondCalls;
+    });
+
+    LidarScanMode mode;
+    if (SL_IS_FAIL(drv->startScan(false, true, 0, &mode))) {
+        fprintf(stderr, "cannot start scanning\n");
+        delete drv;
+        return 2;
+    }
+
+    // borrow alongside the listeners, holding each scan across the next borrow
+    LidarScanPtr borrowed;
+    int borrowedScans = 0;
+    while (firstCalls < LISTENER_SCANS && borrowedScans < LISTENER_SCANS * 10) {
+        LidarScanPtr next;
+        if (SL_IS_FAIL(drv->borrowScanDataHq(next, 1000))) break;
+        CHECK(validScan(*next));
+        CHECK(!borrowed || next->sequence > borrowed->sequence);
+        borrowed = next;
+        ++borrowedScans;
+    }
+    CHECK(firstCalls >= LISTENER_SCANS);
+    CHECK(borrowedScans > 0);
+
+    drv->unregisterScanListener(second);
+    {
+        std::lock_guard<std::mutex> l(lock);
+        CHECK(scansOk);
+        CHECK(sequenceOk);
+        CHECK(callOrder.size() >= 2 && callOrder[0] == '1');
+        for (size_t i = 0; i + 1 < callOrder.size(); i += 2) {
+            CHECK(callOrder[i] == '1' && callOrder[i + 1] == '2');
+        }
+        for (const HeldScan& scan : held) CHECK(scanChecksum(*scan.scan) == scan.checksum);
+    }
+    int secondAtUnregister = secondCalls;
+    int firstAtUnregister = firstCalls;
+    CHECK(waitFor([&] { return firstCalls >= firstAtUnregister + 3; }));
+    CHECK(secondCalls == secondAtUnregister);
+
+    // unregister while the listener is still running on the decoder thread
+    std::atomic<bool> inFlight(false);
+    std::atomic<int> slowCalls(0);
+    int slow = drv->registerScanListener([&](const LidarScanPtr&) {
+        inFlight = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        ++slowCalls;
+        inFlight = false;
+    });
+    CHECK(waitFor([&] { return inFlight.load(); }));
+    drv->unregisterScanListener(slow);
+    CHECK(!inFlight);
+    int slowAtUnregister = slowCalls;
+    CHECK(slowAtUnregister >= 1);
+    firstAtUnregister = firstCalls;
+    CHECK(waitFor([&] { return firstCalls >= firstAtUnregister + 3; }));
+    CHECK(slowCalls == slowAtUnregister);
+    CHECK(!inFlight);
+
+    drv->unregisterScanListener(first);
+    drv->stop();
+    drv->disconnect();
+    delete drv;
+    delete channel;
+
+    // lent scans outlive the driver
+    for (const HeldScan& scan : held) CHECK(scanChecksum(*scan.scan) == scan.checksum);
+    CHECK(validScan(*borrowed));
+
+    if (failures) {
+        fprintf(stderr, "%d scan listener check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all scan listener checks passed (%d listener scans, %d borrowed, mode %s)\n",
+           (int)firstCalls, borrowedScans, mode.scan_mode);
+    return 0;
+}
@@ -0,0 +1,135 @@
+// Measures the shared-memory scan ring: publish cost, reader copy cost and
+// publish-to-read latency for 8192-node scans, with one writer thread and
+// any number of reader threads polling readNext().
+//
+//   scan_shm_bench [scans] [readers] [publish_interval_us]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "scan_shm_publisher.h"
+#include "scan_shm_reader.h"
+
+static const size_t SCAN_NODES = 8192;
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct ReaderStats {
+    ReaderStats() : scans(0), missed(0), copyNs(0) {}
+
+    uint64_t scans;
+    uint64_t missed;
+    int64_t copyNs;
+    std::vector<int64_t> latencyNs;
+};
+
+static void readerMain(const std::string& name, uint64_t expectedScans, std::atomic<bool>& writerDone, ReaderStats& stats) {
+    ScanShmReader reader;
+    if (!reader.open(name)) {
+        fprintf(stderr, "reader failed to open %s\n", name.c_str());
+        return;
+    }
+
+    ScanFrame frame;
+    frame.nodes.reserve(SCAN_NODES);
+    stats.latencyNs.reserve(expectedScans);
+
+    while (true) {
+        int64_t begin = nowNs();
+        ScanShmReader::Result result = reader.readNext(frame);
+        int64_t end = nowNs();
+
+        if (result == ScanShmReader::READ_OK || result == ScanShmReader::READ_OVERRUN) {
+            ++stats.scans;
+            stats.copyNs += end - begin;
+            // the bench writer stores its publish time in timestampUs, in ns
+            stats.latencyNs.push_back(end - (int64_t)frame.timestampUs);
+            if (frame.sequence == expectedScans) break;
+            continue;
+        }
+        if (writerDone && reader.published() >= expectedScans && result == ScanShmReader::READ_NONE) break;
+        std::this_thread::yield();
+    }
+    stats.missed = reader.missed();
+}
+
+static int64_t percentile(std::vector<int64_t>& values, double fraction) {
+    if (values.empty()) return 0;
+    size_t index = std::min(values.size() - 1, (size_t)(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t scans = (argc > 1) ? strtoull(argv[1], nullptr, 10) : 2000;
+    int readers = (argc > 2) ? atoi(argv[2]) : 1;
+    int intervalUs = (argc > 3) ? atoi(argv[3]) : 1000;
+    if (!scans || readers <= 0 || intervalUs < 0) {
+        fprintf(stderr, "Usage: %s [scans] [readers] [publish_interval_us]\n", argv[0]);
+        return 1;
+    }
+
+    std::string name = "/scan_shm_bench_" + std::to_string(getpid());
+    ScanShmPublisher publisher;
+    if (!publisher.open(name)) {
+        fprintf(stderr, "failed to create %s\n", name.c_str());
+        return 1;
+    }
+
+    ScanFrame frame;
+    frame.scanMode = 0;
+    frame.nodes.resize(SCAN_NODES);
+    for (size_t i = 0; i < SCAN_NODES; ++i) {
+        frame.nodes[i].angle_z_q14 = (uint16_t)(i * 65536 / SCAN_NODES);
+        frame.nodes[i].dist_mm_q2 = (uint32_t)(4000 + i);
+        frame.nodes[i].quality = 47 << 2;
+        frame.nodes[i].flag = 0;
+    }
+
+    std::atomic<bool> writerDone(false);
+    std::vector<ReaderStats> stats(readers);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readers; ++i) {
+        threads.push_back(std::thread(readerMain, name, scans, std::ref(writerDone), std::ref(stats[i])));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    int64_t publishNs = 0;
+    for (uint64_t sequence = 1; sequence <= scans; ++sequence) {
+        frame.sequence = sequence;
+        int64_t begin = nowNs();
+        frame.timestampUs = (uint64_t)begin;
+        publisher.publish(frame);
+        publishNs += nowNs() - begin;
+        if (intervalUs) std::this_thread::sleep_for(std::chrono::microseconds(intervalUs));
+    }
+    writerDone = true;
+
+    for (auto& thread : threads) thread.join();
+    publisher.close();
+
+    double scanBytes = SCAN_NODES * sizeof(sl_lidar_response_measurement_node_hq_t);
+    double avgPublishNs = (double)publishNs / scans;
+    printf("%zu nodes, %llu scans, %d reader(s), publish every %d us\n",
+           SCAN_NODES, (unsigned long long)scans, readers, intervalUs);
+    printf("publish      %10.0f ns/scan %8.1f MB/s\n", avgPublishNs, scanBytes / avgPublishNs * 1000.0);
+
+    for (int i = 0; i < readers; ++i) {
+        ReaderStats& s = stats[i];
+        double avgCopyNs = s.scans ? (double)s.copyNs / s.scans : 0;
+        printf("reader %-4d  %10.0f ns/scan %8.1f MB/s  got %llu missed %llu  latency p50 %lld ns p99 %lld ns\n",
+               i, avgCopyNs, avgCopyNs ? scanBytes / avgCopyNs * 1000.0 : 0.0,
+               (unsigned long long)s.scans, (unsigned long long)s.missed,
+               (long long)percentile(s.latencyNs, 0.5), (long long)percentile(s.latencyNs, 0.99));
+    }
+    return 0;
+}
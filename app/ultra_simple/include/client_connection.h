@@ -0,0 +1,163 @@
+#ifndef CLIENT_CONNECTION_H
+#define CLIENT_CONNECTION_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "input_ring.h"
+#include "scan_filter.h"
+#include "scan_wire_format.h"
+#include "shared_buffer.h"
+
+// What to do with a subscriber whose socket cannot keep up with the scan rate.
+enum SlowConsumerPolicy {
+    SLOW_CONSUMER_DROP_OLDEST = 0,  // replace the oldest queued frame with the new one
+    SLOW_CONSUMER_DROP_NEWEST = 1,  // keep the queue, skip the new frame
+    SLOW_CONSUMER_DISCONNECT = 2,   // close the connection once it falls too far behind
+};
+
+// a client that sends this much without completing a command is not speaking our protocol
+static const size_t CLIENT_INPUT_RING_BYTES = 16 * 1024;
+// commands parsed but not answered yet; at this many the rest of the input is
+// left in the ring and the socket until some of them complete
+static const size_t MAX_CLIENT_COMMAND_BACKLOG = 256;
+
+// One queued write. Only pushed scan frames may be dropped; command replies
+// are always delivered so every request still gets its answer.
+struct OutputChunk {
+    // on a framed connection the CommandFrameHeader goes out just before data
+    size_t size() const { return frameHeaderBytes + data->size(); }
+
+    SharedBuffer data;
+    bool droppableFrame;
+    int64_t queuedMs;
+    char frameHeader[sizeof(CommandFrameHeader)];
+    uint8_t frameHeaderBytes;
+    // pushed frames only, for latency tracing
+    uint64_t queuedUs;
+    uint64_t scanRxUs;
+};
+
+struct PendingCommand {
+    uint32_t requestId;
+    std::string text;
+    // the connection's device when the command was dispatched, so a later
+    // DEVICE does not redirect a LiDAR command still waiting for a worker
+    size_t device;
+};
+
+// Per-socket state owned by the TcpServer event loop. Only the loop thread
+// touches these fields; command workers get copies of what they need.
+struct ClientConnection {
+    ClientConnection(uint64_t id, int fd, const std::string& peerAddress, int64_t nowMs)
+        : id(id)
+        , fd(fd)
+        , peerAddress(peerAddress)
+        , input(CLIENT_INPUT_RING_BYTES)
+        , framedInput(false)
+        , framed(false)
+        , outputOffset(0)
+        , queuedFrames(0)
+        , slowConsumerPolicy(SLOW_CONSUMER_DROP_OLDEST)
+        , framesSent(0)
+        , framesDropped(0)
+        , maxLagMs(0)
+        , commandInFlight(false)
+        , device(0)
+        , encoding(SCAN_ENCODING_JSON)
+        , subscribed(false)
+        , scanRequested(false)
+        , holdsScan(false)
+        , deltaBaseSequence(0)
+        , sampleAfterSequence(0)
+        , sampleDeadlineMs(0)
+        , closeAfterFlush(false)
+        , inputClosed(false)
+        , inputPaused(false)
+        , lastActivityMs(nowMs) {}
+
+    bool hasPendingOutput() const {
+        return !outputQueue.empty();
+    }
+
+    bool waitingForSample() const {
+        return !sampleRequestIds.empty();
+    }
+
+    // a line protocol connection answers one command at a time
+    bool busy() const {
+        return commandInFlight || waitingForSample();
+    }
+
+    bool commandBacklogFull() const {
+        return pendingCommands.size() + workerCommands.size() + sampleRequestIds.size() >= MAX_CLIENT_COMMAND_BACKLOG;
+    }
+
+    // the peer half-closed and every command it sent has been answered
+    bool inputDone() const {
+        return inputClosed && !busy() && pendingCommands.empty() && workerCommands.empty();
+    }
+
+    // how long the oldest unsent chunk has been waiting
+    int64_t lagMs(int64_t nowMs) const {
+        return outputQueue.empty() ? 0 : nowMs - outputQueue.front().queuedMs;
+    }
+
+    uint64_t id;
+    int fd;
+    std::string peerAddress;
+
+    InputRing input;
+    // framedInput flips as soon as PROTOCOL FRAMED is parsed, framed once it
+    // has been answered, so earlier replies still go out as plain lines
+    bool framedInput;
+    bool framed;
+
+    // buffers may be shared with other connections and are never modified;
+    // outputOffset is how much of the front buffer has already been sent
+    std::deque<OutputChunk> outputQueue;
+    size_t outputOffset;
+    size_t queuedFrames;
+
+    SlowConsumerPolicy slowConsumerPolicy;
+    uint64_t framesSent;
+    uint64_t framesDropped;
+    int64_t maxLagMs;
+
+    std::deque<PendingCommand> pendingCommands;
+    // LiDAR commands reach the workers one at a time per connection, so they
+    // take effect in the order sent even when framed replies do not
+    std::deque<PendingCommand> workerCommands;
+    bool commandInFlight;
+
+    // index into the server's devices, picked with DEVICE <id>
+    size_t device;
+    ScanEncoding encoding;
+    bool subscribed;
+    // START_SCAN without a STOP yet; either this or subscribed keeps one
+    // reference on the device's scan, holdsScan says whether it is taken
+    bool scanRequested;
+    bool holdsScan;
+    ScanFilter filter;
+    std::string filterKey;
+    // last scan queued on a DELTA stream, 0 forces the next one to be a keyframe
+    uint64_t deltaBaseSequence;
+
+    // GET_SAMPLE requests parked until a frame newer than sampleAfterSequence arrives
+    std::vector<uint32_t> sampleRequestIds;
+    uint64_t sampleAfterSequence;
+    int64_t sampleDeadlineMs;
+
+    bool closeAfterFlush;
+    // the peer shut down its side, close once everything it sent is answered
+    bool inputClosed;
+    // parsing stopped at MAX_CLIENT_COMMAND_BACKLOG with input still buffered
+    bool inputPaused;
+    int64_t lastActivityMs;
+};
+
+typedef std::shared_ptr<ClientConnection> ClientConnectionPtr;
+
+#endif // CLIENT_CONNECTION_H
@@ -0,0 +1,69 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Single-threaded epoll reactor. All fd handlers and timers run on the thread
+// that calls run(); other threads hand work over with post().
+class EventLoop {
+public:
+    typedef std::function<void(uint32_t events)> IoHandler;
+    typedef std::function<void()> Task;
+
+    EventLoop();
+    ~EventLoop();
+
+    bool init();
+    // Runs until quit(), which may also come before run(); a loop runs once.
+    void run();
+    void quit();
+
+    // Thread-safe: queue a task for the loop thread and wake it up.
+    void post(Task task);
+
+    bool addFd(int fd, uint32_t events, IoHandler handler);
+    bool modifyFd(int fd, uint32_t events);
+    void removeFd(int fd);
+
+    // Periodic callback on the loop thread, returns the timer id.
+    int addTimer(int intervalMs, Task task);
+    void removeTimer(int timerId);
+
+    bool isInLoopThread() const;
+
+    static int64_t nowMs();
+
+private:
+    struct Timer {
+        int id;
+        int intervalMs;
+        int64_t nextFireMs;
+        Task task;
+    };
+
+    int computeWaitTimeout() const;
+    void runTimers();
+    void runPendingTasks();
+
+    int epollFd;
+    int wakeupFd;
+    std::atomic<bool> running;
+    std::thread::id loopThreadId;
+
+    std::unordered_map<int, std::shared_ptr<IoHandler> > handlers;
+
+    std::mutex taskMutex;
+    std::vector<Task> pendingTasks;
+
+    std::vector<Timer> timers;
+    int nextTimerId;
+};
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,42 @@
+#ifndef INPUT_RING_H
+#define INPUT_RING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+// Fixed-capacity byte ring a connection's commands are received into. The
+// socket reads straight into the free space and parsed commands are consumed
+// by advancing the read position, so nothing is ever shifted or reallocated.
+class InputRing {
+public:
+    static const size_t npos = (size_t)-1;
+
+    // capacity is rounded up to a power of two
+    explicit InputRing(size_t capacity);
+
+    size_t size() const { return (size_t)(tail - head); }
+    size_t capacity() const { return data.size(); }
+    bool empty() const { return head == tail; }
+
+    // Free space as at most two regions for readv(), returns the region count.
+    int writableRegions(iovec regions[2]);
+    void commit(size_t bytes);
+
+    // Offset from the read position of the first `value` at or after `from`.
+    size_t find(char value, size_t from) const;
+    unsigned char at(size_t offset) const { return (unsigned char)data[(head + offset) & mask]; }
+    // Append length bytes starting at offset to out.
+    void copyTo(size_t offset, size_t length, std::string& out) const;
+    void consume(size_t bytes);
+
+private:
+    std::vector<char> data;
+    size_t mask;
+    uint64_t head;
+    uint64_t tail;
+};
+
+#endif // INPUT_RING_H
@@ -0,0 +1,54 @@
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Microseconds of the monotonic clock. On Linux both this and the SDK's
+// getus() read CLOCK_MONOTONIC, so SDK stage timestamps compare directly.
+uint64_t monotonicUs();
+
+// The legs of a scan's trip from the serial port to a client socket.
+enum LatencyStage {
+    LATENCY_RX_TO_DECODE = 0,        // SDK rx thread to the sample decoder
+    LATENCY_DECODE_TO_COMPLETE = 1,  // first node to the end of the revolution
+    LATENCY_COMPLETE_TO_GRAB = 2,    // waiting for the acquisition thread
+    LATENCY_GRAB_TO_SERIALIZE = 3,   // event loop hand-off plus encoding
+    LATENCY_QUEUE_TO_SEND = 4,       // queued on a connection until fully sent
+    LATENCY_TOTAL = 5,               // first rx byte to the last byte sent
+    LATENCY_STAGE_COUNT = 6,
+};
+
+extern const char* const LATENCY_STAGE_NAMES[LATENCY_STAGE_COUNT];
+
+// Log-linear histogram of microsecond latencies: exact below 16us, then eight
+// buckets per power of two, so percentiles are within 12.5%. Any thread may
+// record; reads are relaxed snapshots.
+class LatencyHistogram {
+public:
+    static const size_t SUB_BUCKETS = 8;
+    static const size_t LINEAR_LIMIT = 16;
+    // up to 2^40 us, about twelve days
+    static const size_t BUCKET_COUNT = LINEAR_LIMIT + (40 - 4) * SUB_BUCKETS;
+
+    LatencyHistogram();
+
+    void record(uint64_t valueUs);
+    void reset();
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t maxUs() const { return maximum.load(std::memory_order_relaxed); }
+    // upper bound of the bucket holding the given fraction, e.g. 0.99
+    uint64_t percentileUs(double fraction) const;
+
+private:
+    static size_t bucketIndex(uint64_t valueUs);
+    static uint64_t bucketUpperBound(size_t index);
+
+    std::atomic<uint64_t> buckets[BUCKET_COUNT];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> maximum;
+};
+
+#endif // LATENCY_TRACE_H
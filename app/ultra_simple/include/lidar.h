@@ -5,23 +5,102 @@
 #include <thread>
 #include <string>
 #include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include "scan_frame.h"
 
 using namespace sl;
 
 class Lidar {
 public:
+    typedef std::function<void(const ScanFramePtr&)> FrameListener;
+
     Lidar();
     ~Lidar();
 
+    // A port of the form replay:<file> plays back a recording instead of
+    // opening a serial port; the baudrate is ignored then.
     bool initialize(const std::string& port, sl_u32 baudrate);
+    // Playback speed of replay ports, 1 is real time and 0 as fast as possible.
+    void setReplaySpeed(float speed);
+    // Pin the acquisition thread to this CPU once it starts, -1 lets it float.
+    void setAcquisitionCpu(int cpu);
     bool checkHealth();
     void shutdown();
 
     ILidarDriver* getDriver();
 
+    // Raw byte recording for offline decoder analysis, see sl_lidar_recording.h.
+    // Starting again closes the previous file first.
+    bool startRecording(const std::string& path);
+    void stopRecording();
+    // Empty when not recording.
+    std::string recordingPath();
+
+    // Scanning is shared by reference count. The first acquireScan() spins the
+    // motor up; after the last releaseScan() it keeps turning for the linger
+    // time, so a client that arrives meanwhile gets scans straight away. Both
+    // only update the count, the acquisition thread does the starting and
+    // stopping and stays the only caller of borrowScanDataHq.
+    void acquireScan();
+    void releaseScan();
+    void setScanLinger(int ms);
+    int scanReferenceCount();
+    // Block until the device is scanning, false if a start attempt fails first.
+    bool waitUntilScanning(int timeoutMs);
+    bool isScanning() const;
+
+    // Scans published since the Lidar was created.
+    uint64_t publishedFrameCount();
+    // Latest published frame, null until the first scan after scanning starts.
+    ScanFramePtr latestFrame();
+
+    // Called on the acquisition thread for every published frame, in the
+    // order they were added. Returns an id for removeFrameListener().
+    int addFrameListener(FrameListener listener);
+    // Waits for an in-flight callback, the listener is never called afterwards.
+    void removeFrameListener(int listenerId);
+
 private:
-    ILidarDriver* drv;
-    bool isHealthy;
+    void acquisitionMain();
+    void stopAcquisition();
+    void pinAcquisitionThread();
+    bool startScanning();
+    void stopScanning();
+
+    // only set once connected, so other threads never see a half-initialized driver
+    std::atomic<ILidarDriver*> drv;
+    std::atomic<bool> isHealthy;
+
+    std::atomic<bool> scanning;
+    uint16_t scanMode;
+
+    std::thread acquisitionThread;
+    int acquisitionCpu;
+    float replaySpeed;
+    int scanReferences;
+    int scanLingerMs;
+    std::chrono::steady_clock::time_point lingerUntil;
+    uint64_t startFailures;
+    std::mutex frameMutex;
+    std::condition_variable frameCondition;
+    ScanFramePtr latest;
+    uint64_t nextSequence;
+    bool acquisitionStopping;
+
+    std::mutex listenerMutex;
+    std::map<int, FrameListener> frameListeners;
+    int nextListenerId;
+
+    std::mutex recordMutex;
+    std::string recording;
+
+    // held while starting or stopping a scan, so a health query cannot slip
+    // in between and end the scan just started
+    std::mutex scanCommandMutex;
 };
 
 #endif // LIDAR_H
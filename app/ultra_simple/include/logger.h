@@ -0,0 +1,99 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+enum LogLevel {
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO = 1,
+    LOG_LEVEL_WARN = 2,
+    LOG_LEVEL_ERROR = 3,
+    LOG_LEVEL_OFF = 4,
+};
+
+// Asynchronous logger. Callers format into a slot of a lock-free bounded ring
+// and return immediately; a background thread writes the slots out in
+// batches. When the ring is full the message is dropped and counted rather
+// than blocking the caller.
+class Logger {
+public:
+    static Logger& instance();
+
+    ~Logger();
+
+    void setLevel(LogLevel level);
+    LogLevel level() const;
+    bool isEnabled(LogLevel level) const {
+        return level >= minLevel.load(std::memory_order_relaxed);
+    }
+
+    void log(LogLevel level, const char* format, ...)
+#ifdef __GNUC__
+        __attribute__((format(printf, 3, 4)))
+#endif
+        ;
+
+    // Counts a message that a rate limiter swallowed.
+    void noteSuppressed();
+
+    // Write out everything queued so far and stop the flusher thread.
+    void shutdown();
+
+    static bool parseLevel(const std::string& name, LogLevel& level);
+    static const char* levelName(LogLevel level);
+
+private:
+    struct Slot;
+
+    Logger();
+    void flusherMain();
+    size_t drain();
+
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<size_t> head;
+    size_t tail;
+
+    std::atomic<int> minLevel;
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> stopping;
+    std::thread flusher;
+};
+
+// Lets at most maxPerSecond messages through per one second window.
+class LogRateLimiter {
+public:
+    explicit LogRateLimiter(uint32_t maxPerSecond);
+    bool allow();
+
+private:
+    uint32_t maxPerSecond;
+    std::atomic<int64_t> windowStartMs;
+    std::atomic<uint32_t> count;
+};
+
+// Arguments are only evaluated when the level is enabled.
+#define LOG_AT(level, ...) \
+    do { \
+        if (Logger::instance().isEnabled(level)) Logger::instance().log(level, __VA_ARGS__); \
+    } while (0)
+
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+// For messages a misbehaving peer can trigger at will.
+#define LOG_RATE_LIMITED(level, maxPerSecond, ...) \
+    do { \
+        if (Logger::instance().isEnabled(level)) { \
+            static LogRateLimiter logRateLimiter(maxPerSecond); \
+            if (logRateLimiter.allow()) Logger::instance().log(level, __VA_ARGS__); \
+            else Logger::instance().noteSuppressed(); \
+        } \
+    } while (0)
+
+#endif // LOGGER_H
@@ -0,0 +1,61 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Monotonic counter. Updates are relaxed atomic adds, cheap enough for any hot path.
+class MetricCounter {
+public:
+    MetricCounter() : value(0) {}
+
+    void add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value;
+};
+
+// Fixed-bucket histogram of durations in microseconds.
+class MetricHistogram {
+public:
+    static const size_t BUCKET_COUNT = 12;
+    // upper bounds, the last bucket takes everything above the one before it
+    static const uint64_t BUCKET_BOUNDS_US[BUCKET_COUNT - 1];
+
+    MetricHistogram();
+
+    void observe(uint64_t valueUs);
+    uint64_t bucket(size_t index) const { return buckets[index].load(std::memory_order_relaxed); }
+    uint64_t count() const;
+    uint64_t sumUs() const { return sum.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> buckets[BUCKET_COUNT];
+    std::atomic<uint64_t> sum;
+};
+
+// Appends metrics in the Prometheus text exposition format. labels are
+// written verbatim between the braces, e.g. device="front",encoding="json".
+class MetricsWriter {
+public:
+    explicit MetricsWriter(std::string& out) : out(out) {}
+
+    void describe(const char* name, const char* type, const char* help);
+    void sample(const char* name, const std::string& labels, uint64_t value);
+    void sample(const char* name, const std::string& labels, double value);
+    // histograms are exported in seconds, as Prometheus expects
+    void histogram(const char* name, const std::string& labels, const MetricHistogram& histogram);
+
+    // Quote and escape a label value.
+    static std::string label(const char* name, const std::string& value);
+
+private:
+    void writeName(const char* name, const char* suffix, const std::string& labels);
+
+    std::string& out;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,45 @@
+#ifndef METRICS_HTTP_SERVER_H
+#define METRICS_HTTP_SERVER_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include "event_loop.h"
+
+// Minimal HTTP responder for Prometheus scrapes. It answers GET /metrics with
+// whatever the renderer returns and closes the connection, all on an existing
+// EventLoop so the renderer can read loop-owned state without locking.
+class MetricsHttpServer {
+public:
+    typedef std::function<std::string()> Renderer;
+
+    MetricsHttpServer(EventLoop& loop, Renderer renderer);
+    ~MetricsHttpServer();
+
+    // Must be called on the loop thread, like close().
+    bool open(int port);
+    void close();
+
+private:
+    struct Request {
+        std::string input;
+        std::string output;
+        size_t sent;
+        int64_t acceptedMs;
+    };
+
+    void onAcceptReady();
+    void onRequestEvent(int fd, uint32_t events);
+    bool readRequest(int fd, Request& request);
+    bool writeResponse(int fd, Request& request);
+    void closeRequest(int fd);
+    void sweepStaleRequests();
+
+    EventLoop& loop;
+    Renderer renderer;
+    int listenFd;
+    int sweepTimer;
+    std::map<int, Request> requests;
+};
+
+#endif // METRICS_HTTP_SERVER_H
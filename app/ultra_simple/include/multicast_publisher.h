@@ -0,0 +1,41 @@
+#ifndef MULTICAST_PUBLISHER_H
+#define MULTICAST_PUBLISHER_H
+
+#include <cstdint>
+#include <string>
+#include "shared_buffer.h"
+
+// Sends every scan once to a UDP multicast group, so any number of listeners
+// on the segment cost the server the same as one. Scans go out as BINARY
+// messages split into ScanDatagramHeader-prefixed fragments; listeners put
+// them back together with ScanDatagramReassembler.
+//
+// Delivery is best effort: if the socket buffer is full the rest of the scan
+// is dropped and listeners see the gap in datagram sequence numbers. Each
+// publisher tags its datagrams with its own session, so listeners that
+// outlive a server restart start over instead of waiting for old sequences.
+class MulticastPublisher {
+public:
+    MulticastPublisher();
+    ~MulticastPublisher();
+
+    // interfaceAddress selects the outgoing interface, empty for the default route.
+    bool open(const std::string& group, int port, int ttl, const std::string& interfaceAddress);
+    void close();
+    bool isOpen() const;
+
+    void publish(uint64_t scanSequence, const SharedBuffer& message);
+
+    uint64_t datagramsSent() const { return sent; }
+    uint64_t datagramsDropped() const { return dropped; }
+
+private:
+    int fd;
+    std::string destination;
+    uint32_t session;
+    uint32_t nextDatagramSequence;
+    uint64_t sent;
+    uint64_t dropped;
+};
+
+#endif // MULTICAST_PUBLISHER_H
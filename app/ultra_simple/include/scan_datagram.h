@@ -0,0 +1,92 @@
+#ifndef SCAN_DATAGRAM_H
+#define SCAN_DATAGRAM_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// UDP transport for serialized scans (see multicast_publisher.h).
+//
+// A scan message is split into fragments that each fit one datagram under
+// the MTU. Every datagram starts with a ScanDatagramHeader, little-endian
+// and unpadded like the rest of the wire format. datagramSequence increases
+// by one per datagram across all scans, so a gap means datagrams were lost.
+// session is picked anew each time a publisher starts; scan and datagram
+// sequences of a new session start over.
+
+static const uint32_t SCAN_DATAGRAM_MAGIC = 0x44535052; // "RPSD"
+static const uint8_t SCAN_DATAGRAM_VERSION = 2;
+// 1500 byte ethernet MTU minus IPv4 and UDP headers
+static const size_t MAX_SCAN_DATAGRAM_BYTES = 1472;
+
+#pragma pack(push, 1)
+struct ScanDatagramHeader {
+    uint32_t magic;
+    uint8_t  version;
+    uint8_t  reserved;
+    uint16_t fragmentIndex;
+    uint16_t fragmentCount;
+    uint16_t fragmentBytes;
+    uint32_t datagramSequence;
+    uint64_t scanSequence;
+    uint32_t messageBytes;
+    uint32_t fragmentOffset;
+    uint32_t session;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(ScanDatagramHeader) == 36, "ScanDatagramHeader must stay packed");
+
+static const size_t MAX_SCAN_FRAGMENT_BYTES = MAX_SCAN_DATAGRAM_BYTES - sizeof(ScanDatagramHeader);
+
+void encodeScanDatagramHeader(const ScanDatagramHeader& header, char* out);
+bool decodeScanDatagramHeader(const char* data, size_t size, ScanDatagramHeader& header);
+
+// Client helper: feed it every received datagram, it hands back complete
+// scan messages. Only the newest scan is assembled; one that is still
+// missing fragments when a newer scan starts is abandoned. A datagram from a
+// new session starts the stream over, as after a server restart.
+class ScanDatagramReassembler {
+public:
+    enum Result {
+        DATAGRAM_PENDING,       // stored, scan not complete yet
+        DATAGRAM_SCAN_COMPLETE, // message() holds a complete scan
+        DATAGRAM_IGNORED,       // duplicate or for an abandoned scan
+        DATAGRAM_INVALID,
+    };
+
+    ScanDatagramReassembler();
+
+    Result push(const char* data, size_t size);
+
+    const std::string& message() const { return assembled; }
+    uint64_t scanSequence() const { return currentScan; }
+
+    uint64_t datagramsReceived() const { return received; }
+    // datagrams implied missing by sequence gaps
+    uint64_t datagramsLost() const { return lost; }
+    uint64_t scansCompleted() const { return completed; }
+    uint64_t scansIncomplete() const { return incomplete; }
+    // times the stream started over with a new publisher session
+    uint64_t publisherRestarts() const { return restarts; }
+
+private:
+    bool haveSession;
+    uint32_t currentSession;
+    uint64_t currentScan;
+    bool currentDone;
+    std::string assembled;
+    std::vector<bool> fragmentSeen;
+    size_t fragmentsMissing;
+
+    bool haveDatagramSequence;
+    uint32_t nextDatagramSequence;
+
+    uint64_t received;
+    uint64_t lost;
+    uint64_t completed;
+    uint64_t incomplete;
+    uint64_t restarts;
+};
+
+#endif // SCAN_DATAGRAM_H
@@ -0,0 +1,103 @@
+#ifndef SCAN_DELTA_CODEC_H
+#define SCAN_DELTA_CODEC_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "scan_frame.h"
+#include "scan_wire_format.h"
+
+// Delta scan stream, negotiated per connection with FORMAT DELTA.
+//
+// Each scan is first resampled onto binCount fixed angle bins, bin i covering
+// [i, i + 1) * 360 / binCount degrees. When several nodes land in one bin the
+// nearest valid one wins; a bin with no return has distance 0.
+//
+// Message layout: ScanWireHeader (messageType KEYFRAME or DELTA, nodeCount =
+// binCount), ScanDeltaHeader, then payloadBytes of records. A keyframe is a
+// delta against an all-zero scan and has baseSequence 0. A delta frame only
+// applies on top of the scan whose sequence is baseSequence; anything else
+// means a frame was lost and the client must wait for the next keyframe (or
+// send RESYNC to get one immediately).
+//
+// Records walk the bins in order, all numbers are LEB128 varints:
+//   0, run              run (>= 1) bins unchanged
+//   head                head - 1 = zigzag(distance delta) << 1 | qualityChanged,
+//                       followed by zigzag(quality delta) if qualityChanged
+
+static const uint16_t DEFAULT_DELTA_ANGLE_BINS = 3600;
+
+#pragma pack(push, 1)
+struct ScanDeltaHeader {
+    uint64_t baseSequence;
+    uint32_t payloadBytes;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(ScanDeltaHeader) == 12, "ScanDeltaHeader must stay packed");
+
+struct ScanDeltaBin {
+    uint32_t dist_mm_q2;
+    uint8_t quality;
+};
+
+// Server side: keeps the binned form of the last two scans.
+class ScanDeltaEncoder {
+public:
+    explicit ScanDeltaEncoder(uint16_t binCount = DEFAULT_DELTA_ANGLE_BINS);
+
+    // Bin the next published scan, the previous one becomes the delta base.
+    void update(const ScanFrame& frame);
+
+    uint64_t currentSequence() const { return current.sequence; }
+    uint64_t baseSequence() const { return previous.sequence; }
+
+    void encodeKeyframe(std::string& out) const;
+    // Only valid when baseSequence() != 0.
+    void encodeDelta(std::string& out) const;
+
+private:
+    struct BinnedScan {
+        uint64_t sequence;
+        uint64_t timestampUs;
+        uint16_t scanMode;
+        std::vector<ScanDeltaBin> bins;
+    };
+
+    void encode(ScanMessageType type, const std::vector<ScanDeltaBin>& base,
+                uint64_t baseSequence, std::string& out) const;
+
+    uint16_t binCount;
+    BinnedScan previous;
+    BinnedScan current;
+    std::vector<ScanDeltaBin> zeroBins;
+};
+
+// Client side: rebuilds binned scans from keyframes and deltas.
+class ScanDeltaDecoder {
+public:
+    enum Result {
+        DECODE_OK,
+        DECODE_NEED_KEYFRAME,   // delta for a scan we do not have, wait for a keyframe
+        DECODE_MALFORMED,
+    };
+
+    ScanDeltaDecoder();
+
+    // data must hold exactly one complete message.
+    Result decode(const char* data, size_t size);
+
+    uint64_t sequence() const { return currentSequence; }
+    uint64_t timestampUs() const { return currentTimestampUs; }
+    const std::vector<ScanDeltaBin>& bins() const { return currentBins; }
+
+private:
+    uint64_t currentSequence;
+    uint64_t currentTimestampUs;
+    std::vector<ScanDeltaBin> currentBins;
+};
+
+// Total size of the message at data, or 0 if size bytes do not yet hold a full header.
+size_t scanDeltaMessageSize(const char* data, size_t size);
+
+#endif // SCAN_DELTA_CODEC_H
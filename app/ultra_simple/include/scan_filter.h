@@ -0,0 +1,38 @@
+#ifndef SCAN_FILTER_H
+#define SCAN_FILTER_H
+
+#include <cstdint>
+#include <string>
+#include "scan_frame.h"
+
+// Per-connection view of a scan, set with
+//
+//   FILTER [angle_min=<deg>] [angle_max=<deg>] [max_range=<mm>] [min_quality=<q>] [decimate=<n>]
+//   FILTER OFF
+//
+// The angular window is [angle_min, angle_max) and wraps through 0 when
+// angle_min > angle_max. decimate keeps every n-th node inside the window
+// before the range and quality checks, so the survivors stay on an even
+// angular grid. min_quality uses the same 0-63 scale as the JSON output.
+struct ScanFilter {
+    ScanFilter();
+
+    bool isPassThrough() const;
+    // Equal filters produce equal keys, used to share filtered frames.
+    std::string key() const;
+    std::string describe() const;
+
+    void apply(const ScanFrame& in, ScanFrame& out) const;
+
+    // Parse the arguments after FILTER, false with a message on bad input.
+    static bool parse(const std::string& args, ScanFilter& filter, std::string& error);
+
+    // window in angle_z_q14 units, 65536 is a full turn
+    uint32_t minAngleQ14;
+    uint32_t maxAngleQ14;
+    uint32_t maxRangeQ2;    // 0 = unlimited
+    uint8_t minQuality;
+    uint32_t decimation;    // 1 = every node
+};
+
+#endif // SCAN_FILTER_H
@@ -0,0 +1,32 @@
+#ifndef SCAN_FRAME_H
+#define SCAN_FRAME_H
+
+#include <rplidar.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// When a scan passed each stage before it was published, in microseconds of
+// the monotonic clock (see monotonicUs()). 0 means the stage is unknown.
+struct ScanTiming {
+    ScanTiming() : rxUs(0), decodedUs(0), completedUs(0), grabbedUs(0) {}
+
+    uint64_t rxUs;         // serial bytes of the first node read by the SDK
+    uint64_t decodedUs;    // first node decoded
+    uint64_t completedUs;  // revolution closed by the next sync node
+    uint64_t grabbedUs;    // copied out of the SDK by the acquisition thread
+};
+
+// One complete, angle-ascending revolution. Frames are never modified after
+// they are published, so any number of readers may share one without locking.
+struct ScanFrame {
+    uint64_t sequence;
+    uint64_t timestampUs;
+    uint16_t scanMode;
+    ScanTiming timing;
+    std::vector<sl_lidar_response_measurement_node_hq_t> nodes;
+};
+
+typedef std::shared_ptr<const ScanFrame> ScanFramePtr;
+
+#endif // SCAN_FRAME_H
@@ -0,0 +1,22 @@
+#ifndef SCAN_JSON_WRITER_H
+#define SCAN_JSON_WRITER_H
+
+#include <string>
+#include "scan_frame.h"
+
+// Writes a scan response without building a json DOM. The output is byte for
+// byte what makeJsonResponse(command, {{"status","OK"},{"data",...}}) produced:
+//
+//   {"command":"GET_SAMPLE","response":{"data":[{"angle":..,"distance":..,"quality":..}],"status":"OK"}}\n
+//
+// angle (q14 * 90 / 2^14) and distance (q2 / 4) are exact binary fractions, so
+// printing their full decimal expansion matches the shortest round-trip form
+// nlohmann emits.
+
+// Upper bound on the bytes writeScanJson appends for nodeCount nodes.
+size_t scanJsonSizeBound(const std::string& command, size_t nodeCount);
+
+// Append the JSON encoding of frame to out.
+void writeScanJson(const std::string& command, const ScanFrame& frame, std::string& out);
+
+#endif // SCAN_JSON_WRITER_H
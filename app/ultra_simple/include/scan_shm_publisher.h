@@ -0,0 +1,34 @@
+#ifndef SCAN_SHM_PUBLISHER_H
+#define SCAN_SHM_PUBLISHER_H
+
+#include <string>
+#include "scan_frame.h"
+#include "scan_shm_ring.h"
+
+// Writes every scan into a shared-memory ring (see scan_shm_ring.h) for
+// readers on the same host. Publishing never blocks on readers; one that
+// falls a whole ring behind is told how many scans it missed.
+class ScanShmPublisher {
+public:
+    ScanShmPublisher();
+    ~ScanShmPublisher();
+
+    // name is a POSIX shm name such as "/rplidar_scans". Always creates a
+    // fresh ring, retiring any left under that name.
+    bool open(const std::string& name, uint32_t slotCount = DEFAULT_SCAN_SHM_SLOTS,
+              uint32_t maxNodes = DEFAULT_SCAN_SHM_MAX_NODES);
+    // Marks the ring closed, then unmaps and unlinks it; attached readers
+    // move on to the next ring published under the same name.
+    void close();
+    bool isOpen() const;
+
+    // Single writer: call from one thread only (the acquisition thread).
+    void publish(const ScanFrame& frame);
+
+private:
+    std::string name;
+    ScanShmHeader* header;
+    size_t mappedBytes;
+};
+
+#endif // SCAN_SHM_PUBLISHER_H
@@ -0,0 +1,70 @@
+#ifndef SCAN_SHM_READER_H
+#define SCAN_SHM_READER_H
+
+#include <string>
+#include "scan_frame.h"
+#include "scan_shm_ring.h"
+
+// Maps the server's shared-memory scan ring read-only. Reads are plain
+// memory accesses, no system calls; callers that want to block poll
+// readNext() at whatever rate suits them.
+//
+// The reader follows the publisher across restarts: once the ring it has
+// mapped is closed it re-opens the same name on the next read, reporting
+// READ_CLOSED (at the cost of one shm_open per read) until a new ring is
+// there and READ_RESET with the first scan from it.
+//
+// Link with libscan_shm_reader.a.
+class ScanShmReader {
+public:
+    enum Result {
+        READ_OK,
+        READ_NONE,      // nothing new yet
+        READ_OVERRUN,   // the writer lapped us, out holds the oldest scan still available
+        READ_RESET,     // the publisher restarted, out holds its oldest available scan
+        READ_CLOSED,    // not attached to a valid ring, the next read tries again
+    };
+
+    ScanShmReader();
+    ~ScanShmReader();
+
+    bool open(const std::string& name);
+    void close();
+    bool isOpen() const;
+
+    // Copy the newest complete scan into out. out's node storage is reused,
+    // so a long-lived frame makes this allocation free.
+    Result readLatest(ScanFrame& out);
+
+    // Copy the scan after the one the previous readNext returned. Starts
+    // with the newest scan present when the reader was opened.
+    Result readNext(ScanFrame& out);
+
+    // Scans skipped by READ_OVERRUN so far.
+    uint64_t missed() const { return missedTotal; }
+    // Scans the publisher has written since it created the ring.
+    uint64_t published() const;
+
+private:
+    enum CopyResult {
+        COPY_OK,
+        COPY_NOT_READY,
+        COPY_OVERWRITTEN,
+    };
+
+    CopyResult copySlot(uint64_t index, ScanFrame& out) const;
+    bool attach();
+    void detach();
+    bool validRing() const;
+    bool followPublisher();
+
+    std::string name;
+    const ScanShmHeader* header;
+    size_t mappedBytes;
+    uint64_t epoch;
+    uint64_t nextIndex;
+    uint64_t missedTotal;
+    bool resetPending;
+};
+
+#endif // SCAN_SHM_READER_H
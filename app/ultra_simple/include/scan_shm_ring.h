@@ -0,0 +1,65 @@
+#ifndef SCAN_SHM_RING_H
+#define SCAN_SHM_RING_H
+
+#include <rplidar.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Layout of the POSIX shared-memory scan ring shared by ScanShmPublisher
+// (writer, inside the server) and ScanShmReader (any local process).
+//
+// The object is one ScanShmHeader followed by slotCount slots of slotBytes
+// each. Scan number n (counting from 0) is written to slot n % slotCount.
+// Every slot is a seqlock: its generation is 2n + 1 while scan n is being
+// written and 2n + 2 once it is complete, so a reader that sees the same
+// even generation before and after copying has a consistent scan, and can
+// tell from the value alone whether it got the scan it wanted, an older one
+// or one that already overwrote it.
+
+static const uint32_t SCAN_SHM_MAGIC = 0x48535052; // "RPSH"
+static const uint32_t SCAN_SHM_VERSION = 1;
+static const uint32_t DEFAULT_SCAN_SHM_SLOTS = 16;
+static const uint32_t DEFAULT_SCAN_SHM_MAX_NODES = 8192;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring needs address-free 64-bit atomics");
+
+struct alignas(64) ScanShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t maxNodes;
+    uint64_t slotBytes;
+    // changes whenever a publisher (re)creates the ring
+    std::atomic<uint64_t> epoch;
+    // number of scans completely written so far
+    alignas(64) std::atomic<uint64_t> published;
+};
+
+struct alignas(64) ScanShmSlot {
+    std::atomic<uint64_t> generation;
+    uint64_t scanSequence;
+    uint64_t timestampUs;
+    uint32_t scanMode;
+    uint32_t nodeCount;
+    // followed by maxNodes nodes
+    sl_lidar_response_measurement_node_hq_t* nodes() {
+        return reinterpret_cast<sl_lidar_response_measurement_node_hq_t*>(this + 1);
+    }
+};
+
+inline size_t scanShmSlotBytes(uint32_t maxNodes) {
+    size_t bytes = sizeof(ScanShmSlot) + (size_t)maxNodes * sizeof(sl_lidar_response_measurement_node_hq_t);
+    return (bytes + 63) & ~(size_t)63;
+}
+
+inline size_t scanShmTotalBytes(uint32_t slotCount, uint32_t maxNodes) {
+    return sizeof(ScanShmHeader) + (size_t)slotCount * scanShmSlotBytes(maxNodes);
+}
+
+inline ScanShmSlot* scanShmSlot(ScanShmHeader* header, uint64_t index) {
+    char* base = reinterpret_cast<char*>(header + 1);
+    return reinterpret_cast<ScanShmSlot*>(base + (index % header->slotCount) * header->slotBytes);
+}
+
+#endif // SCAN_SHM_RING_H
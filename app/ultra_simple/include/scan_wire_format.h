@@ -0,0 +1,92 @@
+#ifndef SCAN_WIRE_FORMAT_H
+#define SCAN_WIRE_FORMAT_H
+
+#include <cstdint>
+#include <string>
+#include "scan_frame.h"
+
+// Compact binary scan encoding, negotiated per connection with FORMAT BINARY.
+//
+// Every binary message is a ScanWireHeader followed by nodeCount packed
+// ScanWireNode records. All integers are little-endian and there is no
+// padding. Command replies stay newline-delimited JSON, which always starts
+// with '{', so a client tells the two apart from the first byte.
+//
+// quality is the raw node quality (0-255); shift it right by
+// SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT to get the value the JSON format reports.
+
+enum ScanEncoding {
+    SCAN_ENCODING_JSON = 0,
+    SCAN_ENCODING_BINARY = 1,
+    SCAN_ENCODING_DELTA = 2,    // see scan_delta_codec.h, samples are sent as BINARY
+};
+
+static const int SCAN_ENCODING_COUNT = 3;
+
+enum ScanMessageType {
+    SCAN_MESSAGE_SAMPLE = 0,   // reply to GET_SAMPLE
+    SCAN_MESSAGE_PUSH = 1,     // SUBSCRIBE stream
+    SCAN_MESSAGE_KEYFRAME = 2, // DELTA stream, self-contained
+    SCAN_MESSAGE_DELTA = 3,    // DELTA stream, relative to an earlier scan
+};
+
+static const uint32_t SCAN_WIRE_MAGIC = 0x43535052; // "RPSC"
+static const uint8_t SCAN_WIRE_VERSION = 1;
+
+#pragma pack(push, 1)
+struct ScanWireHeader {
+    uint32_t magic;
+    uint8_t  version;
+    uint8_t  messageType;
+    uint16_t scanMode;
+    uint64_t sequence;
+    uint64_t timestampUs;
+    uint32_t nodeCount;
+};
+
+struct ScanWireNode {
+    uint16_t angle_z_q14;
+    uint32_t dist_mm_q2;
+    uint8_t  quality;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(ScanWireHeader) == 28, "ScanWireHeader must stay packed");
+static_assert(sizeof(ScanWireNode) == 7, "ScanWireNode must stay packed");
+
+size_t binaryScanSize(size_t nodeCount);
+
+// Append a ScanWireHeader in wire byte order.
+void encodeScanWireHeader(ScanMessageType type, uint16_t scanMode, uint64_t sequence,
+                          uint64_t timestampUs, uint32_t nodeCount, std::string& out);
+// Parse and validate a header, false if size is too short or magic/version differ.
+bool decodeScanWireHeader(const char* data, size_t size, ScanWireHeader& header);
+
+// Append the binary encoding of frame to out.
+void encodeBinaryScan(const ScanFrame& frame, ScanMessageType type, std::string& out);
+
+// Framed command protocol, negotiated per connection with PROTOCOL FRAMED.
+//
+// After the PROTOCOL reply every request and every reply is a CommandFrameHeader
+// followed by payloadBytes of payload. A request payload is the command text
+// without a newline; a reply payload is exactly what the line protocol would
+// have sent, so JSON replies keep their newline and scans keep their encoding.
+// Replies carry the requestId of their request and may arrive out of order;
+// requestId 0 is reserved for SUBSCRIBE pushes.
+
+static const uint32_t COMMAND_FRAME_PUSH_ID = 0;
+
+#pragma pack(push, 1)
+struct CommandFrameHeader {
+    uint32_t payloadBytes;
+    uint32_t requestId;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(CommandFrameHeader) == 8, "CommandFrameHeader must stay packed");
+
+// Write a CommandFrameHeader in wire byte order to out.
+void encodeCommandFrameHeader(uint32_t payloadBytes, uint32_t requestId, char* out);
+void decodeCommandFrameHeader(const unsigned char* data, CommandFrameHeader& header);
+
+#endif // SCAN_WIRE_FORMAT_H
@@ -0,0 +1,69 @@
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+#include <string>
+#include <vector>
+#include <rplidar.h>
+
+struct LidarDeviceConfig {
+    LidarDeviceConfig() : baudrate(0), cpu(-1), replaySpeed(1.0f) {}
+
+    std::string id;
+    std::string portPath;
+    sl_u32 baudrate;
+    // CPU the acquisition thread is pinned to, -1 to leave it to the scheduler
+    int cpu;
+    // pacing of a "replay:<file>" port, 1 is real time and 0 as fast as possible
+    float replaySpeed;
+};
+
+// Settings for a server hosting several LiDARs, read from a JSON file:
+//
+//   {
+//     "listen_port": 8002,
+//     "idle_timeout_s": 60,
+//     "log_level": "INFO",
+//     "scan_linger_ms": 5000,
+//     "metrics_port": 9102,
+//     "record_dir": "/var/lib/lidar/recordings",
+//     "queue_policy": "DROP_OLDEST",
+//     "max_queued_frames": 4,
+//     "disconnect_lag_ms": 2000,
+//     "delta_keyframe_interval": 50,
+//     "devices": [
+//       { "id": "front", "port": "/dev/ttyUSB0", "baudrate": 460800, "cpu": 2 },
+//       { "id": "rear",  "port": "/dev/ttyUSB1", "baudrate": 460800 },
+//       { "id": "bench", "port": "replay:/data/front.slrc", "baudrate": 0, "replay_speed": 2 }
+//     ]
+//   }
+//
+// Everything but the device list is optional.
+struct ServerConfig {
+    ServerConfig()
+        : listenPort(8002), idleTimeoutSeconds(60), logLevel("INFO"), scanLingerMs(5000), metricsPort(0)
+        , queuePolicy("DROP_OLDEST"), maxQueuedFrames(4), disconnectLagMs(2000)
+        , deltaKeyframeInterval(50) {}
+
+    int listenPort;
+    int idleTimeoutSeconds;
+    std::string logLevel;
+    // how long the motor keeps turning after the last client lets go of it
+    int scanLingerMs;
+    // Prometheus endpoint, 0 leaves it off
+    int metricsPort;
+    // RECORD START writes here, empty disables it
+    std::string recordDirectory;
+    // slow subscribers: the policy new connections start with, how many pushed
+    // frames each may have queued, and how far a DISCONNECT one may fall behind
+    std::string queuePolicy;
+    int maxQueuedFrames;
+    int disconnectLagMs;
+    // FORMAT DELTA subscribers get a keyframe every this many scans
+    int deltaKeyframeInterval;
+    std::vector<LidarDeviceConfig> devices;
+};
+
+// False with a readable reason in error if the file is missing or invalid.
+bool loadServerConfig(const std::string& path, ServerConfig& config, std::string& error);
+
+#endif // SERVER_CONFIG_H
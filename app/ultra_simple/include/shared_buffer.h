@@ -0,0 +1,15 @@
+#ifndef SHARED_BUFFER_H
+#define SHARED_BUFFER_H
+
+#include <memory>
+#include <string>
+
+// An immutable, refcounted chunk of serialized output. A scan is serialized
+// once and the same buffer is queued on every connection that wants it.
+typedef std::shared_ptr<const std::string> SharedBuffer;
+
+inline SharedBuffer makeSharedBuffer(std::string data) {
+    return std::make_shared<const std::string>(std::move(data));
+}
+
+#endif // SHARED_BUFFER_H
@@ -1,32 +1,186 @@
 #ifndef TCP_SERVER_H
 #define TCP_SERVER_H
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 #include <json.hpp>
+#include "client_connection.h"
+#include "event_loop.h"
+#include "latency_trace.h"
 #include "lidar.h"
+#include "metrics.h"
+#include "metrics_http_server.h"
+#include "multicast_publisher.h"
+#include "scan_delta_codec.h"
+#include "scan_json_writer.h"
+#include "scan_wire_format.h"
 
 class TcpServer {
 public:
-    TcpServer(int port, Lidar& lidar);
+    explicit TcpServer(int port);
     ~TcpServer();
 
+    // Serve a device to clients under id. The first device added is the one new
+    // connections start on; all devices must be added before start().
+    void addDevice(const std::string& id, Lidar& lidar);
+
+    // Drop clients that have been silent for this long, 0 disables the check.
+    void setIdleTimeout(int seconds);
+    // Threads used to run blocking LiDAR commands off the event loop.
+    void setWorkerThreadCount(int count);
+    // Policy for new connections, how many pushed frames each may have queued,
+    // and how far behind a SLOW_CONSUMER_DISCONNECT client may fall.
+    void setSlowConsumerPolicy(SlowConsumerPolicy policy, size_t maxQueuedFrames, int disconnectLagMs);
+    // DROP_OLDEST, DROP_NEWEST or DISCONNECT, as QUEUE_POLICY takes them.
+    static bool parseSlowConsumerPolicy(const std::string& name, SlowConsumerPolicy& policy);
+    // DELTA subscribers get a full keyframe every this many scans.
+    void setDeltaKeyframeInterval(int scans);
+    // Also send every scan of the first device to this multicast group; the
+    // publisher must outlive start().
+    void setMulticastPublisher(MulticastPublisher* publisher);
+    // Serve Prometheus metrics over HTTP on this port, 0 disables it.
+    void setMetricsPort(int port);
+    // Where RECORD START writes raw byte recordings; empty refuses RECORD.
+    void setRecordDirectory(const std::string& directory);
+
     void start();
     void stop();
 
 private:
-    void handleClient(int clientSocket);
-    void handleStartScan(int clientSocket);
-    void handleGetSample(int clientSocket);
-    void handleStopScan(int clientSocket);
-    void sendJsonResponse(int clientSocket, const std::string& command, const nlohmann::json& response);
+    struct CommandJob {
+        uint64_t connectionId;
+        uint32_t requestId;
+        size_t device;
+        std::string command;
+    };
+
+    // Everything derived from the latest scan for one filter, shared by every
+    // connection that uses the same filter.
+    struct FilteredStream {
+        FilteredStream() : lastUsedSequence(0) {}
+
+        ScanFramePtr source;
+        ScanFramePtr frame;
+        SharedBuffer messages[SCAN_ENCODING_COUNT][2];
+        ScanDeltaEncoder deltaEncoder;
+        SharedBuffer keyframe;
+        SharedBuffer delta;
+        uint64_t lastUsedSequence;
+    };
+
+    // One served LiDAR. Sequences are per device, so each keeps its own streams.
+    struct Device {
+        Device(const std::string& id, Lidar& lidar) : id(id), lidar(&lidar), frameListenerId(-1) {}
+
+        std::string id;
+        Lidar* lidar;
+        int frameListenerId;
+        // keyed by ScanFilter::key(), built lazily so a frame is filtered and
+        // serialized at most once per filter and encoding
+        std::map<std::string, FilteredStream> filteredStreams;
+    };
+
+    void onAcceptReady();
+    void onClientEvent(uint64_t connectionId, uint32_t events);
+    bool readFromClient(const ClientConnectionPtr& conn);
+    bool parseInput(const ClientConnectionPtr& conn);
+    bool processInput(const ClientConnectionPtr& conn);
+    bool resumeInput(const ClientConnectionPtr& conn);
+    bool flushOutput(const ClientConnectionPtr& conn);
+    void flushDeferred();
+    void queueOutput(const ClientConnectionPtr& conn, uint32_t requestId, const SharedBuffer& data);
+    void queueOutput(const ClientConnectionPtr& conn, uint32_t requestId, std::string data);
+    OutputChunk makeOutputChunk(const ClientConnectionPtr& conn, uint32_t requestId, const SharedBuffer& data, bool droppableFrame);
+    bool queueFrame(const ClientConnectionPtr& conn, const ScanFramePtr& frame);
+    SharedBuffer streamMessage(const ClientConnectionPtr& conn, const ScanFramePtr& frame);
+    FilteredStream& filteredStream(const ClientConnectionPtr& conn, const ScanFramePtr& frame);
+    FilteredStream& filteredStream(Device& device, const std::string& filterKey, const ScanFilter& filter,
+                                   const ScanFramePtr& frame);
+    SharedBuffer serializedScan(FilteredStream& stream, ScanEncoding encoding, ScanMessageType type);
+    void pruneFilteredStreams(Device& device, uint64_t sequence);
+    void sweepSlowConsumers();
+    void closeConnection(const ClientConnectionPtr& conn);
+    void sweepIdleConnections();
+    ClientConnectionPtr findConnection(uint64_t connectionId);
+
+    void dispatchNextCommand(const ClientConnectionPtr& conn);
+    void submitWorkerCommand(const ClientConnectionPtr& conn);
+    std::string handleProtocol(const std::string& protocol);
+    std::string handleQueuePolicy(const ClientConnectionPtr& conn, const std::string& policyName);
+    std::string handleClients();
+    std::string handleDevices();
+    std::string handleStats(const std::string& args);
+    std::string renderMetrics();
+    std::string handleSelectDevice(const ClientConnectionPtr& conn, const std::string& deviceId);
+    std::string handleFormat(const ClientConnectionPtr& conn, const std::string& format);
+    std::string handleResync(const ClientConnectionPtr& conn);
+    std::string handleFilter(const ClientConnectionPtr& conn, const std::string& args);
+    std::string handleSubscription(const ClientConnectionPtr& conn, bool subscribe);
+    void onScanFrame(size_t deviceIndex, const ScanFramePtr& frame);
+    void expireSampleWaiters();
+    void answerSampleWaiters(const ClientConnectionPtr& conn, const SharedBuffer& reply);
+    void completeCommand(uint64_t connectionId, uint32_t requestId, const std::string& response, bool closeAfterReply);
+    void workerMain();
+    std::string executeCommand(const CommandJob& job, bool& closeAfterReply);
+
+    std::string handleConnect(bool healthy);
+    std::string handleStartScan(Lidar& lidar);
+    std::string handleRecord(size_t deviceIndex, bool start);
+    void handleGetSample(const ClientConnectionPtr& conn, uint32_t requestId, bool fresh);
+    std::string handleStopScan(const ClientConnectionPtr& conn);
+    void updateScanReference(const ClientConnectionPtr& conn);
+    SharedBuffer cachedScanMessage(const ClientConnectionPtr& conn, const ScanFramePtr& frame, ScanMessageType type);
+    std::string makeScanMessage(ScanEncoding encoding, ScanMessageType type, const ScanFrame& frame);
+    std::string makeJsonResponse(const std::string& command, const nlohmann::json& response);
     void cleanupSocket(int socket);
 
     int serverSocket;
     int port;
-    bool running;
-    Lidar& lidar;
+    std::atomic<bool> running;
+    std::deque<Device> devices;
+
+    EventLoop loop;
+    std::unordered_map<uint64_t, ClientConnectionPtr> connections;
+    uint64_t nextConnectionId;
+    int idleTimeoutMs;
+    // connections with worker replies queued this loop pass, flushed together
+    std::vector<uint64_t> deferredFlushes;
+
+    SlowConsumerPolicy defaultSlowConsumerPolicy;
+    size_t maxQueuedFrames;
+    int disconnectLagMs;
+
+    int deltaKeyframeInterval;
+
+    MulticastPublisher* multicast;
+
+    MetricsHttpServer metricsServer;
+    int metricsPort;
+    std::string recordDirectory;
+    // totals across all connections, also the ones already closed
+    MetricCounter connectionsAccepted;
+    MetricCounter connectionsClosed;
+    MetricCounter commandsHandled;
+    MetricCounter bytesSent;
+    MetricCounter framesSentTotal;
+    MetricCounter framesDroppedTotal;
+    MetricHistogram serializeTime[SCAN_ENCODING_COUNT];
+    // per-stage latency of pushed scans, reported by STATS
+    LatencyHistogram latency[LATENCY_STAGE_COUNT];
+
+    int workerThreadCount;
+    std::vector<std::thread> workers;
+    std::mutex jobMutex;
+    std::condition_variable jobCondition;
+    std::deque<CommandJob> jobs;
+    bool workersStopping;
 };
 
 #endif // TCP_SERVER_H
@@ -0,0 +1,176 @@
+#include "event_loop.h"
+#include <algorithm>
+#include <chrono>
+#include "logger.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+
+static const int MAX_EVENTS_PER_WAIT = 256;
+
+// running starts out set so a quit() that comes before run() is not lost
+EventLoop::EventLoop()
+    : epollFd(-1), wakeupFd(-1), running(true), nextTimerId(1) {}
+
+EventLoop::~EventLoop() {
+    if (wakeupFd >= 0) close(wakeupFd);
+    if (epollFd >= 0) close(epollFd);
+}
+
+bool EventLoop::init() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        LOG_ERROR("Failed to create epoll instance");
+        return false;
+    }
+
+    wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeupFd < 0) {
+        LOG_ERROR("Failed to create wakeup eventfd");
+        return false;
+    }
+
+    int fd = wakeupFd;
+    return addFd(wakeupFd, EPOLLIN, [fd](uint32_t) {
+        uint64_t counter;
+        while (read(fd, &counter, sizeof(counter)) > 0) {}
+    });
+}
+
+int64_t EventLoop::nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void EventLoop::run() {
+    loopThreadId = std::this_thread::get_id();
+
+    epoll_event events[MAX_EVENTS_PER_WAIT];
+
+    while (running) {
+        int ready = epoll_wait(epollFd, events, MAX_EVENTS_PER_WAIT, computeWaitTimeout());
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("epoll_wait failed, errno %d", errno);
+            break;
+        }
+
+        for (int i = 0; i < ready; ++i) {
+            auto itr = handlers.find(events[i].data.fd);
+            if (itr == handlers.end()) continue;
+
+            // keep the handler alive even if it removes its own fd
+            std::shared_ptr<IoHandler> handler = itr->second;
+            (*handler)(events[i].events);
+        }
+
+        runPendingTasks();
+        runTimers();
+    }
+
+    runPendingTasks();
+}
+
+void EventLoop::quit() {
+    running = false;
+    if (wakeupFd >= 0) {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeupFd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+void EventLoop::post(Task task) {
+    {
+        std::lock_guard<std::mutex> l(taskMutex);
+        pendingTasks.push_back(std::move(task));
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeupFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+bool EventLoop::addFd(int fd, uint32_t events, IoHandler handler) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        return false;
+    }
+    handlers[fd] = std::make_shared<IoHandler>(std::move(handler));
+    return true;
+}
+
+bool EventLoop::modifyFd(int fd, uint32_t events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EventLoop::removeFd(int fd) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    handlers.erase(fd);
+}
+
+int EventLoop::addTimer(int intervalMs, Task task) {
+    Timer timer;
+    timer.id = nextTimerId++;
+    timer.intervalMs = std::max(1, intervalMs);
+    timer.nextFireMs = nowMs() + timer.intervalMs;
+    timer.task = std::move(task);
+    timers.push_back(std::move(timer));
+    return timers.back().id;
+}
+
+void EventLoop::removeTimer(int timerId) {
+    timers.erase(std::remove_if(timers.begin(), timers.end(),
+        [timerId](const Timer& t) { return t.id == timerId; }), timers.end());
+}
+
+bool EventLoop::isInLoopThread() const {
+    return loopThreadId == std::this_thread::get_id();
+}
+
+int EventLoop::computeWaitTimeout() const {
+    if (timers.empty()) return -1;
+
+    int64_t now = nowMs();
+    int64_t earliest = timers.front().nextFireMs;
+    for (const Timer& t : timers) {
+        earliest = std::min(earliest, t.nextFireMs);
+    }
+    return earliest <= now ? 0 : (int)(earliest - now);
+}
+
+void EventLoop::runTimers() {
+    int64_t now = nowMs();
+    // tasks may add or remove timers, so fire by id from a snapshot
+    std::vector<int> due;
+    for (const Timer& t : timers) {
+        if (t.nextFireMs <= now) due.push_back(t.id);
+    }
+
+    for (int id : due) {
+        for (size_t i = 0; i < timers.size(); ++i) {
+            if (timers[i].id != id) continue;
+            timers[i].nextFireMs = now + timers[i].intervalMs;
+            Task task = timers[i].task;
+            task();
+            break;
+        }
+    }
+}
+
+void EventLoop::runPendingTasks() {
+    std::vector<Task> tasks;
+    {
+        std::lock_guard<std::mutex> l(taskMutex);
+        tasks.swap(pendingTasks);
+    }
+    for (Task& task : tasks) {
+        task();
+    }
+}
@@ -0,0 +1,62 @@
+#include "input_ring.h"
+#include <cstring>
+
+static size_t roundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) result <<= 1;
+    return result;
+}
+
+InputRing::InputRing(size_t capacity)
+    : data(roundUpToPowerOfTwo(capacity)), mask(data.size() - 1), head(0), tail(0) {
+}
+
+int InputRing::writableRegions(iovec regions[2]) {
+    size_t free = capacity() - size();
+    if (!free) return 0;
+
+    size_t start = tail & mask;
+    size_t first = capacity() - start;
+    if (first > free) first = free;
+
+    regions[0].iov_base = &data[start];
+    regions[0].iov_len = first;
+    if (first == free) return 1;
+
+    regions[1].iov_base = &data[0];
+    regions[1].iov_len = free - first;
+    return 2;
+}
+
+void InputRing::commit(size_t bytes) {
+    tail += bytes;
+}
+
+size_t InputRing::find(char value, size_t from) const {
+    // search the stored bytes as at most two contiguous runs
+    while (from < size()) {
+        size_t start = (head + from) & mask;
+        size_t run = capacity() - start;
+        if (run > size() - from) run = size() - from;
+
+        const void* hit = memchr(&data[start], value, run);
+        if (hit) return from + ((const char*)hit - &data[start]);
+        from += run;
+    }
+    return npos;
+}
+
+void InputRing::copyTo(size_t offset, size_t length, std::string& out) const {
+    size_t start = (head + offset) & mask;
+    size_t first = capacity() - start;
+    if (first > length) first = length;
+
+    out.append(&data[start], first);
+    out.append(&data[0], length - first);
+}
+
+void InputRing::consume(size_t bytes) {
+    head += bytes;
+    // an empty ring restarts at the front so short commands never wrap
+    if (head == tail) head = tail = 0;
+}
@@ -0,0 +1,66 @@
+#include "latency_trace.h"
+#include <chrono>
+
+const char* const LATENCY_STAGE_NAMES[LATENCY_STAGE_COUNT] = {
+    "rx_to_decode", "decode_to_complete", "complete_to_grab", "grab_to_serialize", "queue_to_send", "total"
+};
+
+uint64_t monotonicUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::reset() {
+    for (auto& b : buckets) b.store(0, std::memory_order_relaxed);
+    total.store(0, std::memory_order_relaxed);
+    maximum.store(0, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t valueUs) {
+    if (valueUs < LINEAR_LIMIT) return (size_t)valueUs;
+
+    int exponent = 63 - __builtin_clzll(valueUs);
+    size_t sub = (size_t)(valueUs >> (exponent - 3)) & (SUB_BUCKETS - 1);
+    size_t index = LINEAR_LIMIT + (exponent - 4) * SUB_BUCKETS + sub;
+    return index < BUCKET_COUNT ? index : BUCKET_COUNT - 1;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+    if (index < LINEAR_LIMIT) return index;
+
+    size_t exponent = 4 + (index - LINEAR_LIMIT) / SUB_BUCKETS;
+    uint64_t sub = (index - LINEAR_LIMIT) % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub + 1) << (exponent - 3)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t valueUs) {
+    buckets[bucketIndex(valueUs)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t seen = maximum.load(std::memory_order_relaxed);
+    while (valueUs > seen && !maximum.compare_exchange_weak(seen, valueUs, std::memory_order_relaxed)) {}
+}
+
+uint64_t LatencyHistogram::percentileUs(double fraction) const {
+    uint64_t samples = count();
+    if (samples == 0) return 0;
+
+    uint64_t rank = (uint64_t)(fraction * samples);
+    if (rank >= samples) rank = samples - 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        // the max is exact, so never report a bucket bound above it
+        if (seen > rank) {
+            uint64_t bound = bucketUpperBound(i);
+            uint64_t top = maxUs();
+            return bound < top ? bound : top;
+        }
+    }
+    return maxUs();
+}
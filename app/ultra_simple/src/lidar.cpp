@@ -1,60 +1,335 @@
 #include "lidar.h"
-#include <iostream>
+#include "latency_trace.h"
+#include "logger.h"
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
 
-Lidar::Lidar() : drv(nullptr), isHealthy(false) {}
+// bounded grab so the acquisition thread notices stopScan() promptly
+static const sl_u32 ACQUISITION_GRAB_TIMEOUT_MS = 500;
+static const size_t MAX_SCAN_NODES = 8192;
+static const int DEFAULT_SCAN_LINGER_MS = 5000;
+// between start attempts while a device that is wanted refuses to scan
+static const int START_RETRY_INTERVAL_MS = 1000;
+static const char REPLAY_PORT_PREFIX[] = "replay:";
+
+Lidar::Lidar()
+    : drv(nullptr), isHealthy(false), scanning(false), scanMode(0)
+    , acquisitionCpu(-1), replaySpeed(1.0f), scanReferences(0), scanLingerMs(DEFAULT_SCAN_LINGER_MS), startFailures(0)
+    , nextSequence(1), acquisitionStopping(false), nextListenerId(1) {}
 
 Lidar::~Lidar() {
     shutdown();
 }
 
 bool Lidar::initialize(const std::string& port, sl_u32 baudrate) {
-    drv = *createLidarDriver();
-    if (!drv) {
-        std::cerr << "Failed to create LIDAR driver instance\n";
+    ILidarDriver* driver = *createLidarDriver();
+    if (!driver) {
+        LOG_ERROR("Failed to create LIDAR driver instance");
         return false;
     }
 
-    IChannel* channel = *createSerialPortChannel(port.c_str(), baudrate);
-    if (SL_IS_FAIL(drv->connect(channel))) {
-        std::cerr << "Failed to connect to LIDAR on port " << port << "\n";
-        delete drv;
-        drv = nullptr;
+    IChannel* channel;
+    if (port.compare(0, sizeof(REPLAY_PORT_PREFIX) - 1, REPLAY_PORT_PREFIX) == 0) {
+        // loop so clients keep getting scans once the recording runs out
+        channel = *createReplayChannel(port.substr(sizeof(REPLAY_PORT_PREFIX) - 1), replaySpeed, true);
+    }
+    else {
+        channel = *createSerialPortChannel(port.c_str(), baudrate);
+    }
+    if (SL_IS_FAIL(driver->connect(channel))) {
+        LOG_ERROR("Failed to connect to LIDAR on port %s", port.c_str());
+        delete driver;
         return false;
     }
+    drv = driver;
 
-    isHealthy = checkHealth();
-    return isHealthy;
+    return checkHealth();
+}
+
+void Lidar::setReplaySpeed(float speed) {
+    replaySpeed = speed > 0 ? speed : 0;
+}
+
+void Lidar::setAcquisitionCpu(int cpu) {
+    acquisitionCpu = cpu;
 }
 
 bool Lidar::checkHealth() {
-    if (!drv) {
-        std::cerr << "LIDAR driver is null\n";
+    ILidarDriver* driver = drv;
+    if (!driver) {
+        LOG_ERROR("LIDAR driver is null");
         return false;
     }
 
+    // any request ends a running scan, and a device delivering scans is
+    // healthy as far as clients care
+    std::lock_guard<std::mutex> l(scanCommandMutex);
+    if (scanning) return isHealthy;
+
     sl_lidar_response_device_health_t health;
-    if (SL_IS_OK(drv->getHealth(health))) {
+    if (SL_IS_OK(driver->getHealth(health))) {
         if (health.status == SL_LIDAR_STATUS_ERROR) {
-            std::cerr << "LIDAR internal error detected, error code: " << health.error_code << "\n";
-            return false;
+            LOG_ERROR("LIDAR internal error detected, error code: %u", (unsigned)health.error_code);
+            isHealthy = false;
+        }
+        else {
+            isHealthy = true;
         }
-        return true;
     }
     else {
-        std::cerr << "Failed to retrieve LIDAR health\n";
-        return false;
+        LOG_ERROR("Failed to retrieve LIDAR health");
+        isHealthy = false;
     }
+    return isHealthy;
 }
 
 void Lidar::shutdown() {
-    if (drv) {
-        drv->stop();
-        drv->setMotorSpeed(0);
-        delete drv;
-        drv = nullptr;
+    stopAcquisition();
+    stopRecording();
+    ILidarDriver* driver = drv.exchange(nullptr);
+    if (driver) {
+        driver->stop();
+        driver->setMotorSpeed(0);
+        delete driver;
     }
 }
 
 ILidarDriver* Lidar::getDriver() {
     return drv;
 }
+
+bool Lidar::startRecording(const std::string& path) {
+    std::lock_guard<std::mutex> l(recordMutex);
+    ILidarDriver* driver = drv;
+    if (!driver) return false;
+
+    if (!recording.empty()) driver->stopRecording();
+    recording.clear();
+    if (SL_IS_FAIL(driver->startRecording(path.c_str()))) {
+        LOG_ERROR("Failed to start recording to %s", path.c_str());
+        return false;
+    }
+    recording = path;
+    LOG_INFO("Recording raw LIDAR data to %s", path.c_str());
+    return true;
+}
+
+void Lidar::stopRecording() {
+    std::lock_guard<std::mutex> l(recordMutex);
+    if (recording.empty()) return;
+
+    ILidarDriver* driver = drv;
+    if (driver) driver->stopRecording();
+    LOG_INFO("Recording to %s finished", recording.c_str());
+    recording.clear();
+}
+
+std::string Lidar::recordingPath() {
+    std::lock_guard<std::mutex> l(recordMutex);
+    return recording;
+}
+
+void Lidar::setScanLinger(int ms) {
+    std::lock_guard<std::mutex> l(frameMutex);
+    scanLingerMs = ms > 0 ? ms : 0;
+}
+
+void Lidar::acquireScan() {
+    {
+        std::lock_guard<std::mutex> l(frameMutex);
+        ++scanReferences;
+        if (!acquisitionThread.joinable() && !acquisitionStopping) {
+            acquisitionThread = std::thread(&Lidar::acquisitionMain, this);
+            pinAcquisitionThread();
+        }
+    }
+    frameCondition.notify_all();
+}
+
+void Lidar::releaseScan() {
+    {
+        std::lock_guard<std::mutex> l(frameMutex);
+        if (scanReferences == 0) return;
+        if (--scanReferences == 0) {
+            lingerUntil = std::chrono::steady_clock::now() + std::chrono::milliseconds(scanLingerMs);
+        }
+    }
+    frameCondition.notify_all();
+}
+
+int Lidar::scanReferenceCount() {
+    std::lock_guard<std::mutex> l(frameMutex);
+    return scanReferences;
+}
+
+bool Lidar::waitUntilScanning(int timeoutMs) {
+    std::unique_lock<std::mutex> l(frameMutex);
+    uint64_t failuresBefore = startFailures;
+    frameCondition.wait_for(l, std::chrono::milliseconds(timeoutMs), [&]() {
+        return acquisitionStopping || scanning || startFailures != failuresBefore;
+    });
+    return scanning;
+}
+
+void Lidar::pinAcquisitionThread() {
+    if (acquisitionCpu < 0) return;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(acquisitionCpu, &cpus);
+    if (pthread_setaffinity_np(acquisitionThread.native_handle(), sizeof(cpus), &cpus) != 0) {
+        LOG_WARN("Failed to pin acquisition thread to CPU %d", acquisitionCpu);
+    }
+}
+
+bool Lidar::startScanning() {
+    ILidarDriver* driver = drv;
+    if (!driver) return false;
+    // a device that failed its last check gets asked again, it may have recovered
+    if (!isHealthy && !checkHealth()) return false;
+
+    std::lock_guard<std::mutex> commandLock(scanCommandMutex);
+    driver->setMotorSpeed(600);
+    LidarScanMode usedMode;
+    if (SL_IS_FAIL(driver->startScan(false, true, 0, &usedMode))) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> l(frameMutex);
+        scanMode = usedMode.id;
+        latest.reset();
+        scanning = true;
+    }
+    frameCondition.notify_all();
+    LOG_INFO("Scanning started in mode %u", (unsigned)usedMode.id);
+    return true;
+}
+
+void Lidar::stopScanning() {
+    std::lock_guard<std::mutex> commandLock(scanCommandMutex);
+    {
+        // a stopped device must not keep serving its last revolution
+        std::lock_guard<std::mutex> l(frameMutex);
+        scanning = false;
+        latest.reset();
+    }
+
+    ILidarDriver* driver = drv;
+    driver->stop();
+    driver->setMotorSpeed(0);
+    LOG_INFO("Scanning stopped, no clients left");
+}
+
+bool Lidar::isScanning() const {
+    return scanning;
+}
+
+uint64_t Lidar::publishedFrameCount() {
+    std::lock_guard<std::mutex> l(frameMutex);
+    return nextSequence - 1;
+}
+
+ScanFramePtr Lidar::latestFrame() {
+    std::lock_guard<std::mutex> l(frameMutex);
+    return latest;
+}
+
+int Lidar::addFrameListener(FrameListener listener) {
+    std::lock_guard<std::mutex> l(listenerMutex);
+    int listenerId = nextListenerId++;
+    frameListeners[listenerId] = listener;
+    return listenerId;
+}
+
+void Lidar::removeFrameListener(int listenerId) {
+    // callbacks run under this lock, so none is in flight once we hold it
+    std::lock_guard<std::mutex> l(listenerMutex);
+    frameListeners.erase(listenerId);
+}
+
+void Lidar::stopAcquisition() {
+    scanning = false;
+    {
+        std::lock_guard<std::mutex> l(frameMutex);
+        acquisitionStopping = true;
+        latest.reset();
+    }
+    frameCondition.notify_all();
+    if (acquisitionThread.joinable()) acquisitionThread.join();
+}
+
+void Lidar::acquisitionMain() {
+    while (true) {
+        bool wanted;
+        {
+            // idle until a reference is taken; a scan nobody holds runs on
+            // until its linger time is up
+            std::unique_lock<std::mutex> l(frameMutex);
+            frameCondition.wait(l, [this]() { return acquisitionStopping || scanning || scanReferences > 0; });
+            if (acquisitionStopping) return;
+            wanted = scanReferences > 0 || std::chrono::steady_clock::now() < lingerUntil;
+        }
+
+        if (!wanted) {
+            stopScanning();
+            continue;
+        }
+
+        if (!scanning) {
+            if (startScanning()) continue;
+
+            std::unique_lock<std::mutex> l(frameMutex);
+            ++startFailures;
+            frameCondition.notify_all();
+            frameCondition.wait_for(l, std::chrono::milliseconds(START_RETRY_INTERVAL_MS), [this]() {
+                return acquisitionStopping || scanReferences == 0;
+            });
+            continue;
+        }
+
+        // the borrowed scan is copied once, straight into the frame that
+        // gets ascended and published
+        LidarScanPtr scan;
+        if (SL_IS_FAIL(drv.load()->borrowScanDataHq(scan, ACQUISITION_GRAB_TIMEOUT_MS))) {
+            continue;
+        }
+        std::shared_ptr<ScanFrame> frame = std::make_shared<ScanFrame>();
+        frame->timing.grabbedUs = monotonicUs();
+        if (!scanning) continue;
+
+        frame->nodes.assign(scan->nodes, scan->nodes + std::min<size_t>(scan->count, MAX_SCAN_NODES));
+        frame->timestampUs = scan->timestamp_us;
+        frame->timing.rxUs = scan->timing.first_rx_us;
+        frame->timing.decodedUs = scan->timing.first_decoded_us;
+        frame->timing.completedUs = scan->timing.completed_us;
+        scan.reset();
+
+        size_t nodeCount = frame->nodes.size();
+        if (nodeCount) drv.load()->ascendScanData(&frame->nodes[0], nodeCount);
+
+        // the per-node dump is far too heavy for anything but debugging
+        if (Logger::instance().isEnabled(LOG_LEVEL_DEBUG)) {
+            for (size_t i = 0; i < nodeCount; ++i) {
+                int rawQuality = frame->nodes[i].quality;
+                LOG_DEBUG("{ angle: %g, distance: %g, raw quality: %d, adjusted quality: %d }",
+                          frame->nodes[i].angle_z_q14 * 90.f / (1 << 14),
+                          frame->nodes[i].dist_mm_q2 / 4.0,
+                          rawQuality, rawQuality >> SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT);
+            }
+        }
+
+        ScanFramePtr published;
+        {
+            std::lock_guard<std::mutex> l(frameMutex);
+            frame->sequence = nextSequence++;
+            frame->scanMode = scanMode;
+            latest = frame;
+            published = frame;
+        }
+
+        std::lock_guard<std::mutex> l(listenerMutex);
+        for (auto& item : frameListeners) item.second(published);
+    }
+}
@@ -0,0 +1,166 @@
+#include "logger.h"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+// must be a power of two
+static const size_t LOG_RING_SLOTS = 8192;
+static const size_t LOG_MESSAGE_BYTES = 232;
+static const int FLUSH_IDLE_SLEEP_MS = 10;
+
+struct Logger::Slot {
+    std::atomic<size_t> sequence;
+    int64_t timeUs;
+    int level;
+    uint32_t length;
+    char text[LOG_MESSAGE_BYTES];
+};
+
+static int64_t wallClockUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger()
+    : slots(new Slot[LOG_RING_SLOTS]), head(0), tail(0)
+    , minLevel(LOG_LEVEL_INFO), dropped(0), stopping(false) {
+    for (size_t i = 0; i < LOG_RING_SLOTS; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    flusher = std::thread(&Logger::flusherMain, this);
+}
+
+Logger::~Logger() {
+    shutdown();
+}
+
+void Logger::setLevel(LogLevel level) {
+    minLevel.store(level, std::memory_order_relaxed);
+}
+
+LogLevel Logger::level() const {
+    return (LogLevel)minLevel.load(std::memory_order_relaxed);
+}
+
+void Logger::log(LogLevel level, const char* format, ...) {
+    // format before claiming a slot so the flusher never waits on vsnprintf
+    char text[LOG_MESSAGE_BYTES];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length < 0) return;
+    if ((size_t)length >= sizeof(text)) length = sizeof(text) - 1;
+
+    size_t pos = head.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots[pos & (LOG_RING_SLOTS - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        }
+        else if (diff < 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->timeUs = wallClockUs();
+    slot->level = level;
+    slot->length = length;
+    memcpy(slot->text, text, length);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void Logger::noteSuppressed() {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Logger::shutdown() {
+    if (stopping.exchange(true)) return;
+    if (flusher.joinable()) flusher.join();
+}
+
+bool Logger::parseLevel(const std::string& name, LogLevel& level) {
+    for (int i = LOG_LEVEL_DEBUG; i <= LOG_LEVEL_OFF; ++i) {
+        if (name == levelName((LogLevel)i)) {
+            level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* Logger::levelName(LogLevel level) {
+    switch (level) {
+    case LOG_LEVEL_DEBUG: return "DEBUG";
+    case LOG_LEVEL_INFO:  return "INFO";
+    case LOG_LEVEL_WARN:  return "WARN";
+    case LOG_LEVEL_ERROR: return "ERROR";
+    default:              return "OFF";
+    }
+}
+
+size_t Logger::drain() {
+    size_t written = 0;
+    while (true) {
+        Slot& slot = slots[tail & (LOG_RING_SLOTS - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != tail + 1) break;
+
+        time_t seconds = (time_t)(slot.timeUs / 1000000);
+        struct tm local;
+        localtime_r(&seconds, &local);
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%H:%M:%S", &local);
+
+        // one stream for every level so lines stay in order when redirected
+        fprintf(stderr, "%s.%03d %-5s %.*s\n", stamp, (int)(slot.timeUs / 1000 % 1000),
+                levelName((LogLevel)slot.level), (int)slot.length, slot.text);
+
+        slot.sequence.store(tail + LOG_RING_SLOTS, std::memory_order_release);
+        ++tail;
+        ++written;
+    }
+
+    uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+    if (lost) {
+        fprintf(stderr, "%llu log messages dropped or rate limited\n", (unsigned long long)lost);
+    }
+
+    if (written || lost) fflush(stderr);
+    return written;
+}
+
+void Logger::flusherMain() {
+    while (!stopping.load(std::memory_order_relaxed)) {
+        if (!drain()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(FLUSH_IDLE_SLEEP_MS));
+        }
+    }
+    drain();
+}
+
+LogRateLimiter::LogRateLimiter(uint32_t maxPerSecond)
+    : maxPerSecond(maxPerSecond), windowStartMs(0), count(0) {}
+
+bool LogRateLimiter::allow() {
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t start = windowStartMs.load(std::memory_order_relaxed);
+    if (now - start >= 1000 && windowStartMs.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    return count.fetch_add(1, std::memory_order_relaxed) < maxPerSecond;
+}
@@ -1,9 +1,14 @@
 #include "lidar.h"
 #include "tcp_server.h"
+#include "logger.h"
+#include "scan_shm_publisher.h"
+#include "server_config.h"
 #include <csignal>
 #include <iostream>
+#include <memory>
 #include <thread>
 #include <atomic>
+#include <vector>
 
 std::atomic<bool> ctrl_c_pressed(false);
 
@@ -11,38 +16,168 @@ void signalHandler(int) {
     ctrl_c_pressed = true;
 }
 
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " <baudrate> <port_path> [idle_timeout_s] [log_level]\n"
+              << "       " << program << " --config <file>\n"
+              << "       [--multicast <group>:<port>] [--multicast-ttl <hops>] [--multicast-if <address>]\n"
+              << "       [--shm <name>] [--scan-linger <ms>] [--metrics-port <port>] [--record-dir <dir>]\n"
+              << "       [--replay-speed <factor>]    (port_path replay:<file> plays back a recording)\n"
+              << "       [--queue-policy DROP_OLDEST|DROP_NEWEST|DISCONNECT] [--max-queued-frames <n>]\n"
+              << "       [--disconnect-lag <ms>] [--delta-keyframe-interval <scans>]\n";
+}
+
 int main(int argc, char* argv[]) {
     signal(SIGINT, signalHandler);
 
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <baudrate> <port_path>\n";
+    std::vector<std::string> positional;
+    std::string multicastTarget;
+    std::string multicastInterface;
+    int multicastTtl = 1;
+    std::string shmName;
+    std::string configPath;
+    int scanLingerMs = -1;
+    int metricsPort = -1;
+    std::string recordDirectory;
+    float replaySpeed = -1;
+    std::string queuePolicyName;
+    int maxQueuedFrames = -1;
+    int disconnectLagMs = -1;
+    int deltaKeyframeInterval = -1;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            positional.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--multicast") multicastTarget = value;
+        else if (arg == "--multicast-ttl") multicastTtl = std::stoi(value);
+        else if (arg == "--multicast-if") multicastInterface = value;
+        else if (arg == "--shm") shmName = value;
+        else if (arg == "--config") configPath = value;
+        else if (arg == "--scan-linger") scanLingerMs = std::stoi(value);
+        else if (arg == "--metrics-port") metricsPort = std::stoi(value);
+        else if (arg == "--record-dir") recordDirectory = value;
+        else if (arg == "--replay-speed") replaySpeed = std::stof(value);
+        else if (arg == "--queue-policy") queuePolicyName = value;
+        else if (arg == "--max-queued-frames") maxQueuedFrames = std::stoi(value);
+        else if (arg == "--disconnect-lag") disconnectLagMs = std::stoi(value);
+        else if (arg == "--delta-keyframe-interval") deltaKeyframeInterval = std::stoi(value);
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    ServerConfig config;
+    if (!configPath.empty()) {
+        std::string error;
+        if (!positional.empty() || !loadServerConfig(configPath, config, error)) {
+            if (!error.empty()) std::cerr << "Invalid config " << error << "\n";
+            else printUsage(argv[0]);
+            return 1;
+        }
+    }
+    else {
+        if (positional.size() < 2 || positional.size() > 4) {
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        LidarDeviceConfig device;
+        device.id = "0";
+        device.portPath = positional[1];
+        device.baudrate = std::stoul(positional[0]);
+        config.devices.push_back(device);
+        if (positional.size() >= 3) config.idleTimeoutSeconds = std::stoi(positional[2]);
+        if (positional.size() == 4) config.logLevel = positional[3];
+    }
+
+    LogLevel logLevel = LOG_LEVEL_INFO;
+    if (!Logger::parseLevel(config.logLevel, logLevel)) {
+        std::cerr << "Unknown log level " << config.logLevel << ", use DEBUG, INFO, WARN, ERROR or OFF\n";
         return 1;
     }
+    Logger::instance().setLevel(logLevel);
 
-    std::string portPath = argv[2];
-    sl_u32 baudrate = std::stoul(argv[1]);
+    if (queuePolicyName.empty()) queuePolicyName = config.queuePolicy;
+    SlowConsumerPolicy queuePolicy;
+    if (!TcpServer::parseSlowConsumerPolicy(queuePolicyName, queuePolicy)) {
+        std::cerr << "Unknown queue policy " << queuePolicyName << ", use DROP_OLDEST, DROP_NEWEST or DISCONNECT\n";
+        return 1;
+    }
+
+    MulticastPublisher multicast;
+    if (!multicastTarget.empty()) {
+        size_t colon = multicastTarget.rfind(':');
+        if (colon == std::string::npos
+            || !multicast.open(multicastTarget.substr(0, colon), std::stoi(multicastTarget.substr(colon + 1)),
+                               multicastTtl, multicastInterface)) {
+            std::cerr << "Cannot publish to multicast group " << multicastTarget << "\n";
+            return 1;
+        }
+    }
 
-    Lidar lidar;
-    std::atomic<bool> isLidarAvailable(false);
+    ScanShmPublisher shmPublisher;
+    if (!shmName.empty() && !shmPublisher.open(shmName)) {
+        std::cerr << "Cannot create shared memory ring " << shmName << "\n";
+        return 1;
+    }
 
+    // each device has its own driver and acquisition thread
+    std::vector<std::unique_ptr<Lidar> > lidars;
+    for (const LidarDeviceConfig& device : config.devices) {
+        lidars.push_back(std::unique_ptr<Lidar>(new Lidar()));
+        lidars.back()->setAcquisitionCpu(device.cpu);
+        lidars.back()->setScanLinger(scanLingerMs >= 0 ? scanLingerMs : config.scanLingerMs);
+        lidars.back()->setReplaySpeed(replaySpeed >= 0 ? replaySpeed : device.replaySpeed);
+    }
+
+    // same-host readers get each scan of the first device straight from its
+    // acquisition thread
+    int shmListenerId = -1;
+    if (shmPublisher.isOpen()) {
+        shmListenerId = lidars[0]->addFrameListener([&shmPublisher](const ScanFramePtr& frame) {
+            shmPublisher.publish(*frame);
+        });
+    }
+
+    // a single thread keeps retrying every device that is not connected yet
     std::thread lidarInitThread([&]() {
         while (!ctrl_c_pressed) {
-            if (!lidar.getDriver()) {
-                std::cout << "Attempting to initialize LIDAR...\n";
-                if (lidar.initialize(portPath, baudrate)) {
-                    isLidarAvailable = true;
-                    std::cout << "LIDAR initialized successfully\n";
+            for (size_t i = 0; i < lidars.size() && !ctrl_c_pressed; ++i) {
+                const LidarDeviceConfig& device = config.devices[i];
+                if (lidars[i]->getDriver()) continue;
+
+                LOG_INFO("Attempting to initialize LIDAR %s on %s...", device.id.c_str(), device.portPath.c_str());
+                if (lidars[i]->initialize(device.portPath, device.baudrate)) {
+                    LOG_INFO("LIDAR %s initialized successfully", device.id.c_str());
                 }
                 else {
-                    isLidarAvailable = false;
-                    std::cerr << "Failed to initialize LIDAR\n";
+                    LOG_ERROR("Failed to initialize LIDAR %s", device.id.c_str());
                 }
             }
             std::this_thread::sleep_for(std::chrono::seconds(5));
         }
         });
 
-    TcpServer server(8002, lidar);
+    TcpServer server(config.listenPort);
+    for (size_t i = 0; i < lidars.size(); ++i) {
+        server.addDevice(config.devices[i].id, *lidars[i]);
+    }
+    server.setIdleTimeout(config.idleTimeoutSeconds);
+    server.setSlowConsumerPolicy(queuePolicy, maxQueuedFrames >= 0 ? maxQueuedFrames : config.maxQueuedFrames,
+                                 disconnectLagMs >= 0 ? disconnectLagMs : config.disconnectLagMs);
+    server.setDeltaKeyframeInterval(deltaKeyframeInterval >= 0 ? deltaKeyframeInterval : config.deltaKeyframeInterval);
+    if (multicast.isOpen()) server.setMulticastPublisher(&multicast);
+    server.setMetricsPort(metricsPort >= 0 ? metricsPort : config.metricsPort);
+    server.setRecordDirectory(recordDirectory.empty() ? config.recordDirectory : recordDirectory);
 
     std::thread serverThread([&]() {
         server.start();
@@ -52,10 +187,14 @@ int main(int argc, char* argv[]) {
         std::this_thread::sleep_for(std::chrono::seconds(1));
     }
 
-    std::cout << "Shutting down...\n";
+    LOG_INFO("Shutting down...");
     server.stop();
     if (serverThread.joinable()) serverThread.join();
     if (lidarInitThread.joinable()) lidarInitThread.join();
 
+    if (shmListenerId >= 0) lidars[0]->removeFrameListener(shmListenerId);
+    for (auto& lidar : lidars) lidar->shutdown();
+    Logger::instance().shutdown();
+
     return 0;
 }
@@ -0,0 +1,103 @@
+#include "metrics.h"
+#include <cstdio>
+
+const uint64_t MetricHistogram::BUCKET_BOUNDS_US[MetricHistogram::BUCKET_COUNT - 1] = {
+    10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 50000
+};
+
+MetricHistogram::MetricHistogram() : sum(0) {
+    for (auto& b : buckets) b = 0;
+}
+
+void MetricHistogram::observe(uint64_t valueUs) {
+    size_t index = 0;
+    while (index < BUCKET_COUNT - 1 && valueUs > BUCKET_BOUNDS_US[index]) ++index;
+    buckets[index].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(valueUs, std::memory_order_relaxed);
+}
+
+uint64_t MetricHistogram::count() const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) total += bucket(i);
+    return total;
+}
+
+void MetricsWriter::describe(const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void MetricsWriter::writeName(const char* name, const char* suffix, const std::string& labels) {
+    out += name;
+    out += suffix;
+    if (!labels.empty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += ' ';
+}
+
+void MetricsWriter::sample(const char* name, const std::string& labels, uint64_t value) {
+    writeName(name, "", labels);
+    out += std::to_string(value);
+    out += '\n';
+}
+
+void MetricsWriter::sample(const char* name, const std::string& labels, double value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.9g", value);
+    writeName(name, "", labels);
+    out += text;
+    out += '\n';
+}
+
+void MetricsWriter::histogram(const char* name, const std::string& labels, const MetricHistogram& histogram) {
+    std::string prefix = labels.empty() ? std::string() : labels + ",";
+    char bound[32];
+    uint64_t cumulative = 0;
+
+    for (size_t i = 0; i < MetricHistogram::BUCKET_COUNT; ++i) {
+        cumulative += histogram.bucket(i);
+        if (i < MetricHistogram::BUCKET_COUNT - 1) {
+            snprintf(bound, sizeof(bound), "%g", MetricHistogram::BUCKET_BOUNDS_US[i] / 1e6);
+        }
+        else {
+            snprintf(bound, sizeof(bound), "+Inf");
+        }
+        writeName(name, "_bucket", prefix + "le=\"" + bound + "\"");
+        out += std::to_string(cumulative);
+        out += '\n';
+    }
+
+    char sum[32];
+    snprintf(sum, sizeof(sum), "%.9g", histogram.sumUs() / 1e6);
+    writeName(name, "_sum", labels);
+    out += sum;
+    out += '\n';
+    writeName(name, "_count", labels);
+    out += std::to_string(cumulative);
+    out += '\n';
+}
+
+std::string MetricsWriter::label(const char* name, const std::string& value) {
+    std::string result = name;
+    result += "=\"";
+    for (char c : value) {
+        if (c == '\\' || c == '"') result += '\\';
+        if (c == '\n') {
+            result += "\\n";
+            continue;
+        }
+        result += c;
+    }
+    result += '"';
+    return result;
+}
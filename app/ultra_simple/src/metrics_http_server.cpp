@@ -0,0 +1,177 @@
+#include "metrics_http_server.h"
+#include "logger.h"
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <errno.h>
+
+// scrapers send a short GET, anything longer is not one
+static const size_t MAX_REQUEST_BYTES = 8 * 1024;
+// a scrape that has not been answered and sent by then is dropped
+static const int REQUEST_TIMEOUT_MS = 5000;
+static const int REQUEST_SWEEP_INTERVAL_MS = 1000;
+
+MetricsHttpServer::MetricsHttpServer(EventLoop& loop, Renderer renderer)
+    : loop(loop), renderer(renderer), listenFd(-1), sweepTimer(-1) {
+}
+
+MetricsHttpServer::~MetricsHttpServer() {
+    close();
+}
+
+bool MetricsHttpServer::open(int port) {
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        LOG_ERROR("Failed to create metrics socket");
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+
+    if (bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, SOMAXCONN) < 0
+        || !loop.addFd(listenFd, EPOLLIN | EPOLLET, [this](uint32_t) { onAcceptReady(); })) {
+        LOG_ERROR("Failed to listen for metrics on port %d", port);
+        ::close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    sweepTimer = loop.addTimer(REQUEST_SWEEP_INTERVAL_MS, [this]() { sweepStaleRequests(); });
+    LOG_INFO("Serving metrics on http://0.0.0.0:%d/metrics", port);
+    return true;
+}
+
+void MetricsHttpServer::close() {
+    while (!requests.empty()) closeRequest(requests.begin()->first);
+    if (sweepTimer >= 0) {
+        loop.removeTimer(sweepTimer);
+        sweepTimer = -1;
+    }
+    if (listenFd >= 0) {
+        loop.removeFd(listenFd);
+        ::close(listenFd);
+        listenFd = -1;
+    }
+}
+
+void MetricsHttpServer::onAcceptReady() {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+
+        if (!loop.addFd(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                        [this, fd](uint32_t events) { onRequestEvent(fd, events); })) {
+            ::close(fd);
+            continue;
+        }
+        requests[fd] = Request{ std::string(), std::string(), 0, EventLoop::nowMs() };
+    }
+}
+
+void MetricsHttpServer::onRequestEvent(int fd, uint32_t events) {
+    auto itr = requests.find(fd);
+    if (itr == requests.end()) return;
+    Request& request = itr->second;
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        closeRequest(fd);
+        return;
+    }
+
+    if (request.output.empty() && (events & (EPOLLIN | EPOLLRDHUP)) && !readRequest(fd, request)) {
+        closeRequest(fd);
+        return;
+    }
+
+    if (!request.output.empty() && !writeResponse(fd, request)) {
+        closeRequest(fd);
+    }
+}
+
+bool MetricsHttpServer::readRequest(int fd, Request& request) {
+    char chunk[1024];
+    bool peerClosed = false;
+    while (true) {
+        ssize_t bytesRead = recv(fd, chunk, sizeof(chunk), 0);
+        if (bytesRead > 0) {
+            request.input.append(chunk, bytesRead);
+            if (request.input.size() > MAX_REQUEST_BYTES) return false;
+            continue;
+        }
+        if (bytesRead == 0) {
+            // a client may half-close right after its request, still answer it
+            peerClosed = true;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        return false;
+    }
+
+    // only the request line matters, but wait for the whole header
+    if (request.input.find("\r\n\r\n") == std::string::npos
+        && request.input.find("\n\n") == std::string::npos) {
+        return !peerClosed;
+    }
+
+    std::string status;
+    std::string body;
+    if (request.input.compare(0, 13, "GET /metrics ") == 0 || request.input.compare(0, 14, "GET /metrics\r\n") == 0) {
+        status = "200 OK";
+        body = renderer();
+    }
+    else {
+        status = "404 Not Found";
+        body = "Only /metrics is served here\n";
+    }
+
+    request.output = "HTTP/1.0 " + status + "\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n\r\n" + body;
+    return true;
+}
+
+bool MetricsHttpServer::writeResponse(int fd, Request& request) {
+    while (request.sent < request.output.size()) {
+        ssize_t sent = send(fd, request.output.data() + request.sent, request.output.size() - request.sent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            request.sent += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        // EPOLLOUT picks up the rest
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        return false;
+    }
+
+    // done, one response per connection
+    return false;
+}
+
+void MetricsHttpServer::sweepStaleRequests() {
+    int64_t now = EventLoop::nowMs();
+    std::vector<int> stale;
+    for (auto& item : requests) {
+        if (now - item.second.acceptedMs >= REQUEST_TIMEOUT_MS) stale.push_back(item.first);
+    }
+    for (int fd : stale) closeRequest(fd);
+}
+
+void MetricsHttpServer::closeRequest(int fd) {
+    loop.removeFd(fd);
+    ::close(fd);
+    requests.erase(fd);
+}
@@ -0,0 +1,141 @@
+#include "multicast_publisher.h"
+#include "logger.h"
+#include "scan_datagram.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+
+// datagrams handed to one sendmmsg call
+static const size_t MAX_DATAGRAMS_PER_SEND = 64;
+
+MulticastPublisher::MulticastPublisher()
+    : fd(-1), nextDatagramSequence(0), sent(0), dropped(0) {
+    // differs between runs, which is all listeners need of it
+    uint64_t now = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+    session = (uint32_t)(now ^ (now >> 32)) ^ ((uint32_t)getpid() << 16);
+}
+
+MulticastPublisher::~MulticastPublisher() {
+    close();
+}
+
+bool MulticastPublisher::open(const std::string& group, int port, int ttl, const std::string& interfaceAddress) {
+    close();
+
+    sockaddr_in groupAddr{};
+    groupAddr.sin_family = AF_INET;
+    groupAddr.sin_port = htons(port);
+    if (inet_pton(AF_INET, group.c_str(), &groupAddr.sin_addr) != 1 || !IN_MULTICAST(ntohl(groupAddr.sin_addr.s_addr))) {
+        LOG_ERROR("Invalid multicast group %s", group.c_str());
+        return false;
+    }
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR("Failed to create multicast socket, errno %d", errno);
+        return false;
+    }
+
+    unsigned char multicastTtl = (unsigned char)(ttl > 0 && ttl < 256 ? ttl : 1);
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &multicastTtl, sizeof(multicastTtl));
+
+    if (!interfaceAddress.empty()) {
+        in_addr outgoing{};
+        if (inet_pton(AF_INET, interfaceAddress.c_str(), &outgoing) != 1
+            || setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &outgoing, sizeof(outgoing)) < 0) {
+            LOG_ERROR("Failed to select multicast interface %s", interfaceAddress.c_str());
+            close();
+            return false;
+        }
+    }
+
+    // connect once so every send goes to the group without an address per datagram
+    if (connect(fd, (struct sockaddr*)&groupAddr, sizeof(groupAddr)) < 0) {
+        LOG_ERROR("Failed to connect multicast socket to %s:%d, errno %d", group.c_str(), port, errno);
+        close();
+        return false;
+    }
+
+    destination = group + ":" + std::to_string(port);
+    LOG_INFO("Publishing scans to multicast group %s", destination.c_str());
+    return true;
+}
+
+void MulticastPublisher::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+}
+
+bool MulticastPublisher::isOpen() const {
+    return fd >= 0;
+}
+
+void MulticastPublisher::publish(uint64_t scanSequence, const SharedBuffer& message) {
+    if (fd < 0) return;
+
+    size_t fragmentCount = (message->size() + MAX_SCAN_FRAGMENT_BYTES - 1) / MAX_SCAN_FRAGMENT_BYTES;
+    if (fragmentCount == 0) fragmentCount = 1;
+    if (fragmentCount > 0xFFFF) {
+        LOG_RATE_LIMITED(LOG_LEVEL_WARN, 1, "Scan %llu is too large to multicast", (unsigned long long)scanSequence);
+        return;
+    }
+
+    // headers are built here, payloads point straight into the shared message
+    std::vector<char> headers(fragmentCount * sizeof(ScanDatagramHeader));
+    std::vector<iovec> iov(fragmentCount * 2);
+    std::vector<mmsghdr> messages(fragmentCount);
+
+    for (size_t i = 0; i < fragmentCount; ++i) {
+        size_t offset = i * MAX_SCAN_FRAGMENT_BYTES;
+        size_t bytes = std::min(MAX_SCAN_FRAGMENT_BYTES, message->size() - offset);
+
+        ScanDatagramHeader header;
+        header.magic = SCAN_DATAGRAM_MAGIC;
+        header.version = SCAN_DATAGRAM_VERSION;
+        header.reserved = 0;
+        header.fragmentIndex = (uint16_t)i;
+        header.fragmentCount = (uint16_t)fragmentCount;
+        header.fragmentBytes = (uint16_t)bytes;
+        header.datagramSequence = nextDatagramSequence++;
+        header.scanSequence = scanSequence;
+        header.messageBytes = (uint32_t)message->size();
+        header.fragmentOffset = (uint32_t)offset;
+        header.session = session;
+
+        char* headerBytes = &headers[i * sizeof(ScanDatagramHeader)];
+        encodeScanDatagramHeader(header, headerBytes);
+
+        iov[i * 2].iov_base = headerBytes;
+        iov[i * 2].iov_len = sizeof(ScanDatagramHeader);
+        iov[i * 2 + 1].iov_base = const_cast<char*>(message->data() + offset);
+        iov[i * 2 + 1].iov_len = bytes;
+
+        messages[i] = mmsghdr{};
+        messages[i].msg_hdr.msg_iov = &iov[i * 2];
+        messages[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    size_t next = 0;
+    while (next < fragmentCount) {
+        unsigned int batch = (unsigned int)std::min(MAX_DATAGRAMS_PER_SEND, fragmentCount - next);
+        int result = sendmmsg(fd, &messages[next], batch, 0);
+        if (result > 0) {
+            next += result;
+            sent += result;
+            continue;
+        }
+        if (result < 0 && errno == EINTR) continue;
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            LOG_RATE_LIMITED(LOG_LEVEL_WARN, 1, "Multicast send to %s failed, errno %d", destination.c_str(), errno);
+        }
+        dropped += fragmentCount - next;
+        return;
+    }
+}
@@ -0,0 +1,105 @@
+#include "scan_datagram.h"
+#include <cstring>
+
+static inline char* putLe(char* p, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) *p++ = (char)((value >> (i * 8)) & 0xFF);
+    return p;
+}
+
+static inline uint64_t getLe(const unsigned char* p, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) value |= (uint64_t)p[i] << (i * 8);
+    return value;
+}
+
+void encodeScanDatagramHeader(const ScanDatagramHeader& header, char* out) {
+    char* p = out;
+    p = putLe(p, header.magic, 4);
+    *p++ = (char)header.version;
+    *p++ = (char)header.reserved;
+    p = putLe(p, header.fragmentIndex, 2);
+    p = putLe(p, header.fragmentCount, 2);
+    p = putLe(p, header.fragmentBytes, 2);
+    p = putLe(p, header.datagramSequence, 4);
+    p = putLe(p, header.scanSequence, 8);
+    p = putLe(p, header.messageBytes, 4);
+    p = putLe(p, header.fragmentOffset, 4);
+    putLe(p, header.session, 4);
+}
+
+bool decodeScanDatagramHeader(const char* data, size_t size, ScanDatagramHeader& header) {
+    if (size < sizeof(ScanDatagramHeader)) return false;
+
+    const unsigned char* p = (const unsigned char*)data;
+    header.magic = (uint32_t)getLe(p, 4);
+    header.version = p[4];
+    header.reserved = p[5];
+    header.fragmentIndex = (uint16_t)getLe(p + 6, 2);
+    header.fragmentCount = (uint16_t)getLe(p + 8, 2);
+    header.fragmentBytes = (uint16_t)getLe(p + 10, 2);
+    header.datagramSequence = (uint32_t)getLe(p + 12, 4);
+    header.scanSequence = getLe(p + 16, 8);
+    header.messageBytes = (uint32_t)getLe(p + 24, 4);
+    header.fragmentOffset = (uint32_t)getLe(p + 28, 4);
+    header.session = (uint32_t)getLe(p + 32, 4);
+
+    return header.magic == SCAN_DATAGRAM_MAGIC
+        && header.version == SCAN_DATAGRAM_VERSION
+        && header.fragmentIndex < header.fragmentCount
+        && sizeof(ScanDatagramHeader) + header.fragmentBytes == size
+        && (uint64_t)header.fragmentOffset + header.fragmentBytes <= header.messageBytes;
+}
+
+ScanDatagramReassembler::ScanDatagramReassembler()
+    : haveSession(false), currentSession(0), currentScan(0), currentDone(true), fragmentsMissing(0)
+    , haveDatagramSequence(false), nextDatagramSequence(0)
+    , received(0), lost(0), completed(0), incomplete(0), restarts(0) {}
+
+ScanDatagramReassembler::Result ScanDatagramReassembler::push(const char* data, size_t size) {
+    ScanDatagramHeader header;
+    if (!decodeScanDatagramHeader(data, size, header)) return DATAGRAM_INVALID;
+    ++received;
+
+    // a restarted publisher numbers scans and datagrams from the start again
+    if (!haveSession || header.session != currentSession) {
+        if (haveSession) ++restarts;
+        if (!currentDone) ++incomplete;
+        haveSession = true;
+        currentSession = header.session;
+        currentScan = 0;
+        currentDone = true;
+        haveDatagramSequence = false;
+    }
+
+    // sequence gaps are losses; a datagram from behind is late, not lost
+    int32_t gap = (int32_t)(header.datagramSequence - nextDatagramSequence);
+    if (!haveDatagramSequence || gap >= 0) {
+        if (haveDatagramSequence) lost += (uint32_t)gap;
+        nextDatagramSequence = header.datagramSequence + 1;
+        haveDatagramSequence = true;
+    }
+
+    if (header.scanSequence < currentScan) return DATAGRAM_IGNORED;
+
+    if (header.scanSequence > currentScan || currentScan == 0) {
+        if (!currentDone) ++incomplete;
+        currentScan = header.scanSequence;
+        currentDone = false;
+        assembled.assign(header.messageBytes, '\0');
+        fragmentSeen.assign(header.fragmentCount, false);
+        fragmentsMissing = header.fragmentCount;
+    }
+
+    if (currentDone || header.fragmentCount != fragmentSeen.size() || header.messageBytes != assembled.size()) {
+        return DATAGRAM_IGNORED;
+    }
+    if (fragmentSeen[header.fragmentIndex]) return DATAGRAM_IGNORED;
+
+    memcpy(&assembled[header.fragmentOffset], data + sizeof(ScanDatagramHeader), header.fragmentBytes);
+    fragmentSeen[header.fragmentIndex] = true;
+    if (--fragmentsMissing) return DATAGRAM_PENDING;
+
+    currentDone = true;
+    ++completed;
+    return DATAGRAM_SCAN_COMPLETE;
+}
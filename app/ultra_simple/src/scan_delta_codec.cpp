@@ -0,0 +1,180 @@
+#include "scan_delta_codec.h"
+#include <cstring>
+
+static inline void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+static inline bool getVarint(const unsigned char*& p, const unsigned char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        unsigned char byte = *p++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static inline uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static void putLe64(std::string& out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) out.push_back((char)((value >> (i * 8)) & 0xFF));
+}
+
+static void putLe32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out.push_back((char)((value >> (i * 8)) & 0xFF));
+}
+
+static uint64_t getLe(const unsigned char* p, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) value |= (uint64_t)p[i] << (i * 8);
+    return value;
+}
+
+ScanDeltaEncoder::ScanDeltaEncoder(uint16_t binCount)
+    : binCount(binCount ? binCount : DEFAULT_DELTA_ANGLE_BINS)
+    , zeroBins(this->binCount, ScanDeltaBin{ 0, 0 }) {
+    previous.sequence = 0;
+    current.sequence = 0;
+}
+
+void ScanDeltaEncoder::update(const ScanFrame& frame) {
+    std::swap(previous, current);
+
+    current.sequence = frame.sequence;
+    current.timestampUs = frame.timestampUs;
+    current.scanMode = frame.scanMode;
+    current.bins.assign(binCount, ScanDeltaBin{ 0, 0 });
+
+    for (const sl_lidar_response_measurement_node_hq_t& node : frame.nodes) {
+        if (!node.dist_mm_q2) continue;
+        ScanDeltaBin& bin = current.bins[((uint32_t)node.angle_z_q14 * binCount) >> 16];
+        if (!bin.dist_mm_q2 || node.dist_mm_q2 < bin.dist_mm_q2) {
+            bin.dist_mm_q2 = node.dist_mm_q2;
+            bin.quality = node.quality;
+        }
+    }
+
+    // a scan mode change invalidates the base, the next delta request gets refused
+    if (previous.sequence && previous.scanMode != current.scanMode) previous.sequence = 0;
+}
+
+void ScanDeltaEncoder::encodeKeyframe(std::string& out) const {
+    encode(SCAN_MESSAGE_KEYFRAME, zeroBins, 0, out);
+}
+
+void ScanDeltaEncoder::encodeDelta(std::string& out) const {
+    encode(SCAN_MESSAGE_DELTA, previous.bins, previous.sequence, out);
+}
+
+void ScanDeltaEncoder::encode(ScanMessageType type, const std::vector<ScanDeltaBin>& base,
+                              uint64_t baseSequence, std::string& out) const {
+    std::string payload;
+    payload.reserve(binCount * 2);
+
+    uint64_t unchangedRun = 0;
+    for (uint16_t i = 0; i < binCount; ++i) {
+        int64_t distDelta = (int64_t)current.bins[i].dist_mm_q2 - (int64_t)base[i].dist_mm_q2;
+        int qualityDelta = (int)current.bins[i].quality - (int)base[i].quality;
+
+        if (!distDelta && !qualityDelta) {
+            ++unchangedRun;
+            continue;
+        }
+        if (unchangedRun) {
+            putVarint(payload, 0);
+            putVarint(payload, unchangedRun);
+            unchangedRun = 0;
+        }
+
+        putVarint(payload, ((zigzag(distDelta) << 1) | (qualityDelta ? 1 : 0)) + 1);
+        if (qualityDelta) putVarint(payload, zigzag(qualityDelta));
+    }
+    if (unchangedRun) {
+        putVarint(payload, 0);
+        putVarint(payload, unchangedRun);
+    }
+
+    out.reserve(out.size() + sizeof(ScanWireHeader) + sizeof(ScanDeltaHeader) + payload.size());
+    encodeScanWireHeader(type, current.scanMode, current.sequence, current.timestampUs, binCount, out);
+    putLe64(out, baseSequence);
+    putLe32(out, (uint32_t)payload.size());
+    out.append(payload);
+}
+
+size_t scanDeltaMessageSize(const char* data, size_t size) {
+    if (size < sizeof(ScanWireHeader) + sizeof(ScanDeltaHeader)) return 0;
+    const unsigned char* p = (const unsigned char*)data + sizeof(ScanWireHeader);
+    return sizeof(ScanWireHeader) + sizeof(ScanDeltaHeader) + (size_t)getLe(p + 8, 4);
+}
+
+ScanDeltaDecoder::ScanDeltaDecoder()
+    : currentSequence(0), currentTimestampUs(0) {}
+
+ScanDeltaDecoder::Result ScanDeltaDecoder::decode(const char* data, size_t size) {
+    ScanWireHeader header;
+    if (!decodeScanWireHeader(data, size, header)) return DECODE_MALFORMED;
+    if (header.messageType != SCAN_MESSAGE_KEYFRAME && header.messageType != SCAN_MESSAGE_DELTA) {
+        return DECODE_MALFORMED;
+    }
+    if (scanDeltaMessageSize(data, size) != size) return DECODE_MALFORMED;
+
+    const unsigned char* p = (const unsigned char*)data + sizeof(ScanWireHeader);
+    uint64_t baseSequence = getLe(p, 8);
+    const unsigned char* end = (const unsigned char*)data + size;
+    p += sizeof(ScanDeltaHeader);
+
+    std::vector<ScanDeltaBin> bins;
+    if (header.messageType == SCAN_MESSAGE_KEYFRAME) {
+        bins.assign(header.nodeCount, ScanDeltaBin{ 0, 0 });
+    }
+    else {
+        if (!currentSequence || baseSequence != currentSequence || currentBins.size() != header.nodeCount) {
+            return DECODE_NEED_KEYFRAME;
+        }
+        bins = currentBins;
+    }
+
+    size_t bin = 0;
+    while (p < end) {
+        uint64_t head;
+        if (!getVarint(p, end, head)) return DECODE_MALFORMED;
+
+        if (head == 0) {
+            uint64_t run;
+            if (!getVarint(p, end, run) || run == 0 || run > bins.size() - bin) return DECODE_MALFORMED;
+            bin += run;
+            continue;
+        }
+
+        if (bin >= bins.size()) return DECODE_MALFORMED;
+        head -= 1;
+        int64_t distDelta = unzigzag(head >> 1);
+        int64_t qualityDelta = 0;
+        if (head & 1) {
+            uint64_t quality;
+            if (!getVarint(p, end, quality)) return DECODE_MALFORMED;
+            qualityDelta = unzigzag(quality);
+        }
+
+        bins[bin].dist_mm_q2 = (uint32_t)((int64_t)bins[bin].dist_mm_q2 + distDelta);
+        bins[bin].quality = (uint8_t)((int)bins[bin].quality + qualityDelta);
+        ++bin;
+    }
+    if (bin != bins.size()) return DECODE_MALFORMED;
+
+    currentBins.swap(bins);
+    currentSequence = header.sequence;
+    currentTimestampUs = header.timestampUs;
+    return DECODE_OK;
+}
@@ -0,0 +1,126 @@
+#include "scan_filter.h"
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+static const uint32_t FULL_TURN_Q14 = 65536;
+
+static bool parseNumber(const std::string& text, double& value) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    value = strtod(text.c_str(), &end);
+    return end && *end == '\0' && std::isfinite(value);
+}
+
+static uint32_t degreesToQ14(double degrees) {
+    return (uint32_t)std::lround(degrees * FULL_TURN_Q14 / 360.0);
+}
+
+static double q14ToDegrees(uint32_t q14) {
+    return q14 * 360.0 / FULL_TURN_Q14;
+}
+
+ScanFilter::ScanFilter()
+    : minAngleQ14(0), maxAngleQ14(FULL_TURN_Q14), maxRangeQ2(0), minQuality(0), decimation(1) {}
+
+bool ScanFilter::isPassThrough() const {
+    return minAngleQ14 == 0 && maxAngleQ14 == FULL_TURN_Q14 && !maxRangeQ2 && !minQuality && decimation == 1;
+}
+
+std::string ScanFilter::key() const {
+    if (isPassThrough()) return std::string();
+
+    std::ostringstream out;
+    out << minAngleQ14 << ':' << maxAngleQ14 << ':' << maxRangeQ2 << ':' << (int)minQuality << ':' << decimation;
+    return out.str();
+}
+
+std::string ScanFilter::describe() const {
+    std::ostringstream out;
+    out << "angle_min=" << q14ToDegrees(minAngleQ14)
+        << " angle_max=" << q14ToDegrees(maxAngleQ14)
+        << " max_range=" << maxRangeQ2 / 4
+        << " min_quality=" << (int)minQuality
+        << " decimate=" << decimation;
+    return out.str();
+}
+
+void ScanFilter::apply(const ScanFrame& in, ScanFrame& out) const {
+    out.sequence = in.sequence;
+    out.timestampUs = in.timestampUs;
+    out.scanMode = in.scanMode;
+    out.timing = in.timing;
+    out.nodes.clear();
+    out.nodes.reserve(in.nodes.size() / decimation + 1);
+
+    bool wraps = minAngleQ14 > maxAngleQ14;
+    uint32_t windowIndex = 0;
+    for (const sl_lidar_response_measurement_node_hq_t& node : in.nodes) {
+        uint32_t angle = node.angle_z_q14;
+        bool inWindow = wraps ? (angle >= minAngleQ14 || angle < maxAngleQ14)
+                              : (angle >= minAngleQ14 && angle < maxAngleQ14);
+        if (!inWindow) continue;
+        if (windowIndex++ % decimation) continue;
+
+        if (maxRangeQ2 && node.dist_mm_q2 > maxRangeQ2) continue;
+        if ((node.quality >> SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) < minQuality) continue;
+        out.nodes.push_back(node);
+    }
+}
+
+bool ScanFilter::parse(const std::string& args, ScanFilter& filter, std::string& error) {
+    filter = ScanFilter();
+
+    std::istringstream in(args);
+    std::string token;
+    while (in >> token) {
+        if (token == "OFF") continue;
+
+        size_t equals = token.find('=');
+        double value;
+        if (equals == std::string::npos || !parseNumber(token.substr(equals + 1), value)) {
+            error = "Expected name=value, got " + token;
+            return false;
+        }
+
+        std::string name = token.substr(0, equals);
+        if (name == "angle_min" || name == "angle_max") {
+            if (value < 0 || value > 360) {
+                error = name + " must be between 0 and 360";
+                return false;
+            }
+            (name == "angle_min" ? filter.minAngleQ14 : filter.maxAngleQ14) = degreesToQ14(value);
+        }
+        else if (name == "max_range") {
+            if (value < 0 || value > 1000000) {
+                error = "max_range must be between 0 and 1000000 mm";
+                return false;
+            }
+            filter.maxRangeQ2 = (uint32_t)std::lround(value * 4);
+        }
+        else if (name == "min_quality") {
+            if (value < 0 || value > 63) {
+                error = "min_quality must be between 0 and 63";
+                return false;
+            }
+            filter.minQuality = (uint8_t)value;
+        }
+        else if (name == "decimate") {
+            if (value < 1 || value > 65536) {
+                error = "decimate must be between 1 and 65536";
+                return false;
+            }
+            filter.decimation = (uint32_t)value;
+        }
+        else {
+            error = "Unknown filter field " + name;
+            return false;
+        }
+    }
+
+    if (filter.minAngleQ14 == filter.maxAngleQ14) {
+        error = "angle_min and angle_max must differ";
+        return false;
+    }
+    return true;
+}
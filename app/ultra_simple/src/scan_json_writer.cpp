@@ -0,0 +1,87 @@
+#include "scan_json_writer.h"
+#include <cstring>
+
+// {"angle":<=18,"distance":<=13,"quality":<=3},
+static const size_t MAX_NODE_JSON_BYTES = 72;
+
+static const char* const DISTANCE_FRACTIONS[4] = { ".0", ".25", ".5", ".75" };
+
+static inline char* putLiteral(char* p, const char* literal, size_t length) {
+    memcpy(p, literal, length);
+    return p + length;
+}
+
+#define PUT_LITERAL(p, literal) putLiteral(p, literal, sizeof(literal) - 1)
+
+static inline char* putUnsigned(char* p, uint64_t value) {
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    while (count) *p++ = digits[--count];
+    return p;
+}
+
+static inline char* putAngle(char* p, uint16_t angleQ14) {
+    // angle = angleQ14 * 90 / 2^14, the fraction has at most 14 decimal digits
+    uint32_t scaled = (uint32_t)angleQ14 * 90;
+    p = putUnsigned(p, scaled >> 14);
+    *p++ = '.';
+
+    uint32_t fraction = scaled & 0x3FFF;
+    if (!fraction) {
+        *p++ = '0';
+        return p;
+    }
+
+    // fraction / 2^14 == fraction * 5^14 / 10^14
+    uint64_t decimals = (uint64_t)fraction * 6103515625ULL;
+    char digits[14];
+    for (int i = 13; i >= 0; --i) {
+        digits[i] = (char)('0' + decimals % 10);
+        decimals /= 10;
+    }
+    int length = 14;
+    while (digits[length - 1] == '0') --length;
+    return putLiteral(p, digits, length);
+}
+
+static inline char* putDistance(char* p, uint32_t distQ2) {
+    p = putUnsigned(p, distQ2 >> 2);
+    const char* fraction = DISTANCE_FRACTIONS[distQ2 & 3];
+    return putLiteral(p, fraction, strlen(fraction));
+}
+
+size_t scanJsonSizeBound(const std::string& command, size_t nodeCount) {
+    return 64 + command.size() + nodeCount * MAX_NODE_JSON_BYTES;
+}
+
+void writeScanJson(const std::string& command, const ScanFrame& frame, std::string& out) {
+    size_t offset = out.size();
+    out.resize(offset + scanJsonSizeBound(command, frame.nodes.size()));
+    char* begin = &out[offset];
+    char* p = begin;
+
+    p = PUT_LITERAL(p, "{\"command\":\"");
+    p = putLiteral(p, command.data(), command.size());
+    p = PUT_LITERAL(p, "\",\"response\":{\"data\":[");
+
+    bool first = true;
+    for (const sl_lidar_response_measurement_node_hq_t& node : frame.nodes) {
+        if (!first) *p++ = ',';
+        first = false;
+
+        p = PUT_LITERAL(p, "{\"angle\":");
+        p = putAngle(p, node.angle_z_q14);
+        p = PUT_LITERAL(p, ",\"distance\":");
+        p = putDistance(p, node.dist_mm_q2);
+        p = PUT_LITERAL(p, ",\"quality\":");
+        p = putUnsigned(p, node.quality >> SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT);
+        *p++ = '}';
+    }
+
+    p = PUT_LITERAL(p, "],\"status\":\"OK\"}}\n");
+    out.resize(offset + (p - begin));
+}
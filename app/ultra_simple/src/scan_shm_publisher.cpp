@@ -0,0 +1,126 @@
+#include "scan_shm_publisher.h"
+#include "logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Readers stay on a ring until its magic is cleared, then re-open the name.
+static void markClosed(ScanShmHeader* header) {
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = 0;
+}
+
+// A ring left behind by a publisher that died without closing it may still
+// be mapped by readers. Mark it closed and unlink it rather than rebuilding
+// it in place, where resizing it would pull the mapping out from under them.
+static void retireStaleRing(const std::string& shmName) {
+    int fd = shm_open(shmName.c_str(), O_RDWR, 0);
+    if (fd < 0) return;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(ScanShmHeader)) {
+        void* mapped = mmap(nullptr, sizeof(ScanShmHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped != MAP_FAILED) {
+            markClosed(static_cast<ScanShmHeader*>(mapped));
+            munmap(mapped, sizeof(ScanShmHeader));
+        }
+    }
+    ::close(fd);
+    shm_unlink(shmName.c_str());
+}
+
+ScanShmPublisher::ScanShmPublisher()
+    : header(nullptr), mappedBytes(0) {}
+
+ScanShmPublisher::~ScanShmPublisher() {
+    close();
+}
+
+bool ScanShmPublisher::open(const std::string& shmName, uint32_t slotCount, uint32_t maxNodes) {
+    close();
+    if (!slotCount || !maxNodes) return false;
+
+    retireStaleRing(shmName);
+    int fd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        LOG_ERROR("Failed to create shared memory %s, errno %d", shmName.c_str(), errno);
+        return false;
+    }
+
+    size_t bytes = scanShmTotalBytes(slotCount, maxNodes);
+    if (ftruncate(fd, bytes) < 0) {
+        LOG_ERROR("Failed to size shared memory %s, errno %d", shmName.c_str(), errno);
+        ::close(fd);
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        LOG_ERROR("Failed to map shared memory %s, errno %d", shmName.c_str(), errno);
+        return false;
+    }
+
+    header = static_cast<ScanShmHeader*>(mapped);
+    mappedBytes = bytes;
+    name = shmName;
+
+    // readers validate magic last, so they never attach to a half-built ring
+    header->magic = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->version = SCAN_SHM_VERSION;
+    header->slotCount = slotCount;
+    header->maxNodes = maxNodes;
+    header->slotBytes = scanShmSlotBytes(maxNodes);
+    header->published.store(0, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < slotCount; ++i) {
+        scanShmSlot(header, i)->generation.store(0, std::memory_order_relaxed);
+    }
+    header->epoch.store((uint64_t)std::chrono::steady_clock::now().time_since_epoch().count(),
+                        std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SCAN_SHM_MAGIC;
+
+    LOG_INFO("Publishing scans to shared memory %s (%u slots of %u nodes)", shmName.c_str(), slotCount, maxNodes);
+    return true;
+}
+
+void ScanShmPublisher::close() {
+    if (!header) return;
+    markClosed(header);
+    munmap(header, mappedBytes);
+    shm_unlink(name.c_str());
+    header = nullptr;
+    mappedBytes = 0;
+}
+
+bool ScanShmPublisher::isOpen() const {
+    return header != nullptr;
+}
+
+void ScanShmPublisher::publish(const ScanFrame& frame) {
+    if (!header) return;
+
+    uint64_t index = header->published.load(std::memory_order_relaxed);
+    ScanShmSlot* slot = scanShmSlot(header, index);
+
+    // odd generation: readers that overlap this write will retry or move on
+    slot->generation.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint32_t nodeCount = (uint32_t)std::min<size_t>(frame.nodes.size(), header->maxNodes);
+    slot->scanSequence = frame.sequence;
+    slot->timestampUs = frame.timestampUs;
+    slot->scanMode = frame.scanMode;
+    slot->nodeCount = nodeCount;
+    if (nodeCount) memcpy(slot->nodes(), frame.nodes.data(), nodeCount * sizeof(frame.nodes[0]));
+
+    slot->generation.store(2 * index + 2, std::memory_order_release);
+    header->published.store(index + 1, std::memory_order_release);
+}
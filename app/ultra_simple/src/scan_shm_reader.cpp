@@ -0,0 +1,171 @@
+#include "scan_shm_reader.h"
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+ScanShmReader::ScanShmReader()
+    : header(nullptr), mappedBytes(0), epoch(0), nextIndex(0), missedTotal(0), resetPending(false) {}
+
+ScanShmReader::~ScanShmReader() {
+    close();
+}
+
+bool ScanShmReader::open(const std::string& shmName) {
+    close();
+    name = shmName;
+    missedTotal = 0;
+    if (attach()) return true;
+    name.clear();
+    return false;
+}
+
+void ScanShmReader::close() {
+    detach();
+    name.clear();
+    resetPending = false;
+}
+
+bool ScanShmReader::isOpen() const {
+    return header != nullptr;
+}
+
+uint64_t ScanShmReader::published() const {
+    return header ? header->published.load(std::memory_order_acquire) : 0;
+}
+
+bool ScanShmReader::attach() {
+    detach();
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(ScanShmHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    header = static_cast<const ScanShmHeader*>(mapped);
+    mappedBytes = info.st_size;
+    if (!validRing()) {
+        detach();
+        return false;
+    }
+
+    epoch = header->epoch.load(std::memory_order_acquire);
+    uint64_t published = header->published.load(std::memory_order_acquire);
+    nextIndex = published ? published - 1 : 0;
+    return true;
+}
+
+void ScanShmReader::detach() {
+    if (header) munmap(const_cast<ScanShmHeader*>(header), mappedBytes);
+    header = nullptr;
+    mappedBytes = 0;
+}
+
+// the publisher sets magic last when it builds a ring and clears it first
+// when it closes one
+bool ScanShmReader::validRing() const {
+    if (header->magic != SCAN_SHM_MAGIC) return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header->version == SCAN_SHM_VERSION
+        && header->slotCount && header->slotBytes == scanShmSlotBytes(header->maxNodes)
+        && scanShmTotalBytes(header->slotCount, header->maxNodes) <= mappedBytes;
+}
+
+// Makes sure the mapped ring is the publisher's current one, moving to the
+// ring now under name if it was closed. False if there is none to read.
+bool ScanShmReader::followPublisher() {
+    if (name.empty()) return false;
+
+    if (header && validRing()) {
+        uint64_t current = header->epoch.load(std::memory_order_acquire);
+        if (current == epoch) return true;
+        epoch = current;
+        nextIndex = 0;
+        resetPending = true;
+        return true;
+    }
+
+    if (!attach()) return false;
+    // a new publisher, everything it still holds is news to us
+    nextIndex = 0;
+    resetPending = true;
+    return true;
+}
+
+ScanShmReader::CopyResult ScanShmReader::copySlot(uint64_t index, ScanFrame& out) const {
+    ScanShmSlot* slot = scanShmSlot(const_cast<ScanShmHeader*>(header), index);
+    uint64_t expected = 2 * index + 2;
+
+    uint64_t before = slot->generation.load(std::memory_order_acquire);
+    if (before < expected) return COPY_NOT_READY;
+    if (before > expected) return COPY_OVERWRITTEN;
+
+    uint32_t nodeCount = slot->nodeCount;
+    if (nodeCount > header->maxNodes) nodeCount = header->maxNodes;
+    out.sequence = slot->scanSequence;
+    out.timestampUs = slot->timestampUs;
+    out.scanMode = (uint16_t)slot->scanMode;
+    out.nodes.resize(nodeCount);
+    if (nodeCount) memcpy(&out.nodes[0], slot->nodes(), nodeCount * sizeof(out.nodes[0]));
+
+    // seqlock check: the writer must not have touched the slot while we copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->generation.load(std::memory_order_relaxed) != before) return COPY_OVERWRITTEN;
+    return COPY_OK;
+}
+
+ScanShmReader::Result ScanShmReader::readLatest(ScanFrame& out) {
+    if (!followPublisher()) return READ_CLOSED;
+
+    while (true) {
+        uint64_t published = header->published.load(std::memory_order_acquire);
+        if (!published) return READ_NONE;
+        // only fails if the writer lapped the whole ring mid-copy, try the new newest
+        if (copySlot(published - 1, out) == COPY_OK) return READ_OK;
+    }
+}
+
+ScanShmReader::Result ScanShmReader::readNext(ScanFrame& out) {
+    if (!followPublisher()) return READ_CLOSED;
+    bool overrun = false;
+
+    while (true) {
+        uint64_t published = header->published.load(std::memory_order_acquire);
+        if (nextIndex >= published) return READ_NONE;
+
+        // the slot after the newest may already be under rewrite, so the
+        // oldest safe scan is one newer than a full ring back
+        uint64_t oldest = published > header->slotCount ? published - header->slotCount + 1 : 0;
+        if (nextIndex < oldest) {
+            missedTotal += oldest - nextIndex;
+            nextIndex = oldest;
+            overrun = true;
+        }
+
+        CopyResult result = copySlot(nextIndex, out);
+        if (result == COPY_OK) {
+            ++nextIndex;
+            if (resetPending) {
+                resetPending = false;
+                return READ_RESET;
+            }
+            return overrun ? READ_OVERRUN : READ_OK;
+        }
+        if (result == COPY_NOT_READY) return READ_NONE;
+
+        // overwritten while we were copying, skip it and try the next one
+        ++missedTotal;
+        ++nextIndex;
+        overrun = true;
+    }
+}
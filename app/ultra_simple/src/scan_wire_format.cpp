@@ -0,0 +1,92 @@
+#include "scan_wire_format.h"
+
+static inline char* putLe16(char* p, uint16_t v) {
+    p[0] = (char)(v & 0xFF);
+    p[1] = (char)(v >> 8);
+    return p + 2;
+}
+
+static inline char* putLe32(char* p, uint32_t v) {
+    p[0] = (char)(v & 0xFF);
+    p[1] = (char)((v >> 8) & 0xFF);
+    p[2] = (char)((v >> 16) & 0xFF);
+    p[3] = (char)(v >> 24);
+    return p + 4;
+}
+
+static inline char* putLe64(char* p, uint64_t v) {
+    p = putLe32(p, (uint32_t)(v & 0xFFFFFFFFu));
+    return putLe32(p, (uint32_t)(v >> 32));
+}
+
+static inline uint16_t getLe16(const unsigned char* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t getLe32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t getLe64(const unsigned char* p) {
+    return (uint64_t)getLe32(p) | ((uint64_t)getLe32(p + 4) << 32);
+}
+
+static char* putHeader(char* p, ScanMessageType type, uint16_t scanMode, uint64_t sequence,
+                       uint64_t timestampUs, uint32_t nodeCount) {
+    p = putLe32(p, SCAN_WIRE_MAGIC);
+    *p++ = (char)SCAN_WIRE_VERSION;
+    *p++ = (char)type;
+    p = putLe16(p, scanMode);
+    p = putLe64(p, sequence);
+    p = putLe64(p, timestampUs);
+    return putLe32(p, nodeCount);
+}
+
+void encodeScanWireHeader(ScanMessageType type, uint16_t scanMode, uint64_t sequence,
+                          uint64_t timestampUs, uint32_t nodeCount, std::string& out) {
+    size_t offset = out.size();
+    out.resize(offset + sizeof(ScanWireHeader));
+    putHeader(&out[offset], type, scanMode, sequence, timestampUs, nodeCount);
+}
+
+bool decodeScanWireHeader(const char* data, size_t size, ScanWireHeader& header) {
+    if (size < sizeof(ScanWireHeader)) return false;
+
+    const unsigned char* p = (const unsigned char*)data;
+    header.magic = getLe32(p);
+    header.version = p[4];
+    header.messageType = p[5];
+    header.scanMode = getLe16(p + 6);
+    header.sequence = getLe64(p + 8);
+    header.timestampUs = getLe64(p + 16);
+    header.nodeCount = getLe32(p + 24);
+    return header.magic == SCAN_WIRE_MAGIC && header.version == SCAN_WIRE_VERSION;
+}
+
+size_t binaryScanSize(size_t nodeCount) {
+    return sizeof(ScanWireHeader) + nodeCount * sizeof(ScanWireNode);
+}
+
+void encodeBinaryScan(const ScanFrame& frame, ScanMessageType type, std::string& out) {
+    size_t offset = out.size();
+    out.resize(offset + binaryScanSize(frame.nodes.size()));
+    char* p = &out[offset];
+
+    p = putHeader(p, type, frame.scanMode, frame.sequence, frame.timestampUs, (uint32_t)frame.nodes.size());
+
+    for (const sl_lidar_response_measurement_node_hq_t& node : frame.nodes) {
+        p = putLe16(p, node.angle_z_q14);
+        p = putLe32(p, node.dist_mm_q2);
+        *p++ = (char)node.quality;
+    }
+}
+
+void encodeCommandFrameHeader(uint32_t payloadBytes, uint32_t requestId, char* out) {
+    out = putLe32(out, payloadBytes);
+    putLe32(out, requestId);
+}
+
+void decodeCommandFrameHeader(const unsigned char* data, CommandFrameHeader& header) {
+    header.payloadBytes = getLe32(data);
+    header.requestId = getLe32(data + 4);
+}
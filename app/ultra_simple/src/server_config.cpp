@@ -0,0 +1,59 @@
+#include "server_config.h"
+#include <fstream>
+#include <set>
+#include <json.hpp>
+
+bool loadServerConfig(const std::string& path, ServerConfig& config, std::string& error) {
+    std::ifstream file(path);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    nlohmann::json root;
+    try {
+        file >> root;
+
+        config.listenPort = root.value("listen_port", config.listenPort);
+        config.idleTimeoutSeconds = root.value("idle_timeout_s", config.idleTimeoutSeconds);
+        config.logLevel = root.value("log_level", config.logLevel);
+        config.scanLingerMs = root.value("scan_linger_ms", config.scanLingerMs);
+        config.metricsPort = root.value("metrics_port", config.metricsPort);
+        config.recordDirectory = root.value("record_dir", config.recordDirectory);
+        config.queuePolicy = root.value("queue_policy", config.queuePolicy);
+        config.maxQueuedFrames = root.value("max_queued_frames", config.maxQueuedFrames);
+        config.disconnectLagMs = root.value("disconnect_lag_ms", config.disconnectLagMs);
+        config.deltaKeyframeInterval = root.value("delta_keyframe_interval", config.deltaKeyframeInterval);
+
+        const nlohmann::json& devices = root.at("devices");
+        std::set<std::string> ids;
+        for (const nlohmann::json& entry : devices) {
+            LidarDeviceConfig device;
+            device.id = entry.at("id").get<std::string>();
+            device.portPath = entry.at("port").get<std::string>();
+            device.baudrate = entry.at("baudrate").get<sl_u32>();
+            device.cpu = entry.value("cpu", -1);
+            device.replaySpeed = entry.value("replay_speed", device.replaySpeed);
+
+            if (device.id.empty() || device.id.find(' ') != std::string::npos) {
+                error = "device ids must be non-empty and contain no spaces";
+                return false;
+            }
+            if (!ids.insert(device.id).second) {
+                error = "duplicate device id " + device.id;
+                return false;
+            }
+            config.devices.push_back(device);
+        }
+    }
+    catch (const std::exception& e) {
+        error = path + ": " + e.what();
+        return false;
+    }
+
+    if (config.devices.empty()) {
+        error = path + ": no devices configured";
+        return false;
+    }
+    return true;
+}
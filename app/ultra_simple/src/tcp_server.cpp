@@ -1,270 +1,1367 @@
 #include "tcp_server.h"
-#include <iostream>
+#include "logger.h"
 #include <cstring>
+#include <ctime>
 #include <thread>
+#include <chrono>
 
-#ifdef _WIN32
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#pragma comment(lib, "ws2_32.lib")
-#else
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
-#endif
+#include <errno.h>
+
+static const int DEFAULT_WORKER_THREADS = 4;
+static const int IDLE_SWEEP_INTERVAL_MS = 1000;
+static const int SAMPLE_WAIT_SWEEP_INTERVAL_MS = 100;
+// matches the SDK's default grabScanDataHq timeout the old blocking path used
+static const int SAMPLE_WAIT_TIMEOUT_MS = 2000;
+// buffers handed to a single sendmsg call, well below IOV_MAX
+static const size_t MAX_SEND_IOVECS = 64;
+// a few revolutions of slack before a subscriber starts losing frames
+static const size_t DEFAULT_MAX_QUEUED_FRAMES = 4;
+static const int DEFAULT_DISCONNECT_LAG_MS = 2000;
+static const int SLOW_CONSUMER_SWEEP_INTERVAL_MS = 100;
+// about five seconds at the usual 10Hz scan rate
+static const int DEFAULT_DELTA_KEYFRAME_INTERVAL = 50;
+// spin-up plus the SDK's mode queries, with room to spare
+static const int START_SCAN_TIMEOUT_MS = 10000;
+
+static const char* const SLOW_CONSUMER_POLICY_NAMES[] = { "DROP_OLDEST", "DROP_NEWEST", "DISCONNECT" };
+static const char* const SCAN_ENCODING_NAMES[] = { "json", "binary", "delta" };
+
+static uint64_t elapsedUs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// stages the SDK or an older frame could not time are left out
+static void recordLatency(LatencyHistogram& histogram, uint64_t fromUs, uint64_t toUs) {
+    if (fromUs != 0 && toUs >= fromUs) histogram.record(toUs - fromUs);
+}
 
 void TcpServer::cleanupSocket(int socket) {
-#ifdef _WIN32
-    closesocket(socket);
-#else
     close(socket);
-#endif
 }
 
-TcpServer::TcpServer(int port, Lidar& lidar)
-    : serverSocket(-1), port(port), running(false), lidar(lidar) {
-#ifdef _WIN32
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        throw std::runtime_error("Failed to initialize Winsock");
-    }
-#endif
+TcpServer::TcpServer(int port)
+    : serverSocket(-1), port(port), running(false)
+    , nextConnectionId(1), idleTimeoutMs(0)
+    , defaultSlowConsumerPolicy(SLOW_CONSUMER_DROP_OLDEST)
+    , maxQueuedFrames(DEFAULT_MAX_QUEUED_FRAMES), disconnectLagMs(DEFAULT_DISCONNECT_LAG_MS)
+    , deltaKeyframeInterval(DEFAULT_DELTA_KEYFRAME_INTERVAL)
+    , multicast(nullptr)
+    , metricsServer(loop, [this]() { return renderMetrics(); }), metricsPort(0)
+    , workerThreadCount(DEFAULT_WORKER_THREADS), workersStopping(false) {
 }
 
 TcpServer::~TcpServer() {
     stop();
-#ifdef _WIN32
-    WSACleanup(); 
-#endif
+}
+
+void TcpServer::addDevice(const std::string& id, Lidar& lidar) {
+    devices.emplace_back(id, lidar);
+}
+
+void TcpServer::setMetricsPort(int port) {
+    metricsPort = port;
+}
+
+void TcpServer::setRecordDirectory(const std::string& directory) {
+    recordDirectory = directory;
+}
+
+void TcpServer::setIdleTimeout(int seconds) {
+    idleTimeoutMs = seconds > 0 ? seconds * 1000 : 0;
+}
+
+void TcpServer::setWorkerThreadCount(int count) {
+    workerThreadCount = count > 0 ? count : 1;
+}
+
+void TcpServer::setSlowConsumerPolicy(SlowConsumerPolicy policy, size_t maxFrames, int lagMs) {
+    defaultSlowConsumerPolicy = policy;
+    maxQueuedFrames = maxFrames > 0 ? maxFrames : 1;
+    disconnectLagMs = lagMs > 0 ? lagMs : DEFAULT_DISCONNECT_LAG_MS;
+}
+
+bool TcpServer::parseSlowConsumerPolicy(const std::string& name, SlowConsumerPolicy& policy) {
+    for (int i = SLOW_CONSUMER_DROP_OLDEST; i <= SLOW_CONSUMER_DISCONNECT; ++i) {
+        if (name == SLOW_CONSUMER_POLICY_NAMES[i]) {
+            policy = (SlowConsumerPolicy)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TcpServer::setDeltaKeyframeInterval(int scans) {
+    deltaKeyframeInterval = scans > 0 ? scans : 1;
+}
+
+void TcpServer::setMulticastPublisher(MulticastPublisher* publisher) {
+    multicast = publisher;
 }
 
 void TcpServer::start() {
-    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (devices.empty()) {
+        LOG_ERROR("No LiDAR devices to serve");
+        return;
+    }
+
+    if (!loop.init()) {
+        LOG_ERROR("Failed to initialize event loop");
+        return;
+    }
+
+    serverSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (serverSocket < 0) {
-        std::cerr << "Failed to create socket\n";
+        LOG_ERROR("Failed to create socket");
         return;
     }
 
+    int reuse = 1;
+    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
     sockaddr_in serverAddr{};
     serverAddr.sin_family = AF_INET;
     serverAddr.sin_addr.s_addr = INADDR_ANY;
     serverAddr.sin_port = htons(port);
 
     if (bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
-        std::cerr << "Failed to bind socket\n";
+        LOG_ERROR("Failed to bind socket");
         cleanupSocket(serverSocket);
+        serverSocket = -1;
         return;
     }
 
-    if (listen(serverSocket, 5) < 0) {
-        std::cerr << "Failed to listen on socket\n";
+    if (listen(serverSocket, SOMAXCONN) < 0) {
+        LOG_ERROR("Failed to listen on socket");
         cleanupSocket(serverSocket);
+        serverSocket = -1;
         return;
     }
 
+    loop.addFd(serverSocket, EPOLLIN | EPOLLET, [this](uint32_t) { onAcceptReady(); });
+    if (idleTimeoutMs > 0) {
+        loop.addTimer(IDLE_SWEEP_INTERVAL_MS, [this]() { sweepIdleConnections(); });
+    }
+    loop.addTimer(SAMPLE_WAIT_SWEEP_INTERVAL_MS, [this]() { expireSampleWaiters(); });
+    loop.addTimer(SLOW_CONSUMER_SWEEP_INTERVAL_MS, [this]() { sweepSlowConsumers(); });
+    if (metricsPort > 0) metricsServer.open(metricsPort);
+
+    workersStopping = false;
+    for (int i = 0; i < workerThreadCount; ++i) {
+        workers.push_back(std::thread(&TcpServer::workerMain, this));
+    }
+
+    for (size_t i = 0; i < devices.size(); ++i) {
+        devices[i].frameListenerId = devices[i].lidar->addFrameListener([this, i](const ScanFramePtr& frame) {
+            loop.post([this, i, frame]() { onScanFrame(i, frame); });
+        });
+    }
+
     running = true;
-    std::cout << "Server listening on port " << port << "...\n";
+    LOG_INFO("Server listening on port %d for %zu device(s)...", port, devices.size());
+
+    loop.run();
+
+    metricsServer.close();
+    for (Device& device : devices) {
+        device.lidar->removeFrameListener(device.frameListenerId);
+        device.filteredStreams.clear();
+    }
+
+    {
+        std::lock_guard<std::mutex> l(jobMutex);
+        workersStopping = true;
+        jobs.clear();
+    }
+    jobCondition.notify_all();
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+    workers.clear();
+
+    while (!connections.empty()) {
+        closeConnection(connections.begin()->second);
+    }
+
+    loop.removeFd(serverSocket);
+    cleanupSocket(serverSocket);
+    serverSocket = -1;
+}
+
+void TcpServer::stop() {
+    running = false;
+    loop.quit();
+}
 
-    while (running) {
+void TcpServer::onAcceptReady() {
+    while (true) {
         sockaddr_in clientAddr{};
-#ifdef _WIN32
-        int clientLen = sizeof(clientAddr);
-#else
         socklen_t clientLen = sizeof(clientAddr);
-#endif
-        int clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientLen);
+        int clientSocket = accept4(serverSocket, (struct sockaddr*)&clientAddr, &clientLen,
+                                   SOCK_NONBLOCK | SOCK_CLOEXEC);
 
         if (clientSocket < 0) {
-            if (running) std::cerr << "Failed to accept connection\n";
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK && running) {
+                LOG_RATE_LIMITED(LOG_LEVEL_ERROR, 10, "Failed to accept connection, errno %d", errno);
+            }
+            return;
+        }
+
+        int noDelay = 1;
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        char peerAddress[INET_ADDRSTRLEN] = "";
+        inet_ntop(AF_INET, &clientAddr.sin_addr, peerAddress, sizeof(peerAddress));
+
+        uint64_t connectionId = nextConnectionId++;
+        ClientConnectionPtr conn = std::make_shared<ClientConnection>(
+            connectionId, clientSocket,
+            std::string(peerAddress) + ":" + std::to_string(ntohs(clientAddr.sin_port)),
+            EventLoop::nowMs());
+        conn->slowConsumerPolicy = defaultSlowConsumerPolicy;
+
+        if (!loop.addFd(clientSocket, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                        [this, connectionId](uint32_t events) { onClientEvent(connectionId, events); })) {
+            LOG_ERROR("Failed to register client socket");
+            cleanupSocket(clientSocket);
             continue;
         }
+        connections[connectionId] = conn;
+        connectionsAccepted.add();
+
+        LOG_RATE_LIMITED(LOG_LEVEL_INFO, 50, "Client %llu connected from %s",
+                         (unsigned long long)connectionId, conn->peerAddress.c_str());
 
-        std::cout << "Client connected\n";
-        std::thread(&TcpServer::handleClient, this, clientSocket).detach();
+        // the handshake goes through the workers like any other command so a slow
+        // health query never blocks the loop
+        conn->workerCommands.push_back(PendingCommand{ 0, "CONNECT", conn->device });
+        submitWorkerCommand(conn);
     }
 }
 
-void TcpServer::stop() {
-    running = false;
-    if (serverSocket >= 0) {
-        cleanupSocket(serverSocket);
-    }
+ClientConnectionPtr TcpServer::findConnection(uint64_t connectionId) {
+    auto itr = connections.find(connectionId);
+    if (itr == connections.end()) return ClientConnectionPtr();
+    return itr->second;
 }
 
-void TcpServer::handleClient(int clientSocket) {
-    if (!lidar.getDriver() || !lidar.checkHealth()) {
-        sendJsonResponse(clientSocket, "CONNECT", {
-            {"status", "LIDAR_ERROR"},
-            {"message", "LIDAR is unavailable or unhealthy"}
-            });
-        cleanupSocket(clientSocket);
+void TcpServer::onClientEvent(uint64_t connectionId, uint32_t events) {
+    ClientConnectionPtr conn = findConnection(connectionId);
+    if (!conn) return;
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        closeConnection(conn);
         return;
     }
 
-    sendJsonResponse(clientSocket, "CONNECT", {
-        {"status", "OK"},
-        {"message", "LIDAR connection established"}
-        });
+    if (events & (EPOLLIN | EPOLLRDHUP)) {
+        if (!readFromClient(conn)) {
+            closeConnection(conn);
+            return;
+        }
+    }
 
-    std::string buffer;
-    char chunk[1024];
+    if (events & EPOLLOUT) {
+        if (!flushOutput(conn)) {
+            closeConnection(conn);
+            return;
+        }
+    }
+}
+
+bool TcpServer::readFromClient(const ClientConnectionPtr& conn) {
+    // edge triggered: drain the socket completely, straight into the ring
+    while (!conn->inputClosed) {
+        iovec regions[2];
+        int regionCount = conn->input.writableRegions(regions);
+        if (regionCount == 0) {
+            // make room by taking the complete commands out first
+            if (!processInput(conn)) return false;
+            regionCount = conn->input.writableRegions(regions);
+            if (regionCount == 0) {
+                // too many commands outstanding, the rest waits in the socket
+                // until resumeInput() comes back for it
+                if (conn->inputPaused) break;
+                LOG_RATE_LIMITED(LOG_LEVEL_WARN, 10, "Client %llu sent an oversized command, disconnecting", (unsigned long long)conn->id);
+                return false;
+            }
+        }
+
+        ssize_t bytesRead = readv(conn->fd, regions, regionCount);
+        if (bytesRead > 0) {
+            conn->input.commit(bytesRead);
+            continue;
+        }
+        if (bytesRead == 0) {
+            conn->inputClosed = true;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        return false;
+    }
+
+    conn->lastActivityMs = EventLoop::nowMs();
+
+    if (!processInput(conn)) return false;
+
+    // everything answered in place, however many commands came in, leaves in one
+    // write; after a half-close the connection stays open until the rest is answered
+    return flushOutput(conn);
+}
+
+bool TcpServer::parseInput(const ClientConnectionPtr& conn) {
+    InputRing& input = conn->input;
+    conn->inputPaused = false;
+
+    while (!input.empty()) {
+        if (conn->commandBacklogFull()) {
+            conn->inputPaused = true;
+            break;
+        }
 
+        if (conn->framedInput) {
+            if (input.size() < sizeof(CommandFrameHeader)) break;
+
+            unsigned char rawHeader[sizeof(CommandFrameHeader)];
+            for (size_t i = 0; i < sizeof(rawHeader); ++i) rawHeader[i] = input.at(i);
+            CommandFrameHeader header;
+            decodeCommandFrameHeader(rawHeader, header);
+
+            if (header.payloadBytes > input.capacity() - sizeof(CommandFrameHeader)) {
+                LOG_RATE_LIMITED(LOG_LEVEL_WARN, 10, "Client %llu sent an oversized frame, disconnecting", (unsigned long long)conn->id);
+                return false;
+            }
+            if (input.size() < sizeof(CommandFrameHeader) + header.payloadBytes) break;
+
+            PendingCommand command{ header.requestId, std::string(), 0 };
+            input.copyTo(sizeof(CommandFrameHeader), header.payloadBytes, command.text);
+            input.consume(sizeof(CommandFrameHeader) + header.payloadBytes);
+            conn->pendingCommands.push_back(std::move(command));
+            continue;
+        }
+
+        size_t pos = input.find('\n', 0);
+        if (pos == InputRing::npos) break;
+
+        PendingCommand command{ 0, std::string(), 0 };
+        input.copyTo(0, pos, command.text);
+        input.consume(pos + 1);
+        // whatever follows this line in the ring is already framed
+        if (command.text == "PROTOCOL FRAMED") conn->framedInput = true;
+        conn->pendingCommands.push_back(std::move(command));
+    }
+    return true;
+}
+
+// Parse and dispatch until no complete command is left or the backlog is full.
+bool TcpServer::processInput(const ClientConnectionPtr& conn) {
     while (true) {
-        memset(chunk, 0, sizeof(chunk));
-        int bytesRead = recv(clientSocket, chunk, sizeof(chunk) - 1, 0);
-        if (bytesRead <= 0) break;
+        size_t buffered = conn->input.size();
+        if (!parseInput(conn)) return false;
+        dispatchNextCommand(conn);
+        if (conn->input.size() == buffered) return true;
+    }
+}
+
+// Called whenever commands complete, to pick up input left behind at a full backlog.
+bool TcpServer::resumeInput(const ClientConnectionPtr& conn) {
+    if (!conn->inputPaused || conn->commandBacklogFull()) return true;
+    return readFromClient(conn);
+}
+
+OutputChunk TcpServer::makeOutputChunk(const ClientConnectionPtr& conn, uint32_t requestId,
+                                       const SharedBuffer& data, bool droppableFrame) {
+    OutputChunk chunk{ data, droppableFrame, EventLoop::nowMs() };
+    if (conn->framed) {
+        encodeCommandFrameHeader((uint32_t)data->size(), requestId, chunk.frameHeader);
+        chunk.frameHeaderBytes = sizeof(chunk.frameHeader);
+    }
+    return chunk;
+}
+
+void TcpServer::queueOutput(const ClientConnectionPtr& conn, uint32_t requestId, const SharedBuffer& data) {
+    if (data->empty()) return;
+    conn->outputQueue.push_back(makeOutputChunk(conn, requestId, data, false));
+}
+
+void TcpServer::queueOutput(const ClientConnectionPtr& conn, uint32_t requestId, std::string data) {
+    if (data.empty()) return;
+    queueOutput(conn, requestId, makeSharedBuffer(std::move(data)));
+}
+
+bool TcpServer::queueFrame(const ClientConnectionPtr& conn, const ScanFramePtr& frame) {
+    bool deltaStream = conn->encoding == SCAN_ENCODING_DELTA;
 
-        buffer.append(chunk, bytesRead);
+    if (conn->queuedFrames >= maxQueuedFrames) {
+        switch (conn->slowConsumerPolicy) {
+        case SLOW_CONSUMER_DROP_NEWEST:
+            ++conn->framesDropped;
+            framesDroppedTotal.add();
+            // the client will miss this scan, so the next delta would not apply
+            if (deltaStream) conn->deltaBaseSequence = 0;
+            return true;
 
-        size_t pos;
-        while ((pos = buffer.find('\n')) != std::string::npos) {
-            std::string command = buffer.substr(0, pos);
-            buffer.erase(0, pos + 1);
+        case SLOW_CONSUMER_DROP_OLDEST: {
+            // a partially sent frame has to finish, or the stream would be corrupted
+            auto itr = conn->outputQueue.begin();
+            if (conn->outputOffset > 0) ++itr;
 
-            if (command == "START_SCAN") {
-                handleStartScan(clientSocket);
+            if (deltaStream) {
+                // every queued delta builds on the one before it, so drop them
+                // all and restart the chain with a keyframe
+                while (itr != conn->outputQueue.end()) {
+                    if (!itr->droppableFrame) {
+                        ++itr;
+                        continue;
+                    }
+                    itr = conn->outputQueue.erase(itr);
+                    --conn->queuedFrames;
+                    ++conn->framesDropped;
+                    framesDroppedTotal.add();
+                }
+                conn->deltaBaseSequence = 0;
+                break;
             }
-            else if (command == "GET_SAMPLE") {
-                handleGetSample(clientSocket);
+
+            while (itr != conn->outputQueue.end() && !itr->droppableFrame) ++itr;
+            if (itr == conn->outputQueue.end()) {
+                ++conn->framesDropped;
+                framesDroppedTotal.add();
+                return true;
             }
-            else if (command == "STOP") {
-                handleStopScan(clientSocket);
+            conn->outputQueue.erase(itr);
+            --conn->queuedFrames;
+            ++conn->framesDropped;
+            framesDroppedTotal.add();
+            break;
+        }
+
+        case SLOW_CONSUMER_DISCONNECT:
+            return false;
+        }
+    }
+
+    OutputChunk chunk = makeOutputChunk(conn, COMMAND_FRAME_PUSH_ID, streamMessage(conn, frame), true);
+    chunk.queuedUs = monotonicUs();
+    chunk.scanRxUs = frame->timing.rxUs;
+    conn->outputQueue.push_back(chunk);
+    ++conn->queuedFrames;
+    return true;
+}
+
+SharedBuffer TcpServer::streamMessage(const ClientConnectionPtr& conn, const ScanFramePtr& frame) {
+    if (conn->encoding != SCAN_ENCODING_DELTA) {
+        return cachedScanMessage(conn, frame, SCAN_MESSAGE_PUSH);
+    }
+
+    FilteredStream& stream = filteredStream(conn, frame);
+
+    // keyframes fall on the same scans for everyone so they are shared too
+    bool keyframeDue = frame->sequence % deltaKeyframeInterval == 0;
+    bool haveBase = conn->deltaBaseSequence != 0 && conn->deltaBaseSequence == stream.deltaEncoder.baseSequence();
+    conn->deltaBaseSequence = frame->sequence;
+
+    if (keyframeDue || !haveBase) {
+        if (!stream.keyframe) {
+            std::string message;
+            auto start = std::chrono::steady_clock::now();
+            stream.deltaEncoder.encodeKeyframe(message);
+            serializeTime[SCAN_ENCODING_DELTA].observe(elapsedUs(start));
+            recordLatency(latency[LATENCY_GRAB_TO_SERIALIZE], stream.frame->timing.grabbedUs, monotonicUs());
+            stream.keyframe = makeSharedBuffer(std::move(message));
+        }
+        return stream.keyframe;
+    }
+
+    if (!stream.delta) {
+        std::string message;
+        auto start = std::chrono::steady_clock::now();
+        stream.deltaEncoder.encodeDelta(message);
+        serializeTime[SCAN_ENCODING_DELTA].observe(elapsedUs(start));
+        recordLatency(latency[LATENCY_GRAB_TO_SERIALIZE], stream.frame->timing.grabbedUs, monotonicUs());
+        stream.delta = makeSharedBuffer(std::move(message));
+    }
+    return stream.delta;
+}
+
+TcpServer::FilteredStream& TcpServer::filteredStream(const ClientConnectionPtr& conn, const ScanFramePtr& frame) {
+    return filteredStream(devices[conn->device], conn->filterKey, conn->filter, frame);
+}
+
+TcpServer::FilteredStream& TcpServer::filteredStream(Device& device, const std::string& filterKey,
+                                                     const ScanFilter& filter, const ScanFramePtr& frame) {
+    FilteredStream& stream = device.filteredStreams[filterKey];
+    stream.lastUsedSequence = frame->sequence;
+    if (stream.source == frame) return stream;
+
+    stream.source = frame;
+    if (filter.isPassThrough()) {
+        stream.frame = frame;
+    }
+    else {
+        std::shared_ptr<ScanFrame> filtered = std::make_shared<ScanFrame>();
+        filter.apply(*frame, *filtered);
+        stream.frame = filtered;
+    }
+
+    for (auto& row : stream.messages) {
+        for (auto& message : row) message.reset();
+    }
+    stream.keyframe.reset();
+    stream.delta.reset();
+
+    // the delta chain only moves forward; a stream that skipped scans simply
+    // has an older base and its clients get a keyframe
+    if (frame->sequence > stream.deltaEncoder.currentSequence()) {
+        stream.deltaEncoder.update(*stream.frame);
+    }
+    return stream;
+}
+
+void TcpServer::pruneFilteredStreams(Device& device, uint64_t sequence) {
+    for (auto itr = device.filteredStreams.begin(); itr != device.filteredStreams.end();) {
+        if (itr->second.lastUsedSequence < sequence) itr = device.filteredStreams.erase(itr);
+        else ++itr;
+    }
+}
+
+void TcpServer::sweepSlowConsumers() {
+    int64_t now = EventLoop::nowMs();
+    std::vector<ClientConnectionPtr> expired;
+    for (auto& item : connections) {
+        const ClientConnectionPtr& conn = item.second;
+        int64_t lag = conn->lagMs(now);
+        if (lag > conn->maxLagMs) conn->maxLagMs = lag;
+        if (conn->slowConsumerPolicy == SLOW_CONSUMER_DISCONNECT && lag > disconnectLagMs) {
+            expired.push_back(conn);
+        }
+    }
+    for (auto& conn : expired) {
+        LOG_WARN("Client %llu (%s) is %lld ms behind, disconnecting",
+                 (unsigned long long)conn->id, conn->peerAddress.c_str(), (long long)conn->lagMs(now));
+        closeConnection(conn);
+    }
+}
+
+bool TcpServer::flushOutput(const ClientConnectionPtr& conn) {
+    while (conn->hasPendingOutput()) {
+        // gather straight from the queued buffers, shared scans are never copied
+        iovec iov[MAX_SEND_IOVECS];
+        size_t iovCount = 0;
+        for (auto itr = conn->outputQueue.begin();
+             itr != conn->outputQueue.end() && iovCount + 2 <= MAX_SEND_IOVECS; ++itr) {
+            size_t skip = itr == conn->outputQueue.begin() ? conn->outputOffset : 0;
+            if (skip < itr->frameHeaderBytes) {
+                iov[iovCount].iov_base = const_cast<char*>(itr->frameHeader + skip);
+                iov[iovCount].iov_len = itr->frameHeaderBytes - skip;
+                ++iovCount;
+                skip = 0;
             }
             else {
-                sendJsonResponse(clientSocket, "ERROR", { {"message", "Unknown command"} });
+                skip -= itr->frameHeaderBytes;
             }
+            iov[iovCount].iov_base = const_cast<char*>(itr->data->data() + skip);
+            iov[iovCount].iov_len = itr->data->size() - skip;
+            ++iovCount;
         }
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovCount;
+
+        ssize_t sent = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        if (sent > 0) {
+            bytesSent.add(sent);
+            uint64_t sentUs = 0;
+            size_t remaining = sent;
+            while (remaining > 0) {
+                const OutputChunk& front = conn->outputQueue.front();
+                size_t frontLeft = front.size() - conn->outputOffset;
+                if (remaining < frontLeft) {
+                    conn->outputOffset += remaining;
+                    break;
+                }
+                remaining -= frontLeft;
+                if (front.droppableFrame) {
+                    --conn->queuedFrames;
+                    ++conn->framesSent;
+                    framesSentTotal.add();
+                    if (!sentUs) sentUs = monotonicUs();
+                    recordLatency(latency[LATENCY_QUEUE_TO_SEND], front.queuedUs, sentUs);
+                    recordLatency(latency[LATENCY_TOTAL], front.scanRxUs, sentUs);
+                }
+                conn->outputQueue.pop_front();
+                conn->outputOffset = 0;
+            }
+            conn->lastActivityMs = EventLoop::nowMs();
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // EPOLLOUT will tell us when the socket drains
+            return true;
+        }
+        return false;
     }
 
-    cleanupSocket(clientSocket);
+    return !conn->closeAfterFlush && !conn->inputDone();
 }
 
-void TcpServer::handleStartScan(int clientSocket) {
-    auto driver = lidar.getDriver();
-    if (driver) {
-        driver->setMotorSpeed(600);
-        if (SL_IS_OK(driver->startScan(false, true))) {
-            sendJsonResponse(clientSocket, "START_SCAN", {
-                {"status", "OK"},
-                {"message", "LiDAR scan started"}
-                });
-            return;
+void TcpServer::closeConnection(const ClientConnectionPtr& conn) {
+    conn->subscribed = false;
+    conn->scanRequested = false;
+    updateScanReference(conn);
+
+    loop.removeFd(conn->fd);
+    cleanupSocket(conn->fd);
+    connections.erase(conn->id);
+    connectionsClosed.add();
+    LOG_RATE_LIMITED(LOG_LEVEL_INFO, 50, "Client %llu disconnected", (unsigned long long)conn->id);
+}
+
+void TcpServer::sweepIdleConnections() {
+    int64_t now = EventLoop::nowMs();
+    std::vector<ClientConnectionPtr> expired;
+    for (auto& item : connections) {
+        const ClientConnectionPtr& conn = item.second;
+        // a client waiting on a slow command is not idle
+        if (conn->busy()) continue;
+        if (now - conn->lastActivityMs >= idleTimeoutMs) {
+            expired.push_back(conn);
         }
     }
-    sendJsonResponse(clientSocket, "START_SCAN", {
-        {"status", "FAILED"},
-        {"message", "Failed to start LiDAR scan"}
+    for (auto& conn : expired) {
+        LOG_RATE_LIMITED(LOG_LEVEL_INFO, 50, "Closing idle client %llu", (unsigned long long)conn->id);
+        closeConnection(conn);
+    }
+}
+
+void TcpServer::dispatchNextCommand(const ClientConnectionPtr& conn) {
+    // a framed connection takes every parsed command at once, so the cheap ones
+    // are answered here while an earlier LiDAR command is still running
+    while (!conn->pendingCommands.empty() && (conn->framed || !conn->busy())) {
+        PendingCommand pending = std::move(conn->pendingCommands.front());
+        conn->pendingCommands.pop_front();
+        commandsHandled.add();
+        const std::string& command = pending.text;
+        uint32_t requestId = pending.requestId;
+
+        if (command.compare(0, 9, "PROTOCOL ") == 0) {
+            // the reply itself still goes out as a plain line
+            queueOutput(conn, requestId, handleProtocol(command.substr(9)));
+            conn->framed = conn->framedInput;
+            continue;
+        }
+
+        // subscription changes only touch loop state, answer them in place
+        if (command == "SUBSCRIBE" || command == "UNSUBSCRIBE") {
+            queueOutput(conn, requestId, handleSubscription(conn, command == "SUBSCRIBE"));
+            continue;
+        }
+
+        // STOP only gives up this client's share of the scan, nothing blocks
+        if (command == "STOP") {
+            queueOutput(conn, requestId, handleStopScan(conn));
+            continue;
+        }
+
+        // the reference is taken here, the worker only waits for the motor
+        if (command == "START_SCAN") {
+            conn->scanRequested = true;
+            updateScanReference(conn);
+        }
+
+        if (command.compare(0, 13, "QUEUE_POLICY ") == 0) {
+            queueOutput(conn, requestId, handleQueuePolicy(conn, command.substr(13)));
+            continue;
+        }
+
+        if (command == "CLIENTS") {
+            queueOutput(conn, requestId, handleClients());
+            continue;
+        }
+
+        if (command == "DEVICES") {
+            queueOutput(conn, requestId, handleDevices());
+            continue;
+        }
+
+        if (command == "STATS" || command.compare(0, 6, "STATS ") == 0) {
+            queueOutput(conn, requestId, handleStats(command.size() > 6 ? command.substr(6) : std::string()));
+            continue;
+        }
+
+        if (command.compare(0, 7, "DEVICE ") == 0) {
+            queueOutput(conn, requestId, handleSelectDevice(conn, command.substr(7)));
+            continue;
+        }
+
+        if (command == "FILTER" || command.compare(0, 7, "FILTER ") == 0) {
+            queueOutput(conn, requestId, handleFilter(conn, command.size() > 7 ? command.substr(7) : std::string()));
+            continue;
+        }
+
+        if (command == "RESYNC") {
+            queueOutput(conn, requestId, handleResync(conn));
+            continue;
+        }
+
+        if (command.compare(0, 7, "FORMAT ") == 0) {
+            queueOutput(conn, requestId, handleFormat(conn, command.substr(7)));
+            continue;
+        }
+
+        // samples come from the acquisition cache, never from a worker
+        if (command == "GET_SAMPLE" || command == "GET_SAMPLE FRESH") {
+            handleGetSample(conn, requestId, command == "GET_SAMPLE FRESH");
+            continue;
+        }
+
+        pending.device = conn->device;
+        conn->workerCommands.push_back(std::move(pending));
+        submitWorkerCommand(conn);
+    }
+}
+
+void TcpServer::submitWorkerCommand(const ClientConnectionPtr& conn) {
+    if (conn->commandInFlight || conn->workerCommands.empty()) return;
+
+    conn->commandInFlight = true;
+    {
+        std::lock_guard<std::mutex> l(jobMutex);
+        PendingCommand& next = conn->workerCommands.front();
+        jobs.push_back(CommandJob{ conn->id, next.requestId, next.device, std::move(next.text) });
+    }
+    conn->workerCommands.pop_front();
+    jobCondition.notify_one();
+}
+
+void TcpServer::completeCommand(uint64_t connectionId, uint32_t requestId, const std::string& response, bool closeAfterReply) {
+    ClientConnectionPtr conn = findConnection(connectionId);
+    if (!conn) return;
+
+    conn->commandInFlight = false;
+    if (closeAfterReply) {
+        conn->closeAfterFlush = true;
+        conn->pendingCommands.clear();
+        conn->workerCommands.clear();
+    }
+
+    queueOutput(conn, requestId, response);
+    submitWorkerCommand(conn);
+    dispatchNextCommand(conn);
+    if (!resumeInput(conn)) {
+        closeConnection(conn);
+        return;
+    }
+
+    // replies from workers that finish together leave in one write
+    if (deferredFlushes.empty()) {
+        loop.post([this]() { flushDeferred(); });
+    }
+    deferredFlushes.push_back(connectionId);
+}
+
+void TcpServer::flushDeferred() {
+    std::vector<uint64_t> connectionIds;
+    connectionIds.swap(deferredFlushes);
+    for (uint64_t connectionId : connectionIds) {
+        ClientConnectionPtr conn = findConnection(connectionId);
+        if (conn && !flushOutput(conn)) {
+            closeConnection(conn);
+        }
+    }
+}
+
+std::string TcpServer::handleProtocol(const std::string& protocol) {
+    if (protocol != "FRAMED") {
+        return makeJsonResponse("PROTOCOL", {
+            {"status", "INVALID"},
+            {"message", "Unknown protocol, use FRAMED"}
+            });
+    }
+
+    return makeJsonResponse("PROTOCOL", {
+        {"status", "OK"},
+        {"protocol", "FRAMED"}
         });
 }
 
-void TcpServer::handleGetSample(int clientSocket) {
-    if (!lidar.getDriver()) {
-        sendJsonResponse(clientSocket, "GET_SAMPLE", {
+std::string TcpServer::handleSubscription(const ClientConnectionPtr& conn, bool subscribe) {
+    const char* command = subscribe ? "SUBSCRIBE" : "UNSUBSCRIBE";
+    conn->subscribed = subscribe;
+    conn->deltaBaseSequence = 0;
+    updateScanReference(conn);
+
+    return makeJsonResponse(command, {
+        {"status", "OK"},
+        {"message", subscribe ? "Subscribed to scan stream" : "Unsubscribed from scan stream"}
+        });
+}
+
+std::string TcpServer::handleFormat(const ClientConnectionPtr& conn, const std::string& format) {
+    if (format == "JSON") {
+        conn->encoding = SCAN_ENCODING_JSON;
+    }
+    else if (format == "BINARY") {
+        conn->encoding = SCAN_ENCODING_BINARY;
+    }
+    else if (format == "DELTA") {
+        conn->encoding = SCAN_ENCODING_DELTA;
+    }
+    else {
+        return makeJsonResponse("FORMAT", {
             {"status", "FAILED"},
-            {"message", "LiDAR driver unavailable"}
+            {"message", "Unsupported format, use JSON, BINARY or DELTA"}
+            });
+    }
+    conn->deltaBaseSequence = 0;
+
+    return makeJsonResponse("FORMAT", {
+        {"status", "OK"},
+        {"format", format}
         });
-        return;
+}
+
+std::string TcpServer::handleQueuePolicy(const ClientConnectionPtr& conn, const std::string& policyName) {
+    if (parseSlowConsumerPolicy(policyName, conn->slowConsumerPolicy)) {
+        return makeJsonResponse("QUEUE_POLICY", {
+            {"status", "OK"},
+            {"policy", policyName}
+            });
     }
 
-    auto driver = lidar.getDriver();
-    sl_lidar_response_measurement_node_hq_t nodes[8192];
-    size_t nodeCount = _countof(nodes);
+    return makeJsonResponse("QUEUE_POLICY", {
+        {"status", "FAILED"},
+        {"message", "Unknown policy, use DROP_OLDEST, DROP_NEWEST or DISCONNECT"}
+        });
+}
 
-    if (SL_IS_OK(driver->grabScanDataHq(nodes, nodeCount))) {
-        driver->ascendScanData(nodes, nodeCount);
+std::string TcpServer::handleClients() {
+    int64_t now = EventLoop::nowMs();
+    nlohmann::json clients = nlohmann::json::array();
+    for (auto& item : connections) {
+        const ClientConnectionPtr& conn = item.second;
+        size_t queuedBytes = 0;
+        for (const OutputChunk& chunk : conn->outputQueue) queuedBytes += chunk.size();
 
-        nlohmann::json sampleJson = nlohmann::json::array();
-        for (size_t i = 0; i < nodeCount; ++i) {
-            int rawQuality = nodes[i].quality;
-            int adjustedQuality = rawQuality >> SL_LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT;
+        clients.push_back({
+            {"id", conn->id},
+            {"peer", conn->peerAddress},
+            {"protocol", conn->framed ? "FRAMED" : "LINES"},
+            {"device", devices[conn->device].id},
+            {"subscribed", conn->subscribed},
+            {"policy", SLOW_CONSUMER_POLICY_NAMES[conn->slowConsumerPolicy]},
+            {"queued_frames", conn->queuedFrames},
+            {"queued_bytes", queuedBytes - conn->outputOffset},
+            {"lag_ms", conn->lagMs(now)},
+            {"max_lag_ms", conn->maxLagMs},
+            {"frames_sent", conn->framesSent},
+            {"frames_dropped", conn->framesDropped}
+        });
+    }
 
-            std::cout << "{ angle: " << nodes[i].angle_z_q14 * 90.f / (1 << 14)
-                      << ", distance: " << nodes[i].dist_mm_q2 / 4.0
-                      << ", raw quality: " << rawQuality
-                      << ", adjusted quality: " << adjustedQuality
-                      << " }" << std::endl;
+    return makeJsonResponse("CLIENTS", {
+        {"status", "OK"},
+        {"clients", clients}
+        });
+}
 
-            sampleJson.push_back({
-                {"angle", nodes[i].angle_z_q14 * 90.f / (1 << 14)},
-                {"distance", nodes[i].dist_mm_q2 / 4.0},
-                {"quality", adjustedQuality}
+std::string TcpServer::handleDevices() {
+    nlohmann::json list = nlohmann::json::array();
+    for (const Device& device : devices) {
+        ScanFramePtr frame = device.lidar->latestFrame();
+        list.push_back({
+            {"id", device.id},
+            {"connected", device.lidar->getDriver() != nullptr},
+            {"scanning", device.lidar->isScanning()},
+            {"scan_clients", device.lidar->scanReferenceCount()},
+            {"last_sequence", frame ? frame->sequence : 0}
+        });
+    }
+
+    return makeJsonResponse("DEVICES", {
+        {"status", "OK"},
+        {"devices", list}
+        });
+}
+
+std::string TcpServer::handleSelectDevice(const ClientConnectionPtr& conn, const std::string& deviceId) {
+    for (size_t i = 0; i < devices.size(); ++i) {
+        if (devices[i].id != deviceId) continue;
+
+        if (conn->device != i) {
+            // the scan reference follows the connection to its new device
+            if (conn->holdsScan) {
+                devices[conn->device].lidar->releaseScan();
+                conn->holdsScan = false;
+            }
+            conn->device = i;
+            updateScanReference(conn);
+            // sequences are per device, so neither the delta chain nor a
+            // parked GET_SAMPLE FRESH can carry over
+            conn->deltaBaseSequence = 0;
+            conn->sampleAfterSequence = 0;
+        }
+        return makeJsonResponse("DEVICE", {
+            {"status", "OK"},
+            {"device", deviceId}
+            });
+    }
+
+    return makeJsonResponse("DEVICE", {
+        {"status", "INVALID"},
+        {"message", "Unknown device " + deviceId + ", see DEVICES"}
+        });
+}
+
+std::string TcpServer::handleStats(const std::string& args) {
+    if (!args.empty() && args != "RESET") {
+        return makeJsonResponse("STATS", {
+            {"status", "ERROR"},
+            {"message", "Use STATS or STATS RESET"}
             });
+    }
+
+    nlohmann::json stages = nlohmann::json::object();
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; ++stage) {
+        const LatencyHistogram& histogram = latency[stage];
+        stages[LATENCY_STAGE_NAMES[stage]] = {
+            {"count", histogram.count()},
+            {"p50", histogram.percentileUs(0.5)},
+            {"p99", histogram.percentileUs(0.99)},
+            {"max", histogram.maxUs()}
+        };
+    }
+
+    // the snapshot above is what the reset discards
+    if (args == "RESET") {
+        for (LatencyHistogram& histogram : latency) histogram.reset();
+    }
+
+    return makeJsonResponse("STATS", {
+        {"status", "OK"},
+        {"latency_us", stages}
+        });
+}
+
+std::string TcpServer::renderMetrics() {
+    std::string out;
+    MetricsWriter writer(out);
+    int64_t now = EventLoop::nowMs();
+
+    writer.describe("lidar_server_connections", "gauge", "Open client connections.");
+    writer.sample("lidar_server_connections", std::string(), (uint64_t)connections.size());
+    writer.describe("lidar_server_connections_accepted_total", "counter", "Client connections accepted.");
+    writer.sample("lidar_server_connections_accepted_total", std::string(), connectionsAccepted.get());
+    writer.describe("lidar_server_connections_closed_total", "counter", "Client connections closed.");
+    writer.sample("lidar_server_connections_closed_total", std::string(), connectionsClosed.get());
+    writer.describe("lidar_server_commands_total", "counter", "Commands received from clients.");
+    writer.sample("lidar_server_commands_total", std::string(), commandsHandled.get());
+    writer.describe("lidar_server_bytes_sent_total", "counter", "Bytes written to client sockets.");
+    writer.sample("lidar_server_bytes_sent_total", std::string(), bytesSent.get());
+    writer.describe("lidar_server_frames_sent_total", "counter", "Pushed scan frames fully written to subscribers.");
+    writer.sample("lidar_server_frames_sent_total", std::string(), framesSentTotal.get());
+    writer.describe("lidar_server_frames_dropped_total", "counter", "Pushed scan frames dropped for slow subscribers.");
+    writer.sample("lidar_server_frames_dropped_total", std::string(), framesDroppedTotal.get());
+
+    writer.describe("lidar_server_serialize_seconds", "histogram", "Time to serialize one scan message.");
+    for (int encoding = 0; encoding < SCAN_ENCODING_COUNT; ++encoding) {
+        writer.histogram("lidar_server_serialize_seconds", MetricsWriter::label("encoding", SCAN_ENCODING_NAMES[encoding]),
+                         serializeTime[encoding]);
+    }
+
+    std::vector<std::string> clientLabels;
+    for (auto& item : connections) {
+        const ClientConnectionPtr& conn = item.second;
+        clientLabels.push_back(MetricsWriter::label("client", std::to_string(conn->id)) + ","
+                               + MetricsWriter::label("peer", conn->peerAddress) + ","
+                               + MetricsWriter::label("device", devices[conn->device].id));
+    }
+
+    writer.describe("lidar_client_lag_ms", "gauge", "Age of the oldest unsent chunk per client.");
+    size_t index = 0;
+    for (auto& item : connections) {
+        writer.sample("lidar_client_lag_ms", clientLabels[index++], (uint64_t)item.second->lagMs(now));
+    }
+    writer.describe("lidar_client_queued_frames", "gauge", "Pushed scan frames waiting per client.");
+    index = 0;
+    for (auto& item : connections) {
+        writer.sample("lidar_client_queued_frames", clientLabels[index++], (uint64_t)item.second->queuedFrames);
+    }
+    writer.describe("lidar_client_frames_dropped_total", "counter", "Pushed scan frames dropped per client.");
+    index = 0;
+    for (auto& item : connections) {
+        writer.sample("lidar_client_frames_dropped_total", clientLabels[index++], item.second->framesDropped);
+    }
+
+    std::vector<std::string> deviceLabels;
+    std::vector<LidarDriverStats> driverStats(devices.size());
+    std::vector<bool> haveDriver(devices.size());
+    for (size_t i = 0; i < devices.size(); ++i) {
+        deviceLabels.push_back(MetricsWriter::label("device", devices[i].id));
+        ILidarDriver* driver = devices[i].lidar->getDriver();
+        haveDriver[i] = driver != nullptr;
+        if (driver) driver->getStats(driverStats[i]);
+    }
+
+    writer.describe("lidar_device_scanning", "gauge", "Whether the device is scanning.");
+    for (size_t i = 0; i < devices.size(); ++i) {
+        writer.sample("lidar_device_scanning", deviceLabels[i], (uint64_t)devices[i].lidar->isScanning());
+    }
+    writer.describe("lidar_device_scan_clients", "gauge", "Clients holding a reference on the device's scan.");
+    for (size_t i = 0; i < devices.size(); ++i) {
+        writer.sample("lidar_device_scan_clients", deviceLabels[i], (uint64_t)devices[i].lidar->scanReferenceCount());
+    }
+    writer.describe("lidar_device_scans_published_total", "counter", "Scans published by the acquisition thread.");
+    for (size_t i = 0; i < devices.size(); ++i) {
+        writer.sample("lidar_device_scans_published_total", deviceLabels[i], devices[i].lidar->publishedFrameCount());
+    }
+
+    struct DriverCounter {
+        const char* name;
+        const char* help;
+        sl_u64 LidarDriverStats::*field;
+    };
+    static const DriverCounter DRIVER_COUNTERS[] = {
+        { "lidar_driver_scans_completed_total", "Revolutions completed by the SDK.", &LidarDriverStats::scans_completed },
+        { "lidar_driver_nodes_decoded_total", "HQ nodes decoded by the SDK.", &LidarDriverStats::nodes_decoded },
+        { "lidar_driver_nodes_dropped_total", "Nodes lost because the SDK scan buffer was full.", &LidarDriverStats::nodes_dropped },
+        { "lidar_decoder_checksum_errors_total", "Capsules with a bad checksum.", &LidarDriverStats::checksum_errors },
+        { "lidar_decoder_crc_errors_total", "HQ capsules with a bad CRC32.", &LidarDriverStats::crc_errors },
+        { "lidar_decoder_encoder_resets_total", "Capsule streams restarted mid scan.", &LidarDriverStats::encoder_resets },
+    };
+    for (const DriverCounter& counter : DRIVER_COUNTERS) {
+        writer.describe(counter.name, "counter", counter.help);
+        for (size_t i = 0; i < devices.size(); ++i) {
+            if (haveDriver[i]) writer.sample(counter.name, deviceLabels[i], (uint64_t)(driverStats[i].*counter.field));
         }
+    }
 
-        sendJsonResponse(clientSocket, "GET_SAMPLE", {
-            {"status", "OK"},
-            {"data", sampleJson}
+    return out;
+}
+
+std::string TcpServer::handleResync(const ClientConnectionPtr& conn) {
+    conn->deltaBaseSequence = 0;
+    return makeJsonResponse("RESYNC", {
+        {"status", "OK"},
+        {"message", "Next scan will be a keyframe"}
+        });
+}
+
+std::string TcpServer::handleFilter(const ClientConnectionPtr& conn, const std::string& args) {
+    ScanFilter filter;
+    std::string error;
+    if (!ScanFilter::parse(args, filter, error)) {
+        return makeJsonResponse("FILTER", {
+            {"status", "FAILED"},
+            {"message", error}
+            });
+    }
+
+    conn->filter = filter;
+    conn->filterKey = filter.key();
+    conn->deltaBaseSequence = 0;
+    return makeJsonResponse("FILTER", {
+        {"status", "OK"},
+        {"filter", filter.describe()}
         });
-    } else {
-        sendJsonResponse(clientSocket, "GET_SAMPLE", {
+}
+
+void TcpServer::onScanFrame(size_t deviceIndex, const ScanFramePtr& frame) {
+    std::vector<ClientConnectionPtr> touched;
+    std::vector<ClientConnectionPtr> overflowed;
+    Device& device = devices[deviceIndex];
+
+    const ScanTiming& timing = frame->timing;
+    recordLatency(latency[LATENCY_RX_TO_DECODE], timing.rxUs, timing.decodedUs);
+    recordLatency(latency[LATENCY_DECODE_TO_COMPLETE], timing.decodedUs, timing.completedUs);
+    recordLatency(latency[LATENCY_COMPLETE_TO_GRAB], timing.completedUs, timing.grabbedUs);
+
+    for (auto& item : connections) {
+        const ClientConnectionPtr& conn = item.second;
+        if (conn->device != deviceIndex) continue;
+        bool wrote = false;
+
+        if (conn->subscribed) {
+            if (!queueFrame(conn, frame)) {
+                overflowed.push_back(conn);
+                continue;
+            }
+            wrote = true;
+        }
+
+        // every GET_SAMPLE waiting for this revolution is answered by the same grab
+        if (conn->waitingForSample() && frame->sequence > conn->sampleAfterSequence) {
+            answerSampleWaiters(conn, cachedScanMessage(conn, frame, SCAN_MESSAGE_SAMPLE));
+            wrote = true;
+        }
+
+        if (wrote) touched.push_back(conn);
+    }
+
+    if (deviceIndex == 0 && multicast && multicast->isOpen()) {
+        // shares the unfiltered BINARY buffer with TCP clients
+        multicast->publish(frame->sequence,
+                           serializedScan(filteredStream(device, std::string(), ScanFilter(), frame),
+                                          SCAN_ENCODING_BINARY, SCAN_MESSAGE_PUSH));
+    }
+
+    pruneFilteredStreams(device, frame->sequence);
+
+    for (auto& conn : overflowed) {
+        LOG_WARN("Client %llu (%s) has %zu frames queued, disconnecting",
+                 (unsigned long long)conn->id, conn->peerAddress.c_str(), conn->queuedFrames);
+        closeConnection(conn);
+    }
+
+    for (auto& conn : touched) {
+        if (!resumeInput(conn) || !flushOutput(conn)) {
+            closeConnection(conn);
+        }
+    }
+}
+
+void TcpServer::expireSampleWaiters() {
+    int64_t now = EventLoop::nowMs();
+    std::vector<ClientConnectionPtr> touched;
+    for (auto& item : connections) {
+        const ClientConnectionPtr& conn = item.second;
+        if (!conn->waitingForSample() || now < conn->sampleDeadlineMs) continue;
+
+        answerSampleWaiters(conn, makeSharedBuffer(makeJsonResponse("GET_SAMPLE", {
             {"status", "FAILED"},
             {"message", "Failed to retrieve LiDAR sample"}
+            })));
+        touched.push_back(conn);
+    }
+
+    for (auto& conn : touched) {
+        if (!resumeInput(conn) || !flushOutput(conn)) {
+            closeConnection(conn);
+        }
+    }
+}
+
+void TcpServer::answerSampleWaiters(const ClientConnectionPtr& conn, const SharedBuffer& reply) {
+    std::vector<uint32_t> requestIds;
+    requestIds.swap(conn->sampleRequestIds);
+    for (uint32_t requestId : requestIds) {
+        queueOutput(conn, requestId, reply);
+    }
+    dispatchNextCommand(conn);
+}
+
+void TcpServer::workerMain() {
+    while (true) {
+        CommandJob job;
+        {
+            std::unique_lock<std::mutex> l(jobMutex);
+            jobCondition.wait(l, [this]() { return workersStopping || !jobs.empty(); });
+            if (workersStopping) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        bool closeAfterReply = false;
+        std::string response = executeCommand(job, closeAfterReply);
+
+        uint64_t connectionId = job.connectionId;
+        uint32_t requestId = job.requestId;
+        loop.post([this, connectionId, requestId, response, closeAfterReply]() {
+            completeCommand(connectionId, requestId, response, closeAfterReply);
         });
     }
 }
 
+std::string TcpServer::executeCommand(const CommandJob& job, bool& closeAfterReply) {
+    Lidar& lidar = *devices[job.device].lidar;
+    const std::string& command = job.command;
+
+    if (command == "CONNECT") {
+        // one healthy device is enough to be useful, DEVICES tells them apart
+        bool healthy = false;
+        for (const Device& device : devices) {
+            if (device.lidar->getDriver() && device.lidar->checkHealth()) {
+                healthy = true;
+                break;
+            }
+        }
+        closeAfterReply = !healthy;
+        return handleConnect(healthy);
+    }
+    else if (command == "START_SCAN") {
+        return handleStartScan(lidar);
+    }
+    else if (command == "RECORD START" || command == "RECORD STOP") {
+        return handleRecord(job.device, command == "RECORD START");
+    }
+    return makeJsonResponse("ERROR", { {"message", "Unknown command"} });
+}
 
+std::string TcpServer::handleConnect(bool healthy) {
+    if (!healthy) {
+        return makeJsonResponse("CONNECT", {
+            {"status", "LIDAR_ERROR"},
+            {"message", "LIDAR is unavailable or unhealthy"}
+            });
+    }
 
-//void TcpServer::handleGetSample(int clientSocket) {
-//    if (!lidar.getDriver()) {
-//        sendJsonResponse(clientSocket, "GET_SAMPLE", {
-//            {"status", "FAILED"},
-//            {"message", "LiDAR driver unavailable"}
-//            });
-//        return;
-//    }
-//
-//    auto driver = lidar.getDriver();
-//    sl_lidar_response_measurement_node_hq_t nodes[8192];
-//    size_t nodeCount = _countof(nodes);
-//
-//    if (SL_IS_OK(driver->grabScanDataHq(nodes, nodeCount))) {
-//        nlohmann::json sampleJson = nlohmann::json::array();
-//        for (size_t i = 0; i < nodeCount; ++i) {
-//            sampleJson.push_back({
-//                {"angle", nodes[i].angle_z_q14 * 90.f / (1 << 14)},
-//                {"distance", nodes[i].dist_mm_q2 / 4.0},
-//                {"quality", nodes[i].quality}
-//                });
-//        }
-//
-//        sendJsonResponse(clientSocket, "GET_SAMPLE", {
-//            {"status", "OK"},
-//            {"data", sampleJson}
-//            });
-//    }
-//    else {
-//        sendJsonResponse(clientSocket, "GET_SAMPLE", {
-//            {"status", "FAILED"},
-//            {"message", "Failed to retrieve LiDAR sample"}
-//            });
-//    }
-//}
-
-void TcpServer::handleStopScan(int clientSocket) {
-    auto driver = lidar.getDriver();
-    if (driver) {
-        driver->stop();
-        driver->setMotorSpeed(0);
-        sendJsonResponse(clientSocket, "STOP", {
+    return makeJsonResponse("CONNECT", {
+        {"status", "OK"},
+        {"message", "LIDAR connection established"}
+        });
+}
+
+void TcpServer::updateScanReference(const ClientConnectionPtr& conn) {
+    bool wanted = conn->subscribed || conn->scanRequested;
+    if (wanted == conn->holdsScan) return;
+
+    conn->holdsScan = wanted;
+    Lidar& lidar = *devices[conn->device].lidar;
+    if (wanted) lidar.acquireScan();
+    else lidar.releaseScan();
+}
+
+std::string TcpServer::handleStartScan(Lidar& lidar) {
+    // a device that cannot start now keeps trying until STOP withdraws the request
+    if (lidar.getDriver() && lidar.waitUntilScanning(START_SCAN_TIMEOUT_MS)) {
+        return makeJsonResponse("START_SCAN", {
             {"status", "OK"},
-            {"message", "LiDAR scan stopped"}
+            {"message", "LiDAR scan started"}
             });
-        return;
     }
-    sendJsonResponse(clientSocket, "STOP", {
+    return makeJsonResponse("START_SCAN", {
         {"status", "FAILED"},
-        {"message", "Failed to stop LiDAR scan"}
+        {"message", "Failed to start LiDAR scan"}
+        });
+}
+
+std::string TcpServer::handleRecord(size_t deviceIndex, bool start) {
+    const Device& device = devices[deviceIndex];
+    Lidar& lidar = *device.lidar;
+
+    if (!start) {
+        std::string path = lidar.recordingPath();
+        lidar.stopRecording();
+        return makeJsonResponse("RECORD", {
+            {"status", "OK"},
+            {"device", device.id},
+            {"file", path}
+            });
+    }
+
+    if (recordDirectory.empty()) {
+        return makeJsonResponse("RECORD", {
+            {"status", "ERROR"},
+            {"message", "Recording is disabled on this server"}
+            });
+    }
+
+    // clients only pick when, the server picks where
+    char stamp[32];
+    time_t now = time(nullptr);
+    struct tm local;
+    localtime_r(&now, &local);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    std::string name = device.id;
+    for (char& c : name) {
+        if (c == '/') c = '_';
+    }
+    std::string path = recordDirectory + "/" + name + "-" + stamp + ".slrc";
+
+    if (!lidar.startRecording(path)) {
+        return makeJsonResponse("RECORD", {
+            {"status", "FAILED"},
+            {"message", "Failed to start recording"}
+            });
+    }
+    return makeJsonResponse("RECORD", {
+        {"status", "OK"},
+        {"device", device.id},
+        {"file", path}
+        });
+}
+
+void TcpServer::handleGetSample(const ClientConnectionPtr& conn, uint32_t requestId, bool fresh) {
+    Lidar& lidar = *devices[conn->device].lidar;
+    if (!lidar.getDriver()) {
+        queueOutput(conn, requestId, makeJsonResponse("GET_SAMPLE", {
+            {"status", "FAILED"},
+            {"message", "LiDAR driver unavailable"}
+        }));
+        return;
+    }
+
+    ScanFramePtr frame = lidar.latestFrame();
+    if (frame && !fresh) {
+        queueOutput(conn, requestId, cachedScanMessage(conn, frame, SCAN_MESSAGE_SAMPLE));
+        return;
+    }
+
+    // park the request until the acquisition thread publishes a newer scan;
+    // pipelined requests join the ones already waiting
+    if (!conn->waitingForSample()) {
+        conn->sampleAfterSequence = frame ? frame->sequence : 0;
+        conn->sampleDeadlineMs = EventLoop::nowMs() + SAMPLE_WAIT_TIMEOUT_MS;
+    }
+    conn->sampleRequestIds.push_back(requestId);
+}
+
+std::string TcpServer::handleStopScan(const ClientConnectionPtr& conn) {
+    conn->scanRequested = false;
+    updateScanReference(conn);
+
+    int clients = devices[conn->device].lidar->scanReferenceCount();
+    return makeJsonResponse("STOP", {
+        {"status", "OK"},
+        {"message", "LiDAR scan released"},
+        {"scan_clients", clients}
         });
 }
 
-void TcpServer::sendJsonResponse(int clientSocket, const std::string& command, const nlohmann::json& response) {
+SharedBuffer TcpServer::cachedScanMessage(const ClientConnectionPtr& conn, const ScanFramePtr& frame, ScanMessageType type) {
+    // samples on a DELTA connection are sent whole
+    ScanEncoding encoding = conn->encoding == SCAN_ENCODING_DELTA ? SCAN_ENCODING_BINARY : conn->encoding;
+    return serializedScan(filteredStream(conn, frame), encoding, type);
+}
+
+SharedBuffer TcpServer::serializedScan(FilteredStream& stream, ScanEncoding encoding, ScanMessageType type) {
+    // each filter/encoding/message combination is serialized at most once per frame
+    SharedBuffer& message = stream.messages[encoding][type];
+    if (!message) {
+        auto start = std::chrono::steady_clock::now();
+        message = makeSharedBuffer(makeScanMessage(encoding, type, *stream.frame));
+        serializeTime[encoding].observe(elapsedUs(start));
+        recordLatency(latency[LATENCY_GRAB_TO_SERIALIZE], stream.frame->timing.grabbedUs, monotonicUs());
+    }
+    return message;
+}
+
+std::string TcpServer::makeScanMessage(ScanEncoding encoding, ScanMessageType type, const ScanFrame& frame) {
+    if (encoding == SCAN_ENCODING_BINARY) {
+        std::string message;
+        encodeBinaryScan(frame, type, message);
+        return message;
+    }
+
+    std::string message;
+    writeScanJson(type == SCAN_MESSAGE_PUSH ? "SCAN" : "GET_SAMPLE", frame, message);
+    return message;
+}
+
+std::string TcpServer::makeJsonResponse(const std::string& command, const nlohmann::json& response) {
     nlohmann::json jsonResponse = {
         {"command", command},
         {"response", response}
     };
-    std::string jsonString = jsonResponse.dump() + "\n";
-    send(clientSocket, jsonString.c_str(), jsonString.size(), 0);
+    return jsonResponse.dump() + "\n";
 }
-
-
@@ -0,0 +1,343 @@
+// Round-trip checks for the client-facing wire formats: the delta scan codec
+// (including a lost frame and the resync after it), multicast datagram
+// reassembly, the command input ring across its wrap point, and datagram
+// and shared memory readers following the publisher across restarts. Prints
+// each failure and exits non-zero if there was any.
+//
+//   wire_format_check
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "input_ring.h"
+#include "logger.h"
+#include "scan_datagram.h"
+#include "scan_delta_codec.h"
+#include "scan_shm_publisher.h"
+#include "scan_shm_reader.h"
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++failures; \
+        } \
+    } while (0)
+
+static const uint16_t BIN_COUNT = 720;
+static const size_t SCAN_NODES = 2000;
+
+static ScanFrame makeScan(uint64_t sequence) {
+    ScanFrame frame;
+    frame.sequence = sequence;
+    frame.timestampUs = sequence * 100000;
+    frame.scanMode = 1;
+    frame.nodes.resize(SCAN_NODES);
+    for (size_t i = 0; i < SCAN_NODES; ++i) {
+        sl_lidar_response_measurement_node_hq_t& node = frame.nodes[i];
+        node.angle_z_q14 = (uint16_t)(i * 65536 / SCAN_NODES);
+        // most of the scene is static, a moving patch and some dropouts change per scan
+        bool moving = i >= (sequence * 37) % SCAN_NODES && i < (sequence * 37) % SCAN_NODES + 150;
+        node.dist_mm_q2 = (i % 97 == sequence % 97) ? 0 : (uint32_t)(4000 + i * 3 + (moving ? sequence * 11 : 0));
+        node.quality = (uint8_t)(moving ? 100 + sequence : 188);
+        node.flag = 0;
+    }
+    return frame;
+}
+
+// Same binning as ScanDeltaEncoder::update, as the reference the decoder must reproduce.
+static std::vector<ScanDeltaBin> binScan(const ScanFrame& frame) {
+    std::vector<ScanDeltaBin> bins(BIN_COUNT, ScanDeltaBin{ 0, 0 });
+    for (const sl_lidar_response_measurement_node_hq_t& node : frame.nodes) {
+        if (!node.dist_mm_q2) continue;
+        ScanDeltaBin& bin = bins[((uint32_t)node.angle_z_q14 * BIN_COUNT) >> 16];
+        if (!bin.dist_mm_q2 || node.dist_mm_q2 < bin.dist_mm_q2) {
+            bin.dist_mm_q2 = node.dist_mm_q2;
+            bin.quality = node.quality;
+        }
+    }
+    return bins;
+}
+
+static bool sameBins(const std::vector<ScanDeltaBin>& a, const std::vector<ScanDeltaBin>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].dist_mm_q2 != b[i].dist_mm_q2 || a[i].quality != b[i].quality) return false;
+    }
+    return true;
+}
+
+static void checkDeltaCodec() {
+    ScanDeltaEncoder encoder(BIN_COUNT);
+    ScanDeltaDecoder decoder;
+    std::string message;
+
+    // a delta before any keyframe has nothing to apply to
+    encoder.update(makeScan(1));
+    encoder.update(makeScan(2));
+    message.clear();
+    encoder.encodeDelta(message);
+    CHECK(decoder.decode(message.data(), message.size()) == ScanDeltaDecoder::DECODE_NEED_KEYFRAME);
+
+    message.clear();
+    encoder.encodeKeyframe(message);
+    CHECK(scanDeltaMessageSize(message.data(), message.size()) == message.size());
+    CHECK(decoder.decode(message.data(), message.size()) == ScanDeltaDecoder::DECODE_OK);
+    CHECK(decoder.sequence() == 2);
+    CHECK(sameBins(decoder.bins(), binScan(makeScan(2))));
+
+    for (uint64_t sequence = 3; sequence <= 6; ++sequence) {
+        encoder.update(makeScan(sequence));
+        message.clear();
+        encoder.encodeDelta(message);
+        CHECK(decoder.decode(message.data(), message.size()) == ScanDeltaDecoder::DECODE_OK);
+        CHECK(decoder.sequence() == sequence);
+        CHECK(decoder.timestampUs() == sequence * 100000);
+        CHECK(sameBins(decoder.bins(), binScan(makeScan(sequence))));
+    }
+
+    // scan 7 is lost, the delta for 8 must be refused and leave the state alone
+    encoder.update(makeScan(7));
+    encoder.update(makeScan(8));
+    message.clear();
+    encoder.encodeDelta(message);
+    CHECK(decoder.decode(message.data(), message.size()) == ScanDeltaDecoder::DECODE_NEED_KEYFRAME);
+    CHECK(decoder.sequence() == 6);
+    CHECK(sameBins(decoder.bins(), binScan(makeScan(6))));
+
+    // RESYNC: a keyframe for 9, after which deltas apply again
+    encoder.update(makeScan(9));
+    message.clear();
+    encoder.encodeKeyframe(message);
+    CHECK(decoder.decode(message.data(), message.size()) == ScanDeltaDecoder::DECODE_OK);
+    CHECK(decoder.sequence() == 9);
+    CHECK(sameBins(decoder.bins(), binScan(makeScan(9))));
+
+    encoder.update(makeScan(10));
+    message.clear();
+    encoder.encodeDelta(message);
+    CHECK(decoder.decode(message.data(), message.size()) == ScanDeltaDecoder::DECODE_OK);
+    CHECK(sameBins(decoder.bins(), binScan(makeScan(10))));
+
+    // truncated and corrupted messages are rejected without touching the state
+    CHECK(decoder.decode(message.data(), message.size() - 1) == ScanDeltaDecoder::DECODE_MALFORMED);
+    std::string corrupt = message;
+    corrupt[0] ^= 0x55;
+    CHECK(decoder.decode(corrupt.data(), corrupt.size()) == ScanDeltaDecoder::DECODE_MALFORMED);
+    CHECK(decoder.sequence() == 10);
+}
+
+// Split a message into datagrams the way MulticastPublisher does.
+static std::vector<std::string> fragmentMessage(const std::string& message, uint64_t scanSequence,
+                                                uint32_t& datagramSequence, uint32_t session = 1) {
+    size_t fragmentCount = (message.size() + MAX_SCAN_FRAGMENT_BYTES - 1) / MAX_SCAN_FRAGMENT_BYTES;
+    if (fragmentCount == 0) fragmentCount = 1;
+
+    std::vector<std::string> datagrams;
+    for (size_t i = 0; i < fragmentCount; ++i) {
+        size_t offset = i * MAX_SCAN_FRAGMENT_BYTES;
+        size_t bytes = std::min(MAX_SCAN_FRAGMENT_BYTES, message.size() - offset);
+
+        ScanDatagramHeader header;
+        header.magic = SCAN_DATAGRAM_MAGIC;
+        header.version = SCAN_DATAGRAM_VERSION;
+        header.reserved = 0;
+        header.fragmentIndex = (uint16_t)i;
+        header.fragmentCount = (uint16_t)fragmentCount;
+        header.fragmentBytes = (uint16_t)bytes;
+        header.datagramSequence = datagramSequence++;
+        header.scanSequence = scanSequence;
+        header.messageBytes = (uint32_t)message.size();
+        header.fragmentOffset = (uint32_t)offset;
+        header.session = session;
+
+        std::string datagram(sizeof(ScanDatagramHeader), '\0');
+        encodeScanDatagramHeader(header, &datagram[0]);
+        datagram.append(message, offset, bytes);
+        datagrams.push_back(datagram);
+    }
+    return datagrams;
+}
+
+static std::string makeMessage(size_t bytes, int seed) {
+    std::string message(bytes, '\0');
+    for (size_t i = 0; i < bytes; ++i) message[i] = (char)((i * 31 + seed) & 0xFF);
+    return message;
+}
+
+static ScanDatagramReassembler::Result pushDatagram(ScanDatagramReassembler& reassembler, const std::string& datagram) {
+    return reassembler.push(datagram.data(), datagram.size());
+}
+
+static void checkDatagramReassembly() {
+    ScanDatagramReassembler reassembler;
+    uint32_t datagramSequence = 0;
+
+    // out of order with a duplicate
+    std::string first = makeMessage(5000, 1);
+    std::vector<std::string> datagrams = fragmentMessage(first, 1, datagramSequence);
+    CHECK(datagrams.size() == 4);
+    CHECK(pushDatagram(reassembler, datagrams[2]) == ScanDatagramReassembler::DATAGRAM_PENDING);
+    CHECK(pushDatagram(reassembler, datagrams[0]) == ScanDatagramReassembler::DATAGRAM_PENDING);
+    CHECK(pushDatagram(reassembler, datagrams[2]) == ScanDatagramReassembler::DATAGRAM_IGNORED);
+    CHECK(pushDatagram(reassembler, datagrams[3]) == ScanDatagramReassembler::DATAGRAM_PENDING);
+    CHECK(pushDatagram(reassembler, datagrams[1]) == ScanDatagramReassembler::DATAGRAM_SCAN_COMPLETE);
+    CHECK(reassembler.message() == first);
+    CHECK(reassembler.scanSequence() == 1);
+
+    // scan 2 loses two of its three fragments and is abandoned when scan 3 starts
+    std::vector<std::string> second = fragmentMessage(makeMessage(3000, 2), 2, datagramSequence);
+    CHECK(second.size() == 3);
+    CHECK(pushDatagram(reassembler, second[0]) == ScanDatagramReassembler::DATAGRAM_PENDING);
+
+    std::string third = makeMessage(100, 3);
+    std::vector<std::string> thirdDatagrams = fragmentMessage(third, 3, datagramSequence);
+    CHECK(thirdDatagrams.size() == 1);
+    CHECK(pushDatagram(reassembler, thirdDatagrams[0]) == ScanDatagramReassembler::DATAGRAM_SCAN_COMPLETE);
+    CHECK(reassembler.message() == third);
+
+    // the late fragment belongs to an abandoned scan
+    CHECK(pushDatagram(reassembler, second[1]) == ScanDatagramReassembler::DATAGRAM_IGNORED);
+
+    CHECK(reassembler.scansCompleted() == 2);
+    CHECK(reassembler.scansIncomplete() == 1);
+    CHECK(reassembler.datagramsLost() == 2);
+
+    std::string truncated = thirdDatagrams[0].substr(0, thirdDatagrams[0].size() - 1);
+    CHECK(pushDatagram(reassembler, truncated) == ScanDatagramReassembler::DATAGRAM_INVALID);
+
+    // the server restarts: a new session numbers scans and datagrams from the start
+    uint32_t restartedSequence = 0;
+    std::string restarted = makeMessage(2000, 4);
+    std::vector<std::string> restartedDatagrams = fragmentMessage(restarted, 1, restartedSequence, 2);
+    CHECK(restartedDatagrams.size() == 2);
+    CHECK(pushDatagram(reassembler, restartedDatagrams[0]) == ScanDatagramReassembler::DATAGRAM_PENDING);
+    CHECK(pushDatagram(reassembler, restartedDatagrams[1]) == ScanDatagramReassembler::DATAGRAM_SCAN_COMPLETE);
+    CHECK(reassembler.message() == restarted);
+    CHECK(reassembler.scanSequence() == 1);
+    CHECK(reassembler.publisherRestarts() == 1);
+    CHECK(reassembler.datagramsLost() == 2);
+
+    // loss is tracked again in the new session
+    fragmentMessage(makeMessage(100, 5), 2, restartedSequence, 2);
+    std::string afterLoss = makeMessage(100, 6);
+    CHECK(pushDatagram(reassembler, fragmentMessage(afterLoss, 3, restartedSequence, 2)[0])
+          == ScanDatagramReassembler::DATAGRAM_SCAN_COMPLETE);
+    CHECK(reassembler.message() == afterLoss);
+    CHECK(reassembler.datagramsLost() == 3);
+}
+
+// Copy text into the ring's free space like readv() would.
+static size_t fillRing(InputRing& ring, const std::string& text, int& regionCount) {
+    iovec regions[2];
+    regionCount = ring.writableRegions(regions);
+    size_t copied = 0;
+    for (int i = 0; i < regionCount && copied < text.size(); ++i) {
+        size_t bytes = std::min(regions[i].iov_len, text.size() - copied);
+        memcpy(regions[i].iov_base, text.data() + copied, bytes);
+        copied += bytes;
+    }
+    ring.commit(copied);
+    return copied;
+}
+
+static void checkInputRingWrap() {
+    InputRing ring(12);
+    CHECK(ring.capacity() == 16);
+
+    int regionCount;
+    CHECK(fillRing(ring, "HELLO\nSTA", regionCount) == 9);
+    CHECK(regionCount == 1);
+    CHECK(ring.find('\n', 0) == 5);
+    ring.consume(6);
+
+    // "STA" is left at offset 6, the rest of the command wraps past the end
+    CHECK(fillRing(ring, "RT_SCAN\nGET", regionCount) == 11);
+    CHECK(regionCount == 2);
+    CHECK(ring.size() == 14);
+
+    size_t newline = ring.find('\n', 0);
+    CHECK(newline == 10);
+    std::string command;
+    ring.copyTo(0, newline, command);
+    CHECK(command == "START_SCAN");
+    CHECK(ring.at(3) == 'R' && ring.at(9) == 'N');
+    ring.consume(newline + 1);
+
+    CHECK(ring.find('\n', 0) == InputRing::npos);
+    CHECK(fillRing(ring, "_SAMPLE\n", regionCount) == 8);
+    newline = ring.find('\n', 0);
+    CHECK(newline == 10);
+    command.clear();
+    ring.copyTo(0, newline, command);
+    CHECK(command == "GET_SAMPLE");
+    ring.consume(newline + 1);
+    CHECK(ring.empty());
+
+    // a full ring offers no space
+    CHECK(fillRing(ring, std::string(20, 'x'), regionCount) == 16);
+    iovec regions[2];
+    CHECK(ring.writableRegions(regions) == 0);
+}
+
+static ScanFrame makeSmallScan(uint64_t sequence, size_t nodes) {
+    ScanFrame frame = makeScan(sequence);
+    frame.nodes.resize(nodes);
+    return frame;
+}
+
+static void checkShmRestart() {
+    std::string name = "/wire_format_check_" + std::to_string(getpid());
+    Logger::instance().setLevel(LOG_LEVEL_WARN);
+    ScanFrame out;
+
+    ScanShmPublisher* first = new ScanShmPublisher();
+    CHECK(first->open(name, 4, 64));
+    for (uint64_t sequence = 1; sequence <= 3; ++sequence) first->publish(makeSmallScan(sequence, 64));
+
+    ScanShmReader reader;
+    CHECK(reader.open(name));
+    CHECK(reader.readNext(out) == ScanShmReader::READ_OK && out.sequence == 3);
+    CHECK(reader.readNext(out) == ScanShmReader::READ_NONE);
+
+    // a clean restart, into a ring of another geometry
+    first->close();
+    delete first;
+    CHECK(reader.readNext(out) == ScanShmReader::READ_CLOSED);
+    ScanShmPublisher* second = new ScanShmPublisher();
+    CHECK(second->open(name, 8, 256));
+    CHECK(reader.readNext(out) == ScanShmReader::READ_NONE);
+    second->publish(makeSmallScan(1, 200));
+    CHECK(reader.readNext(out) == ScanShmReader::READ_RESET && out.sequence == 1 && out.nodes.size() == 200);
+    second->publish(makeSmallScan(2, 200));
+    CHECK(reader.readNext(out) == ScanShmReader::READ_OK && out.sequence == 2);
+
+    // the second publisher dies without closing (so it is never deleted) and a
+    // smaller ring takes over the name
+    ScanShmPublisher third;
+    CHECK(third.open(name, 2, 16));
+    third.publish(makeSmallScan(1, 16));
+    CHECK(reader.readNext(out) == ScanShmReader::READ_RESET && out.sequence == 1 && out.nodes.size() == 16);
+    CHECK(reader.readLatest(out) == ScanShmReader::READ_OK && out.sequence == 1);
+    third.close();
+}
+
+int main() {
+    checkDeltaCodec();
+    checkDatagramReassembly();
+    checkInputRingWrap();
+    checkShmRestart();
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all wire format checks passed\n");
+    return 0;
+}
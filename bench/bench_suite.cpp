@@ -0,0 +1,152 @@
+#include "bench_suite.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <json.hpp>
+#include "sl_lidar.h"
+
+static const int DEFAULT_REPETITIONS = 5;
+static const int DEFAULT_MIN_TIME_MS = 200;
+
+BenchSuite::BenchSuite()
+    : repetitions(DEFAULT_REPETITIONS), minTimeMs(DEFAULT_MIN_TIME_MS) {}
+
+void BenchSuite::add(const std::string& name, Body body) {
+    Entry entry;
+    entry.name = name;
+    entry.body = body;
+    entries.push_back(entry);
+}
+
+void BenchSuite::setFilter(const std::string& value) {
+    filter = value;
+}
+
+void BenchSuite::setRepetitions(int value) {
+    repetitions = value > 0 ? value : DEFAULT_REPETITIONS;
+}
+
+void BenchSuite::setMinTimeMs(int ms) {
+    minTimeMs = ms > 0 ? ms : DEFAULT_MIN_TIME_MS;
+}
+
+const std::vector<BenchResult>& BenchSuite::run() {
+    results.clear();
+    printf("%-32s %12s %12s %12s %10s\n", "benchmark", "nodes/call", "ns/node", "min ns/node", "MB/s");
+    for (const Entry& entry : entries) {
+        if (entry.name.find(filter) == std::string::npos) continue;
+
+        BenchResult result = measure(entry);
+        printf("%-32s %12llu %12.2f %12.2f %10.1f\n", result.name.c_str(),
+               (unsigned long long)result.workPerCall.nodes, result.nsPerNode, result.nsPerNodeMin, result.mbPerSecond);
+        fflush(stdout);
+        results.push_back(result);
+    }
+    return results;
+}
+
+BenchResult BenchSuite::measure(const Entry& entry) {
+    typedef std::chrono::steady_clock Clock;
+
+    // the first call pays for cold caches and lazy allocations
+    BenchWork work = entry.body();
+
+    BenchResult result;
+    result.name = entry.name;
+    result.calls = 0;
+    result.workPerCall = work;
+
+    std::vector<double> nsPerNode;
+    for (int r = 0; r < repetitions; ++r) {
+        uint64_t nodes = 0;
+        Clock::time_point begin = Clock::now();
+        Clock::time_point end;
+        do {
+            nodes += entry.body().nodes;
+            ++result.calls;
+            end = Clock::now();
+        } while (end - begin < std::chrono::milliseconds(minTimeMs));
+
+        double ns = std::chrono::duration<double, std::nano>(end - begin).count();
+        nsPerNode.push_back(nodes ? ns / nodes : 0);
+    }
+
+    std::sort(nsPerNode.begin(), nsPerNode.end());
+    result.nsPerNode = nsPerNode[nsPerNode.size() / 2];
+    result.nsPerNodeMin = nsPerNode.front();
+    result.nsPerNodeMax = nsPerNode.back();
+
+    double bytesPerNode = work.nodes ? (double)work.bytes / work.nodes : 0;
+    // bytes per ns is GB/s, scaled to MB/s
+    result.mbPerSecond = result.nsPerNode > 0 ? bytesPerNode / result.nsPerNode * 1000.0 : 0;
+    return result;
+}
+
+std::string BenchSuite::toJson() const {
+    char timestamp[32];
+    time_t now = time(nullptr);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    nlohmann::json benchmarks = nlohmann::json::array();
+    for (const BenchResult& result : results) {
+        benchmarks.push_back({
+            {"name", result.name},
+            {"calls", result.calls},
+            {"nodes_per_call", result.workPerCall.nodes},
+            {"bytes_per_call", result.workPerCall.bytes},
+            {"ns_per_node", result.nsPerNode},
+            {"ns_per_node_min", result.nsPerNodeMin},
+            {"ns_per_node_max", result.nsPerNodeMax},
+            {"mb_per_s", result.mbPerSecond}
+        });
+    }
+
+    nlohmann::json document = {
+        {"sdk_version", SL_LIDAR_SDK_VERSION},
+        {"compiler", __VERSION__},
+#ifdef NDEBUG
+        {"build", "release"},
+#else
+        {"build", "debug"},
+#endif
+        {"timestamp", timestamp},
+        {"repetitions", repetitions},
+        {"min_time_ms", minTimeMs},
+        {"benchmarks", benchmarks}
+    };
+    return document.dump(2) + "\n";
+}
+
+int BenchSuite::compare(const std::string& baselineJson, double thresholdPercent) const {
+    nlohmann::json baseline = nlohmann::json::parse(baselineJson, nullptr, false);
+    if (baseline.is_discarded() || !baseline.contains("benchmarks")) {
+        fprintf(stderr, "baseline is not a benchmark result document\n");
+        return -1;
+    }
+
+    std::map<std::string, double> before;
+    for (const nlohmann::json& item : baseline["benchmarks"]) {
+        before[item.value("name", "")] = item.value("ns_per_node", 0.0);
+    }
+
+    printf("\nagainst sdk %s from %s:\n", baseline.value("sdk_version", "?").c_str(),
+           baseline.value("timestamp", "?").c_str());
+    int regressions = 0;
+    for (const BenchResult& result : results) {
+        auto found = before.find(result.name);
+        if (found == before.end() || found->second <= 0) {
+            printf("%-32s %12s\n", result.name.c_str(), "new");
+            continue;
+        }
+
+        // positive is slower
+        double change = (result.nsPerNode - found->second) / found->second * 100.0;
+        bool regressed = change > thresholdPercent;
+        if (regressed) ++regressions;
+        printf("%-32s %12.2f -> %8.2f ns/node %+7.1f%%%s\n", result.name.c_str(), found->second, result.nsPerNode,
+               change, regressed ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
@@ -0,0 +1,66 @@
+#ifndef BENCH_SUITE_H
+#define BENCH_SUITE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// What one call of a benchmark body processed.
+struct BenchWork {
+    BenchWork() : nodes(0), bytes(0) {}
+    BenchWork(uint64_t nodes, uint64_t bytes) : nodes(nodes), bytes(bytes) {}
+
+    uint64_t nodes;
+    uint64_t bytes;
+};
+
+struct BenchResult {
+    std::string name;
+    uint64_t calls;           // body calls over all repetitions
+    BenchWork workPerCall;
+    double nsPerNode;         // median over the repetitions
+    double nsPerNodeMin;
+    double nsPerNodeMax;
+    double mbPerSecond;       // at the median
+};
+
+// Runs named bodies repeatedly and reports time per node and throughput.
+// Each repetition calls a body until it has run for at least minTimeMs, and
+// the median repetition is reported, so one slow pass does not skew a result.
+class BenchSuite {
+public:
+    typedef std::function<BenchWork()> Body;
+
+    BenchSuite();
+
+    void add(const std::string& name, Body body);
+
+    void setFilter(const std::string& filter);
+    void setRepetitions(int repetitions);
+    void setMinTimeMs(int ms);
+
+    // Run every benchmark whose name contains the filter, printing a line each.
+    const std::vector<BenchResult>& run();
+
+    std::string toJson() const;
+    // Print how each result moved against a toJson() document from an earlier
+    // run. Returns the number of benchmarks slower by more than thresholdPercent.
+    int compare(const std::string& baselineJson, double thresholdPercent) const;
+
+private:
+    struct Entry {
+        std::string name;
+        Body body;
+    };
+
+    BenchResult measure(const Entry& entry);
+
+    std::vector<Entry> entries;
+    std::vector<BenchResult> results;
+    std::string filter;
+    int repetitions;
+    int minTimeMs;
+};
+
+#endif // BENCH_SUITE_H
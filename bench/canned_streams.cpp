@@ -0,0 +1,44 @@
+#include "canned_streams.h"
+#include <cmath>
+#include <cstring>
+#include "sl_lidar_cmd.h"
+#include "simulated_scan.h"
+
+CannedStream makeCannedStream(uint8_t ansType, float usPerSample, int rpm, int revolutions) {
+    CannedStream stream;
+    stream.ansType = ansType;
+    stream.usPerSample = usPerSample;
+    stream.headerSize = sizeof(sl_lidar_ans_header_t);
+    stream.packetSize = scanPacketSize(ansType);
+
+    size_t perPacket = scanPacketSamples(ansType);
+    double degPerSample = 360.0 * rpm / 60.0 * usPerSample / 1e6;
+    size_t samplesWanted = (size_t)(360.0 / degPerSample * revolutions);
+    stream.packetCount = (samplesWanted + perPacket - 1) / perPacket;
+    stream.sampleCount = stream.packetCount * perPacket;
+
+    // one extra sample so the last ultra capsule has something to predict from
+    std::vector<SimulatedSample> samples(stream.sampleCount + 1);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        double angle = fmod(i * degPerSample, 360.0);
+        samples[i].angleDeg = angle;
+        samples[i].distMm = simulatedDistanceMm(angle, i * usPerSample / 1e6, 40.0f);
+        samples[i].sync = angle < degPerSample;
+    }
+
+    sl_lidar_ans_header_t header;
+    header.syncByte1 = SL_LIDAR_ANS_SYNC_BYTE1;
+    header.syncByte2 = SL_LIDAR_ANS_SYNC_BYTE2;
+    header.size_q30_subtype = (uint32_t)stream.packetSize | (SL_LIDAR_ANS_PKTFLAG_LOOP << SL_LIDAR_ANS_HEADER_SUBTYPE_SHIFT);
+    header.type = ansType;
+
+    stream.bytes.resize(stream.headerSize + stream.packetCount * stream.packetSize);
+    memcpy(&stream.bytes[0], &header, sizeof(header));
+    for (size_t p = 0; p < stream.packetCount; ++p) {
+        size_t first = p * perPacket;
+        uint64_t timestampUs = (uint64_t)((first + perPacket) * usPerSample);
+        encodeScanPacket(ansType, &samples[first], samples[first + perPacket], p == 0, timestampUs,
+                         &stream.bytes[stream.headerSize + p * stream.packetSize]);
+    }
+    return stream;
+}
@@ -0,0 +1,26 @@
+#ifndef CANNED_STREAMS_H
+#define CANNED_STREAMS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A looping measurement answer as it arrives on the wire: the answer header
+// followed by back-to-back packets, encoded by the simulator's encoders from
+// its synthetic room.
+struct CannedStream {
+    uint8_t ansType;
+    float usPerSample;
+    size_t headerSize;
+    size_t packetSize;
+    size_t packetCount;
+    size_t sampleCount;
+    std::vector<uint8_t> bytes;
+
+    const uint8_t* packet(size_t index) const { return &bytes[headerSize + index * packetSize]; }
+};
+
+// Encodes revolutions full turns at rpm, sampling every usPerSample.
+CannedStream makeCannedStream(uint8_t ansType, float usPerSample, int rpm, int revolutions);
+
+#endif // CANNED_STREAMS_H
@@ -0,0 +1,390 @@
+// Microbenchmarks for the SDK's receive path and the server's serialization,
+// on canned streams of every answer format the simulator produces:
+//
+//   codec.*     RPLidarProtocolCodec::onDecodeData framing the raw stream
+//   unpack.*    the UnpackerHandler_* matching the answer type, per packet
+//   crc32.*     crc32::getResult over HQ capsules
+//   ascend.*    ascendScanData_ on one decoded revolution
+//   holder.*    ScanDataHolder::pushScanNodeData, alone and with a grabber
+//               copying or borrowing the scans, or with a listener
+//   json.*      the GET_SAMPLE reply writeScanJson builds
+//
+//   sdk_bench [--filter <text>] [--repetitions <n>] [--min-time-ms <ms>]
+//             [--json <file>] [--compare <file>] [--threshold <percent>]
+//
+// --json saves the results so a later run, e.g. against another SDK version,
+// can --compare with them; the exit status is 2 when any benchmark got slower
+// by more than --threshold.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sdkcommon.h"
+#include "hal/thread.h"
+#include "hal/locker.h"
+#include "hal/event.h"
+#include "sl_lidar_driver.h"
+#include "sl_crc.h"
+#include "sl_lidarprotocol_codec.h"
+#include "sl_scan_data.h"
+#include "dataunpacker/dataunpacker.h"
+#include "scan_json_writer.h"
+#include "bench_suite.h"
+#include "canned_streams.h"
+
+using namespace sl;
+using namespace sl::internal;
+
+typedef sl_lidar_response_measurement_node_hq_t HqNode;
+
+static const int STREAM_RPM = 600;
+static const int STREAM_REVOLUTIONS = 10;
+// what one serial read typically hands the codec
+static const size_t RX_CHUNK_SIZE = 4096;
+static const size_t SCAN_NODE_CAPACITY = 8192;
+static const double DEFAULT_THRESHOLD_PERCENT = 10.0;
+
+// keeps the crc results alive so the loop is not optimized away
+static volatile sl_u32 crcSink;
+
+struct StreamSpec {
+    const char* name;
+    uint8_t ansType;
+    float usPerSample;
+};
+
+// sample periods of the modes using each format on current devices
+static const StreamSpec STREAMS[] = {
+    { "standard", SL_LIDAR_ANS_TYPE_MEASUREMENT, 125.0f },
+    { "capsule", SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED, 125.0f },
+    { "ultra_capsule", SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA, 62.5f },
+    { "dense_capsule", SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED, 31.25f },
+    { "hq", SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ, 125.0f },
+};
+
+class CountingMessageListener : public IProtocolMessageListener {
+public:
+    CountingMessageListener() : messages(0), payloadBytes(0) {}
+
+    virtual void onProtocolMessageDecoded(const ProtocolMessage& message) {
+        ++messages;
+        payloadBytes += message.getPayloadSize();
+    }
+
+    uint64_t messages;
+    uint64_t payloadBytes;
+};
+
+class CollectingNodeListener : public LIDARSampleDataListener {
+public:
+    CollectingNodeListener() : decoded(0), keep(false) {}
+
+    virtual void onHQNodeScanResetReq() {}
+
+    virtual void onHQNodeDecoded(_u64, const rplidar_response_measurement_node_hq_t* node) {
+        ++decoded;
+        if (keep) nodes.push_back(*node);
+    }
+
+    uint64_t decoded;
+    bool keep;
+    std::vector<HqNode> nodes;
+};
+
+// Owns an unpacker set up the way the driver sets one up for a scan.
+class StreamUnpacker {
+public:
+    StreamUnpacker(const CannedStream& stream) : stream(stream) {
+        unpacker = LIDARSampleDataUnpacker::CreateInstance(listener);
+
+        SlamtecLidarTimingDesc timing;
+        timing.sample_duration_uS = (sl_u32)(stream.usPerSample + 0.5f);
+        timing.native_baudrate = 1000000;
+        timing.linkage_delay_uS = 0;
+        timing.native_interface_type = LIDAR_INTERFACE_UART;
+        timing.native_timestamp_support = false;
+        unpacker->updateUnpackerContext(LIDARSampleDataUnpacker::UNPACKER_CONTEXT_TYPE_LIDAR_TIMING, &timing, sizeof(timing));
+        unpacker->enable();
+    }
+
+    ~StreamUnpacker() {
+        LIDARSampleDataUnpacker::ReleaseInstance(unpacker);
+    }
+
+    // Decodes the whole stream as a fresh scan, returning the nodes produced.
+    uint64_t unpack() {
+        uint64_t before = listener.decoded;
+        unpacker->reset();
+        for (size_t i = 0; i < stream.packetCount; ++i) {
+            unpacker->onSampleData(stream.ansType, stream.packet(i), stream.packetSize);
+        }
+        return listener.decoded - before;
+    }
+
+    CollectingNodeListener listener;
+
+private:
+    const CannedStream& stream;
+    LIDARSampleDataUnpacker* unpacker;
+};
+
+static void fail(const char* what, const char* stream) {
+    fprintf(stderr, "%s: %s\n", stream, what);
+    exit(1);
+}
+
+static void addStreamBenchmarks(BenchSuite& suite, const StreamSpec& spec, const CannedStream& stream) {
+    const std::string name = spec.name;
+
+    // check the canned stream decodes before timing anything on it
+    {
+        CountingMessageListener messages;
+        RPLidarProtocolCodec codec;
+        codec.setMessageListener(&messages);
+        codec.onDecodeData(&stream.bytes[0], stream.bytes.size());
+        if (messages.messages != stream.packetCount) fail("codec did not frame every packet", spec.name);
+
+        StreamUnpacker unpacker(stream);
+        if (unpacker.unpack() < stream.sampleCount / 2) fail("unpacker decoded too few nodes", spec.name);
+    }
+
+    std::shared_ptr<CountingMessageListener> messages = std::make_shared<CountingMessageListener>();
+    std::shared_ptr<RPLidarProtocolCodec> codec = std::make_shared<RPLidarProtocolCodec>();
+    codec->setMessageListener(messages.get());
+    suite.add("codec." + name, [messages, codec, &stream]() {
+        codec->onDecodeReset();
+        for (size_t pos = 0; pos < stream.bytes.size(); pos += RX_CHUNK_SIZE) {
+            codec->onDecodeData(&stream.bytes[pos], std::min(RX_CHUNK_SIZE, stream.bytes.size() - pos));
+        }
+        return BenchWork(stream.sampleCount, stream.bytes.size());
+    });
+
+    std::shared_ptr<StreamUnpacker> unpacker = std::make_shared<StreamUnpacker>(stream);
+    suite.add("unpack." + name, [unpacker, &stream]() {
+        return BenchWork(unpacker->unpack(), stream.packetCount * stream.packetSize);
+    });
+}
+
+// The second revolution of a decoded stream, as grabScanDataHq hands it over.
+static std::vector<HqNode> decodeRevolution(const CannedStream& stream) {
+    StreamUnpacker unpacker(stream);
+    unpacker.listener.keep = true;
+    unpacker.unpack();
+
+    std::vector<HqNode> revolution;
+    int syncs = 0;
+    for (const HqNode& node : unpacker.listener.nodes) {
+        if (node.flag & SL_LIDAR_RESP_HQ_FLAG_SYNCBIT) ++syncs;
+        if (syncs == 2) revolution.push_back(node);
+        if (syncs > 2) break;
+    }
+    return revolution;
+}
+
+static const CannedStream& findStream(const std::vector<CannedStream>& streams, uint8_t ansType) {
+    for (const CannedStream& stream : streams) {
+        if (stream.ansType == ansType) return stream;
+    }
+    return streams.front();
+}
+
+static void addScanBenchmarks(BenchSuite& suite, const std::vector<CannedStream>& streams) {
+    const CannedStream& hqStream = findStream(streams, SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ);
+    const CannedStream& denseStream = findStream(streams, SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED);
+
+    for (size_t i = 0; i < hqStream.packetCount; ++i) {
+        const sl_lidar_response_hq_capsule_measurement_nodes_t* capsule =
+            reinterpret_cast<const sl_lidar_response_hq_capsule_measurement_nodes_t*>(hqStream.packet(i));
+        if (crc32::getResult((sl_u8*)capsule, sizeof(*capsule) - 4) != capsule->crc32) fail("crc mismatch", "hq");
+    }
+
+    suite.add("crc32.hq_capsule", [&hqStream]() {
+        size_t size = hqStream.packetSize - 4;
+        for (size_t i = 0; i < hqStream.packetCount; ++i) {
+            crcSink = crc32::getResult(const_cast<sl_u8*>(hqStream.packet(i)), (sl_u32)size);
+        }
+        return BenchWork(hqStream.packetCount * 96, hqStream.packetCount * size);
+    });
+
+    std::shared_ptr<std::vector<HqNode> > revolution = std::make_shared<std::vector<HqNode> >(decodeRevolution(denseStream));
+    if (revolution->size() < 1000) fail("no full revolution", "dense_capsule");
+
+    // the copy is part of each call, as ascending works in place
+    std::shared_ptr<std::vector<HqNode> > work = std::make_shared<std::vector<HqNode> >();
+    suite.add("ascend.hq_scan", [revolution, work]() {
+        *work = *revolution;
+        ascendScanData_(&(*work)[0], work->size());
+        return BenchWork(work->size(), work->size() * sizeof(HqNode));
+    });
+
+    std::shared_ptr<std::vector<HqNode> > nodes = std::make_shared<std::vector<HqNode> >();
+    {
+        StreamUnpacker unpacker(denseStream);
+        unpacker.listener.keep = true;
+        unpacker.unpack();
+        nodes->swap(unpacker.listener.nodes);
+    }
+
+    std::shared_ptr<ScanDataHolder<HqNode> > holder = std::make_shared<ScanDataHolder<HqNode> >(SCAN_NODE_CAPACITY);
+    suite.add("holder.push", [nodes, holder]() {
+        for (const HqNode& node : *nodes) holder->pushScanNodeData(0, &node);
+        return BenchWork(nodes->size(), nodes->size() * sizeof(HqNode));
+    });
+
+    // a grabber copying every finished scan out, as the acquisition thread does
+    suite.add("holder.push_grabbed", [nodes, holder]() {
+        std::atomic<bool> done(false);
+        std::thread grabber([&]() {
+            std::vector<HqNode> copy(SCAN_NODE_CAPACITY);
+            while (!done) {
+                const std::vector<HqNode>* scan = holder->waitForNewestScan(1);
+                if (scan) std::copy(scan->begin(), scan->end(), copy.begin());
+            }
+        });
+        for (const HqNode& node : *nodes) holder->pushScanNodeData(0, &node);
+        done = true;
+        grabber.join();
+        return BenchWork(nodes->size(), nodes->size() * sizeof(HqNode));
+    });
+
+    // a grabber that never sleeps keeps the newest scan checked out nearly
+    // all the time, the worst case for a decoder that has to wait on it
+    suite.add("holder.push_contended", [nodes, holder]() {
+        std::atomic<bool> done(false);
+        std::thread grabber([&]() {
+            std::vector<HqNode> copy(SCAN_NODE_CAPACITY);
+            while (!done) {
+                const std::vector<HqNode>* scan = holder->waitForNewestScan(0);
+                if (scan) std::copy(scan->begin(), scan->end(), copy.begin());
+            }
+        });
+        for (const HqNode& node : *nodes) holder->pushScanNodeData(0, &node);
+        done = true;
+        grabber.join();
+        return BenchWork(nodes->size(), nodes->size() * sizeof(HqNode));
+    });
+
+    // the grabber taking each scan as it completes, copied out or borrowed
+    suite.add("holder.grab_copy", [nodes, holder]() {
+        std::vector<HqNode> copy(SCAN_NODE_CAPACITY);
+        for (const HqNode& node : *nodes) {
+            holder->pushScanNodeData(0, &node);
+            if (!(node.flag & SL_LIDAR_RESP_HQ_FLAG_SYNCBIT)) continue;
+            const std::vector<HqNode>* scan = holder->waitForNewestScan(0);
+            if (scan) std::copy(scan->begin(), scan->end(), copy.begin());
+        }
+        return BenchWork(nodes->size(), nodes->size() * sizeof(HqNode));
+    });
+
+    suite.add("holder.grab_borrow", [nodes, holder]() {
+        LidarScanPtr scan;
+        for (const HqNode& node : *nodes) {
+            holder->pushScanNodeData(0, &node);
+            if (!(node.flag & SL_LIDAR_RESP_HQ_FLAG_SYNCBIT)) continue;
+            holder->borrowNewestScan(0, scan);
+        }
+        return BenchWork(nodes->size(), nodes->size() * sizeof(HqNode));
+    });
+
+    // the driver's path when a scan listener is registered, holding on to
+    // the latest scan the way a listener queueing it to a worker would
+    suite.add("holder.push_listened", [nodes, holder]() {
+        LidarScanPtr kept;
+        for (const HqNode& node : *nodes) {
+            LidarScanPtr completed;
+            holder->pushScanNodeData(0, &node, 0, &completed);
+            if (completed) kept = completed;
+        }
+        return BenchWork(nodes->size(), nodes->size() * sizeof(HqNode));
+    });
+
+    std::shared_ptr<ScanFrame> frame = std::make_shared<ScanFrame>();
+    frame->sequence = 1;
+    frame->timestampUs = 0;
+    frame->scanMode = 0;
+    frame->nodes = *revolution;
+    ascendScanData_(&frame->nodes[0], frame->nodes.size());
+
+    suite.add("json.get_sample", [frame]() {
+        std::string message;
+        writeScanJson("GET_SAMPLE", *frame, message);
+        return BenchWork(frame->nodes.size(), message.size());
+    });
+}
+
+static bool readFile(const std::string& path, std::string& content) {
+    std::ifstream in(path.c_str());
+    if (!in) return false;
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    content = buffer.str();
+    return true;
+}
+
+static void printUsage(const char* program) {
+    fprintf(stderr, "usage: %s [--filter <text>] [--repetitions <n>] [--min-time-ms <ms>] "
+                    "[--json <file>] [--compare <file>] [--threshold <percent>]\n", program);
+}
+
+int main(int argc, char* argv[]) {
+    BenchSuite suite;
+    std::string jsonPath;
+    std::string comparePath;
+    double threshold = DEFAULT_THRESHOLD_PERCENT;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (arg == "--filter") suite.setFilter(argv[++i]);
+        else if (arg == "--repetitions") suite.setRepetitions(atoi(argv[++i]));
+        else if (arg == "--min-time-ms") suite.setMinTimeMs(atoi(argv[++i]));
+        else if (arg == "--json") jsonPath = argv[++i];
+        else if (arg == "--compare") comparePath = argv[++i];
+        else if (arg == "--threshold") threshold = atof(argv[++i]);
+        else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<CannedStream> streams;
+    for (const StreamSpec& spec : STREAMS) {
+        streams.push_back(makeCannedStream(spec.ansType, spec.usPerSample, STREAM_RPM, STREAM_REVOLUTIONS));
+    }
+    for (size_t i = 0; i < streams.size(); ++i) addStreamBenchmarks(suite, STREAMS[i], streams[i]);
+    addScanBenchmarks(suite, streams);
+
+    suite.run();
+
+    if (!jsonPath.empty()) {
+        std::ofstream out(jsonPath.c_str());
+        out << suite.toJson();
+        if (!out) {
+            fprintf(stderr, "failed to write %s\n", jsonPath.c_str());
+            return 1;
+        }
+    }
+
+    if (!comparePath.empty()) {
+        std::string baseline;
+        if (!readFile(comparePath, baseline)) {
+            fprintf(stderr, "failed to read %s\n", comparePath.c_str());
+            return 1;
+        }
+        int regressions = suite.compare(baseline, threshold);
+        if (regressions < 0) return 1;
+        if (regressions > 0) return 2;
+    }
+    return 0;
+}
@@ -37,6 +37,8 @@
 
 #include <vector>
 #include <map>
+#include <functional>
+#include <memory>
 #include <string>
 
 #ifndef DEPRECATED
@@ -273,6 +275,14 @@ namespace sl {
     */
     Result<IChannel*> createUdpChannel(const std::string& ip, int port);
 
+    /**
+     * Create a channel that plays back a recording made by ILidarDriver::startRecording
+     * \param path  Path of the recording file
+     * \param speed Playback speed, 1 is real time, 2 twice as fast, 0 as fast as possible
+     * \param loop  Start the scan stream over when the recording runs out
+     */
+    Result<IChannel*> createReplayChannel(const std::string& path, float speed = 1.0f, bool loop = false);
+
     enum MotorCtrlSupport
     {
         MotorCtrlSupportNone = 0,
@@ -284,6 +294,7 @@ namespace sl {
         CHANNEL_TYPE_SERIALPORT = 0x0,
         CHANNEL_TYPE_TCP = 0x1,
         CHANNEL_TYPE_UDP = 0x2,
+        CHANNEL_TYPE_REPLAY = 0x3,
     };
 
         /**
@@ -303,6 +314,81 @@ namespace sl {
         sl_u16 min_speed;
     };
 
+    /**
+    * Running totals of a driver instance since it was created
+    *
+    * The counters only grow. The decoding thread updates them with relaxed
+    * atomic increments, so reading them never slows the data path.
+    */
+    struct LidarDriverStats
+    {
+        // Complete revolutions made available to grabScanDataHq
+        sl_u64 scans_completed;
+
+        // HQ nodes produced by the sample decoder
+        sl_u64 nodes_decoded;
+
+        // Nodes that overwrote the last one because the scan buffer was full
+        sl_u64 nodes_dropped;
+
+        // Capsules discarded because their checksum did not match
+        sl_u64 checksum_errors;
+
+        // HQ capsules discarded because their CRC32 did not match
+        sl_u64 crc_errors;
+
+        // Capsule streams that restarted in the middle of a scan
+        sl_u64 encoder_resets;
+    };
+
+    /**
+    * When one scan went through the driver's pipeline
+    *
+    * All values are in microseconds of the same monotonic clock the driver
+    * uses for sample timestamps (CLOCK_MONOTONIC on Linux), so they can be
+    * compared with each other and with the caller's own monotonic clock.
+    */
+    struct LidarScanTiming
+    {
+        // Timestamp of the first sample, as returned by grabScanDataHqWithTimeStamp
+        sl_u64 timestamp_us;
+
+        // The channel reported the bytes holding the scan's first node
+        sl_u64 first_rx_us;
+
+        // The sample decoder produced the scan's first node
+        sl_u64 first_decoded_us;
+
+        // The next scan began and this one became available to grab
+        sl_u64 completed_us;
+    };
+
+    /**
+    * One complete scan lent out by borrowScanDataHq
+    *
+    * The nodes live in the driver's own scan buffer and are never written
+    * while any LidarScanPtr to them exists; the driver recycles the buffer
+    * after the last one is released. Nodes are in the order they were
+    * measured, like grabScanDataHq returns them.
+    */
+    struct LidarScan
+    {
+        const sl_lidar_response_measurement_node_hq_t* nodes;
+        size_t count;
+
+        // Timestamp of the first sample, as returned by grabScanDataHqWithTimeStamp
+        sl_u64 timestamp_us;
+
+        // Counts the scans completed since the driver was created, starting at 1
+        sl_u64 sequence;
+
+        LidarScanTiming timing;
+    };
+
+    typedef std::shared_ptr<const LidarScan> LidarScanPtr;
+
+    typedef std::function<void(const LidarScanPtr& scan)> LidarScanListener;
+
     class ILidarDriver
     {
     public:
@@ -466,6 +552,32 @@ namespace sl {
         /// \The caller application can set the timeout value to Zero(0) to make this interface always returns immediately to achieve non-block operation.
         virtual sl_result grabScanDataHqWithTimeStamp(sl_lidar_response_measurement_node_hq_t* nodebuffer, size_t& count, sl_u64 & timestamp_uS, sl_u32 timeout = DEFAULT_TIMEOUT) = 0;
 
+        /// Same as grabScanDataHqWithTimeStamp, but also tells when the scan passed each stage of the driver
+        ///
+        /// \param timing        The reference used to store the scan's timing
+        virtual sl_result grabScanDataHqWithTiming(sl_lidar_response_measurement_node_hq_t* nodebuffer, size_t& count, LidarScanTiming& timing, sl_u32 timeout = DEFAULT_TIMEOUT) = 0;
+
+        /// Same as grabScanDataHqWithTiming, but hands out the driver's buffer instead of copying it
+        ///
+        /// The scan stays valid and unchanged for as long as the caller keeps the handle, which
+        /// may be passed to other threads. Use ascendScanData on a copy if the nodes need reordering.
+        ///
+        /// \param scan          The reference used to store the scan, reset when the call fails
+        virtual sl_result borrowScanDataHq(LidarScanPtr& scan, sl_u32 timeout = DEFAULT_TIMEOUT) = 0;
+
+        /// Have listener called with every scan as soon as it is complete
+        ///
+        /// Listeners run on the driver's decoding thread, in the order they were registered, and
+        /// receive the same handle borrowScanDataHq would lend out. Decoding waits for them, so a
+        /// listener with real work to do should hand the scan over to its own thread.
+        ///
+        /// \return An id for unregisterScanListener
+        virtual int registerScanListener(LidarScanListener listener) = 0;
+
+        /// Remove a listener. Once this returns the listener is not running and will not be
+        /// called again. Must not be called from inside a listener.
+        virtual void unregisterScanListener(int listenerId) = 0;
+
 
         /// Ascending the scan data according to the angle value in the scan.
         ///
@@ -536,6 +648,23 @@ namespace sl {
         /// \param timeout           The timeout value used by potential data communication
         virtual sl_result getModelNameDescriptionString(std::string& out_description, bool fetchAliasName = true, const sl_lidar_response_device_info_t* devInfo = nullptr, sl_u32 timeout = DEFAULT_TIMEOUT) = 0;
 
+        /// Get a snapshot of the driver's running counters
+        /// It is safe to call from any thread, also while scanning
+        ///
+        /// \param stats     The counters as of this call
+        virtual void getStats(LidarDriverStats& stats) = 0;
+
+        /// Record every byte exchanged with the device to a file, for offline analysis of decoder issues
+        /// The layout is described in sl_lidar_recording.h. Each scan start adds a session record with
+        /// the device info and scan mode; a recording started while scanning begins with the current one.
+        /// Disk writes happen on a thread of their own and never delay the receive path.
+        ///
+        /// \param path     The file to create, an existing one is overwritten
+        virtual sl_result startRecording(const char* path) = 0;
+
+        /// Flush and close the recording started by startRecording
+        virtual void stopRecording() = 0;
+
 };
 
     /**
@@ -0,0 +1,133 @@
+/*
+* Slamtec LIDAR SDK
+*
+* sl_lidar_recording.h
+*
+* Copyright (c) 2020 Shanghai Slamtec Co., Ltd.
+*/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#include "sl_lidar_cmd.h"
+
+/*
+* Layout of a channel recording, as written by ILidarDriver::startRecording
+*
+* The file is a sl_lidar_recording_file_header_t followed by records, each a
+* sl_lidar_record_header_t and its payload. Records are only ever appended,
+* so a recording cut short by a crash is still readable up to the last
+* complete record. All fields are little-endian.
+*
+* An INDEX record is written every SL_LIDAR_RECORDING_INDEX_INTERVAL bytes.
+* It lists where the records since the previous index start, at most one
+* per SL_LIDAR_RECORDING_INDEX_STRIDE bytes and never more than
+* SL_LIDAR_RECORDING_INDEX_MAX_ENTRIES, and points back at that index. A recording closed normally ends with an END record holding
+* the offset of the last index, so a reader can walk the chain from the tail.
+*/
+
+#define SL_LIDAR_RECORDING_MAGIC            0x43524C53  // "SLRC"
+#define SL_LIDAR_RECORDING_VERSION          1
+#define SL_LIDAR_RECORD_SYNC                0xA55A
+
+#define SL_LIDAR_RECORDING_INDEX_INTERVAL   (256 * 1024)
+#define SL_LIDAR_RECORDING_INDEX_STRIDE     (16 * 1024)
+#define SL_LIDAR_RECORDING_INDEX_MAX_ENTRIES (SL_LIDAR_RECORDING_INDEX_INTERVAL / SL_LIDAR_RECORDING_INDEX_STRIDE + 2)
+
+// Bytes read from the channel, as one chunk
+#define SL_LIDAR_RECORD_TYPE_RX             0x01
+// Bytes written to the channel
+#define SL_LIDAR_RECORD_TYPE_TX             0x02
+// sl_lidar_record_session_t, written whenever a scan starts
+#define SL_LIDAR_RECORD_TYPE_SESSION        0x03
+// sl_lidar_record_index_t followed by its entries
+#define SL_LIDAR_RECORD_TYPE_INDEX          0x04
+// sl_lidar_record_gap_t, chunks lost because the writer fell behind
+#define SL_LIDAR_RECORD_TYPE_GAP            0x05
+// sl_lidar_record_end_t, the last record of a closed recording
+#define SL_LIDAR_RECORD_TYPE_END            0x06
+
+#if defined(_WIN32)
+#pragma pack(1)
+#endif
+
+typedef struct _sl_lidar_recording_file_header_t
+{
+    sl_u32  magic;
+    sl_u16  version;
+    sl_u16  header_size;
+    // getus() when the recording started
+    sl_u64  start_timestamp_us;
+} __attribute__((packed)) sl_lidar_recording_file_header_t;
+
+typedef struct _sl_lidar_record_header_t
+{
+    sl_u16  sync;
+    sl_u8   type;
+    sl_u8   reserved;
+    sl_u32  payload_size;
+    // getus() when the chunk arrived or was sent
+    sl_u64  timestamp_us;
+} __attribute__((packed)) sl_lidar_record_header_t;
+
+typedef struct _sl_lidar_record_session_t
+{
+    sl_lidar_response_device_info_t device_info;
+    sl_u16  scan_mode_id;
+    sl_u8   ans_type;
+    float   us_per_sample;
+    float   max_distance;
+    char    scan_mode_name[64];
+} __attribute__((packed)) sl_lidar_record_session_t;
+
+typedef struct _sl_lidar_record_index_entry_t
+{
+    sl_u64  timestamp_us;
+    sl_u64  file_offset;
+} __attribute__((packed)) sl_lidar_record_index_entry_t;
+
+typedef struct _sl_lidar_record_index_t
+{
+    // 0 for the first index of the file
+    sl_u64  previous_index_offset;
+    sl_u32  entry_count;
+} __attribute__((packed)) sl_lidar_record_index_t;
+
+typedef struct _sl_lidar_record_gap_t
+{
+    sl_u32  dropped_records;
+    sl_u64  dropped_bytes;
+} __attribute__((packed)) sl_lidar_record_gap_t;
+
+typedef struct _sl_lidar_record_end_t
+{
+    sl_u64  last_index_offset;
+} __attribute__((packed)) sl_lidar_record_end_t;
+
+#if defined(_WIN32)
+#pragma pack()
+#endif
@@ -181,6 +181,7 @@ AsyncTransceiver::AsyncTransceiver(IAsyncProtocolCodec& codec)
 	, _codec(codec)
 	, _isWorking(false)
     , _workingFlag(0)
+    , _decodingRxTimestamp_uS(0)
 {
 
 }
@@ -288,6 +289,7 @@ u_result AsyncTransceiver::sendMessage(message_autoptr_t& msg)
         int txSize = _bindedChannel->write(txBuffer, requiredBufferSize);
 
         if (txSize < 0) ans = RESULT_OPERATION_FAIL;
+        else _recorder.append(SL_LIDAR_RECORD_TYPE_TX, getus(), txBuffer, txSize);
 
     } while (0);
 
@@ -330,6 +332,8 @@ sl_result AsyncTransceiver::_proc_rxThread()
 
         Buffer* decodeBuffer = new Buffer();
         
+        // taken before the read so it marks the first byte of the batch
+        decodeBuffer->rx_timestamp_us = getus();
         decodeBuffer->data = new _u8[hintedSize];
 
         decodeBuffer->size = _bindedChannel->read(decodeBuffer->data, hintedSize);
@@ -358,6 +362,9 @@ sl_result AsyncTransceiver::_proc_rxThread()
         printf("\n=== END ===\n");
 #endif
 
+        // copies into the recorder's ring, the disk write happens elsewhere
+        _recorder.append(SL_LIDAR_RECORD_TYPE_RX, decodeBuffer->rx_timestamp_us, decodeBuffer->data, decodeBuffer->size);
+
         _rxLocker.lock();
         _rxQueue.push_back(decodeBuffer);
         _dataEvt.set();
@@ -398,6 +405,7 @@ sl_result AsyncTransceiver::_proc_decoderThread()
         _rxLocker.unlock();
 
         //cout<<"decoding "<< bufferToDecode->size <<" bytes of data"<<endl;
+        _decodingRxTimestamp_uS = bufferToDecode->rx_timestamp_us;
         _codec.onDecodeData(bufferToDecode->data, bufferToDecode->size);
 
 
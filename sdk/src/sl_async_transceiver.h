@@ -34,6 +34,7 @@
 
 #include <list>
 #include <memory>
+#include "sl_channel_recorder.h"
 
 namespace sl { namespace internal {
 
@@ -121,6 +122,16 @@ public:
 	IChannel* getBindedChannel() const {
 		return _bindedChannel;
 	}
+
+	// taps every chunk read from and written to the channel
+	ChannelRecorder& getRecorder() {
+		return _recorder;
+	}
+
+	// when the buffer being decoded arrived; only meaningful on the decoder thread
+	_u64 getDecodingRxTimestamp_uS() const {
+		return _decodingRxTimestamp_uS;
+	}
 	
 	u_result sendMessage(message_autoptr_t& msg);
 
@@ -146,12 +157,16 @@ protected:
 	rp::hal::Thread _rxThread;
 	rp::hal::Thread _decoderThread;
 
+	_u64 _decodingRxTimestamp_uS;
+	ChannelRecorder _recorder;
+
 	struct Buffer {
 		size_t size;
 		_u8* data;
+		_u64 rx_timestamp_us;
 
 
-		Buffer() : size(0), data(NULL){}
+		Buffer() : size(0), data(NULL), rx_timestamp_us(0){}
 
 		~Buffer() {
 			if (data) {
@@ -0,0 +1,279 @@
+/*
+ *  Slamtec LIDAR SDK
+ *
+ *  Copyright (c) 2014 - 2023 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+ /*
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  *
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  */
+
+#include "sdkcommon.h"
+#include "hal/thread.h"
+#include "hal/types.h"
+#include "hal/locker.h"
+#include "hal/event.h"
+
+#include "sl_channel_recorder.h"
+
+#include <string.h>
+#include <algorithm>
+
+
+namespace sl { namespace internal {
+
+ChannelRecorder::ChannelRecorder()
+    : _file(NULL)
+    , _isOpen(false)
+    , _isStopping(false)
+    , _produced(0)
+    , _consumed(0)
+    , _fileOffset(0)
+    , _lastIndexOffset(0)
+    , _nextIndexOffset(0)
+    , _nextEntryOffset(0)
+    , _entryStride(SL_LIDAR_RECORDING_INDEX_STRIDE)
+    , _droppedRecords(0)
+    , _droppedBytes(0)
+{
+}
+
+ChannelRecorder::~ChannelRecorder()
+{
+    close();
+}
+
+u_result ChannelRecorder::open(const char* path, size_t bufferSize)
+{
+    rp::hal::AutoLocker l(_locker);
+    if (_isOpen) return RESULT_ALREADY_DONE;
+
+    _file = fopen(path, "wb");
+    if (!_file) return RESULT_OPERATION_FAIL;
+
+    sl_lidar_recording_file_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SL_LIDAR_RECORDING_MAGIC;
+    header.version = SL_LIDAR_RECORDING_VERSION;
+    header.header_size = sizeof(header);
+    header.start_timestamp_us = getus();
+    if (fwrite(&header, sizeof(header), 1, _file) != 1) {
+        fclose(_file);
+        _file = NULL;
+        return RESULT_OPERATION_FAIL;
+    }
+
+    // all allocation happens here, never on the rx path
+    _ring.assign(bufferSize, 0);
+    _indexEntries.clear();
+    _indexEntries.reserve(SL_LIDAR_RECORDING_INDEX_MAX_ENTRIES);
+    _produced = _consumed = 0;
+    _fileOffset = sizeof(header);
+    _lastIndexOffset = 0;
+    _nextIndexOffset = _fileOffset + SL_LIDAR_RECORDING_INDEX_INTERVAL;
+    _nextEntryOffset = _fileOffset;
+    _entryStride = SL_LIDAR_RECORDING_INDEX_STRIDE;
+    _droppedRecords = 0;
+    _droppedBytes = 0;
+
+    _isStopping = false;
+    _isOpen = true;
+    _writerThread = CLASS_THREAD(ChannelRecorder, _proc_writerThread);
+    return RESULT_OK;
+}
+
+void ChannelRecorder::close()
+{
+    {
+        rp::hal::AutoLocker l(_locker);
+        if (!_isOpen) return;
+        // no more appends; the writer adds the closing records once it has
+        // drained the ring, so they always fit
+        _isOpen = false;
+        _isStopping = true;
+    }
+    _dataEvt.set();
+    _writerThread.join();
+
+    fclose(_file);
+    _file = NULL;
+    _ring.clear();
+    _ring.shrink_to_fit();
+}
+
+void ChannelRecorder::append(_u8 type, _u64 timestamp_us, const void* payload, size_t size)
+{
+    // unlocked peek, recording is off almost all the time
+    if (!_isOpen) return;
+
+    {
+        rp::hal::AutoLocker l(_locker);
+        if (!_isOpen) return;
+
+        _pushGapLocked(timestamp_us);
+        if (_droppedRecords || !_pushLocked(type, timestamp_us, payload, size)) {
+            ++_droppedRecords;
+            _droppedBytes += size;
+            return;
+        }
+
+        if (_fileOffset >= _nextIndexOffset) _pushIndexLocked(timestamp_us);
+    }
+    _dataEvt.set();
+}
+
+bool ChannelRecorder::_pushLocked(_u8 type, _u64 timestamp_us, const void* payload, size_t size,
+                                  const void* extra, size_t extraSize)
+{
+    size_t total = sizeof(sl_lidar_record_header_t) + size + extraSize;
+    if (total > _ring.size() - (size_t)(_produced - _consumed)) return false;
+
+    // the index points at the first record past every stride boundary
+    if (type != SL_LIDAR_RECORD_TYPE_INDEX && _fileOffset >= _nextEntryOffset) {
+        sl_lidar_record_index_entry_t entry;
+        entry.timestamp_us = timestamp_us;
+        entry.file_offset = _fileOffset;
+        if (_indexEntries.size() == SL_LIDAR_RECORDING_INDEX_MAX_ENTRIES) _thinIndexEntriesLocked();
+        _indexEntries.push_back(entry);
+        _nextEntryOffset = _fileOffset + _entryStride;
+    }
+
+    sl_lidar_record_header_t header;
+    header.sync = SL_LIDAR_RECORD_SYNC;
+    header.type = type;
+    header.reserved = 0;
+    header.payload_size = (_u32)(size + extraSize);
+    header.timestamp_us = timestamp_us;
+
+    _copyInLocked(&header, sizeof(header));
+    _copyInLocked(payload, size);
+    _copyInLocked(extra, extraSize);
+    _fileOffset += total;
+    return true;
+}
+
+void ChannelRecorder::_copyInLocked(const void* data, size_t size)
+{
+    const _u8* src = (const _u8*)data;
+    while (size) {
+        size_t pos = (size_t)(_produced % _ring.size());
+        size_t chunk = std::min(size, _ring.size() - pos);
+        memcpy(&_ring[pos], src, chunk);
+        src += chunk;
+        size -= chunk;
+        _produced += chunk;
+    }
+}
+
+void ChannelRecorder::_pushGapLocked(_u64 timestamp_us)
+{
+    if (!_droppedRecords) return;
+
+    sl_lidar_record_gap_t gap;
+    gap.dropped_records = _droppedRecords;
+    gap.dropped_bytes = _droppedBytes;
+    if (_pushLocked(SL_LIDAR_RECORD_TYPE_GAP, timestamp_us, &gap, sizeof(gap))) {
+        _droppedRecords = 0;
+        _droppedBytes = 0;
+    }
+}
+
+bool ChannelRecorder::_pushIndexLocked(_u64 timestamp_us)
+{
+    _u64 indexOffset = _fileOffset;
+
+    sl_lidar_record_index_t index;
+    index.previous_index_offset = _lastIndexOffset;
+    index.entry_count = (_u32)_indexEntries.size();
+    bool pushed = _pushLocked(SL_LIDAR_RECORD_TYPE_INDEX, timestamp_us, &index, sizeof(index),
+                              _indexEntries.empty() ? NULL : &_indexEntries[0],
+                              _indexEntries.size() * sizeof(sl_lidar_record_index_entry_t));
+    // on failure the entries carry over to the next attempt
+    if (!pushed) return false;
+
+    _lastIndexOffset = indexOffset;
+    _indexEntries.clear();
+    _entryStride = SL_LIDAR_RECORDING_INDEX_STRIDE;
+    _nextIndexOffset = _fileOffset + SL_LIDAR_RECORDING_INDEX_INTERVAL;
+    return true;
+}
+
+// An index that keeps failing to fit in the ring would otherwise grow its
+// entries past what open() reserved. Keep every other one instead, so the
+// entries still span everything since the last index, just more coarsely.
+void ChannelRecorder::_thinIndexEntriesLocked()
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < _indexEntries.size(); i += 2) {
+        _indexEntries[kept++] = _indexEntries[i];
+    }
+    _indexEntries.resize(kept);
+    _entryStride *= 2;
+}
+
+sl_result ChannelRecorder::_proc_writerThread()
+{
+    bool finished = false;
+    while (true) {
+        _locker.lock();
+        _u64 produced = _produced;
+        _u64 consumed = _consumed;
+        bool stopping = _isStopping;
+        if (stopping && !finished && produced == consumed) {
+            _u64 now = getus();
+            _pushGapLocked(now);
+            _pushIndexLocked(now);
+            sl_lidar_record_end_t end;
+            end.last_index_offset = _lastIndexOffset;
+            _pushLocked(SL_LIDAR_RECORD_TYPE_END, now, &end, sizeof(end));
+            finished = true;
+            produced = _produced;
+        }
+        _locker.unlock();
+
+        if (produced == consumed) {
+            if (stopping) break;
+            _dataEvt.wait(100);
+            continue;
+        }
+
+        // producers never touch bytes that are not consumed yet, so these
+        // are stable without the lock
+        size_t pos = (size_t)(consumed % _ring.size());
+        size_t chunk = std::min((size_t)(produced - consumed), _ring.size() - pos);
+        size_t written = fwrite(&_ring[pos], 1, chunk, _file);
+        if (written == chunk) fflush(_file);
+
+        _locker.lock();
+        // a failing disk must not wedge the producers, the bytes are lost
+        _consumed += chunk;
+        _locker.unlock();
+    }
+
+    fflush(_file);
+    return RESULT_OK;
+}
+
+}}
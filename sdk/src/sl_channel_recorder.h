@@ -0,0 +1,103 @@
+/*
+ *  Slamtec LIDAR SDK
+ *
+ *  Copyright (c) 2014 - 2023 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+ /*
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  *
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  */
+
+#pragma once
+
+#include "sl_lidar_recording.h"
+#include <stdio.h>
+#include <vector>
+
+namespace sl { namespace internal {
+
+// Appends everything that crosses a channel to a recording file (see
+// sl_lidar_recording.h for the layout).
+//
+// Records are copied into a ring preallocated at open() and written out by
+// a thread of its own, so the rx thread never waits on the disk. When the
+// writer falls behind, records are dropped and a GAP record says how many.
+class ChannelRecorder {
+public:
+    enum {
+        DEFAULT_BUFFER_SIZE = 4 * 1024 * 1024,
+    };
+
+    ChannelRecorder();
+    ~ChannelRecorder();
+
+    u_result open(const char* path, size_t bufferSize = DEFAULT_BUFFER_SIZE);
+    // flushes what is buffered, then ends the file with an index and END record
+    void close();
+
+    bool isOpen() const {
+        return _isOpen;
+    }
+
+    // safe from any thread; returns at once if no recording is open
+    void append(_u8 type, _u64 timestamp_us, const void* payload, size_t size);
+
+protected:
+    bool _pushLocked(_u8 type, _u64 timestamp_us, const void* payload, size_t size,
+                     const void* extra = NULL, size_t extraSize = 0);
+    void _copyInLocked(const void* data, size_t size);
+    void _pushGapLocked(_u64 timestamp_us);
+    bool _pushIndexLocked(_u64 timestamp_us);
+    void _thinIndexEntriesLocked();
+
+    sl_result _proc_writerThread();
+
+protected:
+    rp::hal::Locker _locker;
+    rp::hal::Event  _dataEvt;
+    rp::hal::Thread _writerThread;
+
+    FILE* _file;
+    volatile bool _isOpen;
+    bool _isStopping;
+
+    std::vector<_u8> _ring;
+    // running totals, the ring positions are these modulo its size
+    _u64 _produced;
+    _u64 _consumed;
+
+    _u64 _fileOffset;
+    _u64 _lastIndexOffset;
+    _u64 _nextIndexOffset;
+    _u64 _nextEntryOffset;
+    // doubles each time the pending entries are thinned out to fit
+    _u64 _entryStride;
+    std::vector<sl_lidar_record_index_entry_t> _indexEntries;
+
+    _u32 _droppedRecords;
+    _u64 _droppedBytes;
+};
+
+}}
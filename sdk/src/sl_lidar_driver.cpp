@@ -50,6 +50,7 @@
 #include "dataunpacker/dataunpacker.h"
 #include "sl_async_transceiver.h"
 #include "sl_lidarprotocol_codec.h"
+#include "sl_scan_data.h"
 
 
 
@@ -87,289 +88,6 @@ namespace sl {
         to.distance_q2 = from.dist_mm_q2 > sl_u16(-1) ? sl_u16(0) : sl_u16(from.dist_mm_q2);
     }
 
-
-    static inline float getAngle(const sl_lidar_response_measurement_node_t& node)
-    {
-        return (node.angle_q6_checkbit >> SL_LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT) / 64.f;
-    }
-
-    static inline void setAngle(sl_lidar_response_measurement_node_t& node, float v)
-    {
-        sl_u16 checkbit = node.angle_q6_checkbit & SL_LIDAR_RESP_MEASUREMENT_CHECKBIT;
-        node.angle_q6_checkbit = (((sl_u16)(v * 64.0f)) << SL_LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT) | checkbit;
-    }
-
-    static inline float getAngle(const sl_lidar_response_measurement_node_hq_t& node)
-    {
-        return node.angle_z_q14 * 90.f / 16384.f;
-    }
-
-    static inline void setAngle(sl_lidar_response_measurement_node_hq_t& node, float v)
-    {
-        node.angle_z_q14 = sl_u32(v * 16384.f / 90.f);
-    }
-
-    static inline sl_u16 getDistanceQ2(const sl_lidar_response_measurement_node_t& node)
-    {
-        return node.distance_q2;
-    }
-
-    static inline sl_u32 getDistanceQ2(const sl_lidar_response_measurement_node_hq_t& node)
-    {
-        return node.dist_mm_q2;
-    }
-   
-    template <class TNode>
-    static bool angleLessThan(const TNode& a, const TNode& b)
-    {
-        return getAngle(a) < getAngle(b);
-    }
-
-    template < class TNode >
-    static sl_result ascendScanData_(TNode * nodebuffer, size_t count)
-    {
-        float inc_origin_angle = 360.f / count;
-        size_t i = 0;
-
-        //Tune head
-        for (i = 0; i < count; i++) {
-            if (getDistanceQ2(nodebuffer[i]) == 0) {
-                continue;
-            }
-            else {
-                while (i != 0) {
-                    i--;
-                    float expect_angle = getAngle(nodebuffer[i + 1]) - inc_origin_angle;
-                    if (expect_angle < 0.0f) expect_angle = 0.0f;
-                    setAngle(nodebuffer[i], expect_angle);
-                }
-                break;
-            }
-        }
-
-        // all the data is invalid
-        if (i == count) return SL_RESULT_OPERATION_FAIL;
-
-        //Tune tail
-        for (i = count - 1; i < count; i--) {
-            // To avoid array overruns, use the i < count condition
-            if (getDistanceQ2(nodebuffer[i]) == 0) {
-                continue;
-            }
-            else {
-                while (i != (count - 1)) {
-                    i++;
-                    float expect_angle = getAngle(nodebuffer[i - 1]) + inc_origin_angle;
-                    if (expect_angle > 360.0f) expect_angle -= 360.0f;
-                    setAngle(nodebuffer[i], expect_angle);
-                }
-                break;
-            }
-        }
-
-        //Fill invalid angle in the scan
-        float frontAngle = getAngle(nodebuffer[0]);
-        for (i = 1; i < count; i++) {
-            if (getDistanceQ2(nodebuffer[i]) == 0) {
-                float expect_angle = frontAngle + i * inc_origin_angle;
-                if (expect_angle > 360.0f) expect_angle -= 360.0f;
-                setAngle(nodebuffer[i], expect_angle);
-            }
-        }
-
-        // Reorder the scan according to the angle value
-        std::sort(nodebuffer, nodebuffer + count, &angleLessThan<TNode>);
-
-        return SL_RESULT_OK;
-    }
-
-    template<typename T>
-    class RawSampleNodeHolder
-    {
-    public:
-        RawSampleNodeHolder(size_t maxcount = 8192)
-            : _max_count(maxcount)
-        {
-           
-        }
-        void clear()
-        {
-            rp::hal::AutoLocker l(_locker);
-            _data_waiter.set(false);
-            _data_queue.clear();
-        }
-
-        void pushNode(_u64 timestamp_uS, const T* node)
-        {
-            rp::hal::AutoLocker l(_locker);
-            _data_queue.push_back(*node);
-            if (_data_queue.size() > _max_count) {
-                _data_queue.pop_front();
-            }
-            _data_waiter.set();
-        }
-
-        size_t waitAndFetch(T* node, size_t maxcount, _u32 timeout)
-        {
-            if (_data_waiter.wait(timeout) == rp::hal::Event::EVENT_OK)
-            {
-                rp::hal::AutoLocker l(_locker);
-
-                size_t copiedCount = 0;
-
-                while (maxcount--) {
-                    node[copiedCount++] = _data_queue.front();
-                    _data_queue.pop_front();
-                }
-
-                return copiedCount;
-            }
-            return 0;
-        }
-    protected:
-        size_t          _max_count;
-        rp::hal::Locker _locker;
-        rp::hal::Event  _data_waiter;
-        std::deque<T>   _data_queue;
-        
-    };
-
-    template<typename T>
-    class ScanDataHolder
-    {
-    public:
-        ScanDataHolder(size_t maxcount = 8192) 
-            : _scan_node_buffer_size(maxcount)
-            , _scan_node_available_id(-1)
-            , _new_scan_ready(false)
-        {
-            _scanbuffer[0].reserve(_scan_node_buffer_size);
-            _scanbuffer[1].reserve(_scan_node_buffer_size);
-
-            memset(_scan_begin_timestamp_uS, 0, sizeof(_scan_begin_timestamp_uS));
-        }
-
-        size_t getMaxCacheCount() const {
-            return _scan_node_buffer_size;
-        }
-
-
-        void reset() {
-            rp::hal::AutoLocker l(_locker);
-            _scan_node_available_id = -1;
-            _new_scan_ready = false;
-            _scanbuffer[0].clear();
-            _scanbuffer[1].clear();
-            _data_waiter.set(false);
-            memset(_scan_begin_timestamp_uS, 0, sizeof(_scan_begin_timestamp_uS));
-        }
-
-        bool checkNewScanSignalAndReset()
-        {
-            return _new_scan_ready.exchange(false);
-        }
-
-        void pushScanNodeData(_u64 currentSampleTsUs, const T* hqNode)
-        {
-            rp::hal::AutoLocker l(_locker);
-
-            int  operationBufID = _getOperationBufferID_locked();
-            auto operationalBuf = &_scanbuffer[operationBufID];
-            
-            if (hqNode->flag & RPLIDAR_RESP_HQ_FLAG_SYNCBIT) {
-                if (operationalBuf->size()) {
-                    operationBufID = _finishCurrentScanAndSwap_locked();
-                    operationalBuf = &_scanbuffer[operationBufID];
-
-                    // publish the available scan
-                    _new_scan_ready = true;
-                    _data_waiter.set();
-
-                }
-                
-                assert(operationalBuf->size() == 0);
-
-                //store the timestamp info
-                _scan_begin_timestamp_uS[operationBufID] = currentSampleTsUs;
-            }
-            else {
-                if (operationalBuf->size() == 0) {
-                    //discard the data, do not form partial scan
-                    return;
-                }
-            }
-
-            if (operationalBuf->size() >= _scan_node_buffer_size) {
-                //replace the last entry if buffer is full
-                operationalBuf->at(operationalBuf->size() - 1) = *hqNode;
-            }
-            else {
-                operationalBuf->push_back(*hqNode);
-            }
-
-        }
-
-        void rewindCurrentScanData() {
-            rp::hal::AutoLocker l(_locker);
-            _getOperationalBuffer_locked().clear();
-        }
-
-        std::vector<T>* waitAndLockAvailableScan(_u32 timeout, _u64 * out_timestamp_uS = nullptr)
-        {
-            if (_data_waiter.wait(timeout) == rp::hal::Event::EVENT_OK)
-            {
-                _locker.lock();
-                assert(_scan_node_available_id >= 0);
-                _new_scan_ready = false;
-                if (out_timestamp_uS) {
-                    *out_timestamp_uS = _scan_begin_timestamp_uS[_scan_node_available_id];
-                }
-                return &_scanbuffer[_scan_node_available_id];
-            }
-            else {
-                return nullptr;
-            }
-        }
-
-        void unlockScan(std::vector<T>* scan) {
-            if (scan) {
-                _locker.unlock();
-            }
-        }
-
-    protected:
-        int _finishCurrentScanAndSwap_locked() {
-            _scan_node_available_id = _getOperationBufferID_locked();
-            int newOperationalID  =  1 - _scan_node_available_id;
-
-            _scanbuffer[newOperationalID].clear();
-            return newOperationalID;
-        }
-
-        int _getOperationBufferID_locked() {
-            if (_scan_node_available_id < 0) return 0;
-            return 1 - _scan_node_available_id;
-        }
-
-        std::vector<T>& _getOperationalBuffer_locked()
-        {
-            return _scanbuffer[_getOperationBufferID_locked()];
-        }
-
-
-        rp::hal::Locker _locker;
-        rp::hal::Event  _data_waiter;
-
-        
-
-        _u64   _scan_begin_timestamp_uS[2];
-        size_t _scan_node_buffer_size;
-        int    _scan_node_available_id;
-        std::atomic<bool>   _new_scan_ready;
-
-        std::vector<T> _scanbuffer[2];
-    };
-
     class SlamtecLidarDriver : 
         public ILidarDriver, internal::IProtocolMessageListener, internal::LIDARSampleDataListener
     {
@@ -410,6 +128,14 @@ namespace sl {
             _protocolHandler->setMessageListener(this);
 
             memset(&_cached_DevInfo, 0, sizeof(_cached_DevInfo));
+            memset(&_session, 0, sizeof(_session));
+            _hasSession = false;
+            _nodes_decoded = 0;
+            _next_scan_listener_id = 1;
+            _scan_listener_count = 0;
+            _checksum_errors = 0;
+            _crc_errors = 0;
+            _encoder_resets = 0;
         }
 
 
@@ -649,6 +375,7 @@ namespace sl {
 
 
             _updateTimingDesc(_cached_DevInfo, outUsedScanMode.us_per_sample);
+            _recordScanSession(outUsedScanMode);
 
             startMotor();
 
@@ -737,6 +464,7 @@ namespace sl {
             }
             
             _updateTimingDesc(_cached_DevInfo, outUsedScanMode->us_per_sample);
+            _recordScanSession(*outUsedScanMode);
             startMotor();
 
             _scanHolder.reset();
@@ -781,24 +509,65 @@ namespace sl {
         }
 
         sl_result grabScanDataHqWithTimeStamp(sl_lidar_response_measurement_node_hq_t* nodebuffer, size_t& count, sl_u64& timestamp_uS, sl_u32 timeout = DEFAULT_TIMEOUT)
+        {
+            LidarScanTiming timing;
+            sl_result ans = grabScanDataHqWithTiming(nodebuffer, count, timing, timeout);
+            if (IS_OK(ans)) timestamp_uS = timing.timestamp_us;
+            return ans;
+        }
+
+        sl_result grabScanDataHqWithTiming(sl_lidar_response_measurement_node_hq_t* nodebuffer, size_t& count, LidarScanTiming& timing, sl_u32 timeout = DEFAULT_TIMEOUT)
         {
             rp::hal::AutoLocker l(_op_locker);
 
             if (!nodebuffer)
                 return SL_RESULT_INVALID_DATA;
 
-            auto availBuffer = _scanHolder.waitAndLockAvailableScan(timeout, &timestamp_uS);
+            // _op_locker keeps this the holder's only grabbing thread
+            auto availBuffer = _scanHolder.waitForNewestScan(timeout, &timing);
             if (!availBuffer) return SL_RESULT_OPERATION_TIMEOUT;
 
             count = std::min<size_t>(count, availBuffer->size());
 
             std::copy(availBuffer->begin(), availBuffer->begin() + count, nodebuffer);
 
-            _scanHolder.unlockScan(availBuffer);
+            return RESULT_OK;
+        }
+
+        sl_result borrowScanDataHq(LidarScanPtr& scan, sl_u32 timeout = DEFAULT_TIMEOUT)
+        {
+            rp::hal::AutoLocker l(_op_locker);
 
+            if (!_scanHolder.borrowNewestScan(timeout, scan)) return SL_RESULT_OPERATION_TIMEOUT;
             return RESULT_OK;
         }
 
+        int registerScanListener(LidarScanListener listener)
+        {
+            int listenerId;
+            size_t listeners;
+            {
+                rp::hal::AutoLocker turn(_scan_listener_turnstile);
+                rp::hal::AutoLocker l(_scan_listener_locker);
+                listenerId = _next_scan_listener_id++;
+                _scan_listeners[listenerId] = listener;
+                listeners = _scan_listeners.size();
+                _scan_listener_count = (int)listeners;
+            }
+            // room for each listener to keep the newest scan without the
+            // decoder having to allocate a buffer for the next one
+            _scanHolder.reserveSpares(listeners + 1);
+            return listenerId;
+        }
+
+        void unregisterScanListener(int listenerId)
+        {
+            rp::hal::AutoLocker turn(_scan_listener_turnstile);
+            rp::hal::AutoLocker l(_scan_listener_locker);
+            _scan_listeners.erase(listenerId);
+            _scan_listener_count = (int)_scan_listeners.size();
+        }
+
         sl_result grabScanDataHq(sl_lidar_response_measurement_node_hq_t* nodebuffer, size_t& count, sl_u32 timeout = DEFAULT_TIMEOUT)
         {
             _u64 localTS;
@@ -1032,6 +801,7 @@ namespace sl {
 
 			    ans = getLidarConf(SL_LIDAR_CONF_MIN_ROT_FREQ, answer);
 			    if (!ans) return ans;
+                if (answer.size() < sizeof(sl_u16)) return SL_RESULT_INVALID_DATA;
 
 			    const sl_u16 *min_answer = reinterpret_cast<const sl_u16*>(&answer[0]);
                 motorInfo.min_speed = *min_answer;
@@ -1039,6 +809,7 @@ namespace sl {
 
                 ans = getLidarConf(SL_LIDAR_CONF_MAX_ROT_FREQ, answer);
 			    if (!ans) return ans;
+                if (answer.size() < sizeof(sl_u16)) return SL_RESULT_INVALID_DATA;
 
 			    const sl_u16 *max_answer = reinterpret_cast<const sl_u16*>(&answer[0]);
                 motorInfo.max_speed = *max_answer;
@@ -1167,6 +938,7 @@ namespace sl {
             ans = getLidarConf(SL_LIDAR_CONF_DESIRED_ROT_FREQ, answer, nullptr, 0, timeoutInMs);
 
             if (IS_FAIL(ans)) return ans;
+            if (answer.size() < sizeof(sl_lidar_response_desired_rot_speed_t)) return SL_RESULT_INVALID_DATA;
 
             const sl_lidar_response_desired_rot_speed_t *p_answer = reinterpret_cast<const sl_lidar_response_desired_rot_speed_t*>(&answer[0]);
             motorSpeed = *p_answer;
@@ -1553,6 +1325,22 @@ namespace sl {
 
         }
 
+        // remembered so a recording started later can still say what it captured
+        void _recordScanSession(const LidarScanMode& mode)
+        {
+            memset(&_session, 0, sizeof(_session));
+            memcpy(&_session.device_info, &_cached_DevInfo, sizeof(_session.device_info));
+            _session.scan_mode_id = mode.id;
+            _session.ans_type = mode.ans_type;
+            _session.us_per_sample = mode.us_per_sample;
+            _session.max_distance = mode.max_distance;
+            // both are 64 bytes, the last one stays the terminator
+            memcpy(_session.scan_mode_name, mode.scan_mode, sizeof(_session.scan_mode_name) - 1);
+            _hasSession = true;
+
+            _transeiver->getRecorder().append(SL_LIDAR_RECORD_TYPE_SESSION, getus(), &_session, sizeof(_session));
+        }
+
         u_result _getLegacySampleDuration_uS(rplidar_response_sample_rate_t& rateInfo, _u32 timeout)
         {
             
@@ -1642,12 +1430,73 @@ namespace sl {
         
     public:
 
+        virtual void getStats(LidarDriverStats& stats)
+        {
+            stats.scans_completed = _scanHolder.getScansCompleted();
+            stats.nodes_decoded = _nodes_decoded.load(std::memory_order_relaxed);
+            stats.nodes_dropped = _scanHolder.getNodesDropped();
+            stats.checksum_errors = _checksum_errors.load(std::memory_order_relaxed);
+            stats.crc_errors = _crc_errors.load(std::memory_order_relaxed);
+            stats.encoder_resets = _encoder_resets.load(std::memory_order_relaxed);
+        }
+
+        virtual sl_result startRecording(const char* path)
+        {
+            rp::hal::AutoLocker l(_op_locker);
+            internal::ChannelRecorder& recorder = _transeiver->getRecorder();
+            sl_result ans = (sl_result)recorder.open(path);
+            if (IS_OK(ans) && _hasSession) {
+                recorder.append(SL_LIDAR_RECORD_TYPE_SESSION, getus(), &_session, sizeof(_session));
+            }
+            return ans;
+        }
+
+        virtual void stopRecording()
+        {
+            rp::hal::AutoLocker l(_op_locker);
+            _transeiver->getRecorder().close();
+        }
+
         virtual void onHQNodeDecoded(_u64 timestamp_uS, const rplidar_response_measurement_node_hq_t* node)
         {
-            _scanHolder.pushScanNodeData(timestamp_uS, node);
+            _nodes_decoded.fetch_add(1, std::memory_order_relaxed);
+            // called from the transceiver's decoder thread, inside onDecodeData
+            if (!_scan_listener_count.load(std::memory_order_relaxed)) {
+                _scanHolder.pushScanNodeData(timestamp_uS, node, _transeiver->getDecodingRxTimestamp_uS());
+            }
+            else {
+                LidarScanPtr completed;
+                _scanHolder.pushScanNodeData(timestamp_uS, node, _transeiver->getDecodingRxTimestamp_uS(), &completed);
+                if (completed) {
+                    // the decoder would otherwise take the listener lock back
+                    // right away and starve a pending (un)register
+                    _scan_listener_turnstile.lock();
+                    _scan_listener_turnstile.unlock();
+                    rp::hal::AutoLocker l(_scan_listener_locker);
+                    for (auto& item : _scan_listeners) item.second(completed);
+                }
+            }
             _rawSampleNodeHolder.pushNode(timestamp_uS, node);
         }
 
+        virtual void onDecodingError(int errMsg, _u8 ansType, const void* payload, size_t size)
+        {
+            switch (errMsg) {
+            case internal::LIDARSampleDataUnpacker::ERR_EVENT_ON_EXP_CHECKSUM_ERR:
+                // HQ capsules carry a CRC32, all other capsule types an XOR checksum
+                if (ansType == SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ) {
+                    _crc_errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                else {
+                    _checksum_errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                break;
+            case internal::LIDARSampleDataUnpacker::ERR_EVENT_ON_EXP_ENCODER_RESET:
+                _encoder_resets.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+
         virtual void onHQNodeScanResetReq() {
             _scanHolder.rewindCurrentScanData();
         }
@@ -1678,6 +1527,9 @@ namespace sl {
 
         bool _isConnected;
 
+        sl_lidar_record_session_t _session;
+        bool _hasSession;
+
         MotorCtrlSupport          _isSupportingMotorCtrl;
 
 
@@ -1687,12 +1539,24 @@ namespace sl {
 
         ScanDataHolder<sl_lidar_response_measurement_node_hq_t> _scanHolder;
         RawSampleNodeHolder<sl_lidar_response_measurement_node_hq_t> _rawSampleNodeHolder;
+
+        rp::hal::Locker                  _scan_listener_turnstile;
+        rp::hal::Locker                  _scan_listener_locker;
+        std::map<int, LidarScanListener> _scan_listeners;
+        int                              _next_scan_listener_id;
+        std::atomic<int>                 _scan_listener_count;
+
         _u32                          _waiting_packet_type;
         internal::message_autoptr_t   _lastAnsPkt;
 
         sl_lidar_response_device_info_t _cached_DevInfo;
         SlamtecLidarTimingDesc         _timing_desc;
 
+        std::atomic<_u64>              _nodes_decoded;
+        std::atomic<_u64>              _checksum_errors;
+        std::atomic<_u64>              _crc_errors;
+        std::atomic<_u64>              _encoder_resets;
+
     };
 
     Result<ILidarDriver*> createLidarDriver()
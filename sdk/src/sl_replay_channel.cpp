@@ -0,0 +1,530 @@
+/*
+ * Slamtec LIDAR SDK
+ *
+ *  Copyright (c) 2014 - 2020 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+ /*
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  *
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and  the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  */
+
+#include "sdkcommon.h"
+#include "hal/types.h"
+#include "hal/locker.h"
+#include "hal/event.h"
+#include "sl_lidar_driver.h"
+#include "sl_lidar_protocol.h"
+#include "sl_lidar_recording.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+
+namespace sl {
+
+    // Plays a recording made with ILidarDriver::startRecording back as if the
+    // device were attached.
+    //
+    // Every command the driver writes is looked up among the recorded TX
+    // records, and the RX records that followed it are replayed, paced by
+    // their recorded timestamps. Scan commands keep streaming until the next
+    // command; with loop set, the scan stream starts over when it runs out.
+    //
+    // A recording started mid-scan has no handshake to replay. The device
+    // info, scan mode queries and the scan answer descriptor are then made
+    // up from its session record, and the scan streams its RX records.
+    class ReplayChannel : public IChannel
+    {
+    public:
+        ReplayChannel(const std::string& path, float speed, bool loop)
+            : _path(path)
+            , _speed(speed)
+            , _loop(loop)
+            , _file(NULL)
+            , _hasSession(false)
+        {
+            _resetReplay();
+        }
+
+        ~ReplayChannel()
+        {
+            close();
+        }
+
+        bool open()
+        {
+            rp::hal::AutoLocker l(_locker);
+            _closeLocked();
+
+            _file = fopen(_path.c_str(), "rb");
+            if (!_file) return false;
+            if (!_loadRecords()) {
+                _closeLocked();
+                return false;
+            }
+            _resetReplay();
+            return true;
+        }
+
+        void close()
+        {
+            rp::hal::AutoLocker l(_locker);
+            _closeLocked();
+        }
+
+        void flush()
+        {
+        }
+
+        sl_result waitForDataExt(size_t& size_hint, sl_u32 timeoutInMs)
+        {
+            size_hint = 0;
+            _u64 deadline = getms() + timeoutInMs;
+
+            while (true) {
+                _u32 waitMs = timeoutInMs;
+                {
+                    rp::hal::AutoLocker l(_locker);
+                    if (!_file) return SL_RESULT_OPERATION_FAIL;
+
+                    if (_pendingOffset < _pending.size() || _loadDueRecordLocked(waitMs)) {
+                        size_hint = _pending.size() - _pendingOffset;
+                        return SL_RESULT_OK;
+                    }
+                }
+
+                _u64 now = getms();
+                if (now >= deadline) return SL_RESULT_OPERATION_TIMEOUT;
+                // a write() from the driver wakes us early
+                _wakeup.wait((unsigned long)std::min<_u64>(waitMs, deadline - now));
+            }
+        }
+
+        bool waitForData(size_t size, sl_u32 timeoutInMs, size_t* actualReady)
+        {
+            size_t ready = 0;
+            bool ok = IS_OK(waitForDataExt(ready, timeoutInMs));
+            if (actualReady) *actualReady = ready;
+            return ok && ready >= size;
+        }
+
+        int write(const void* data, size_t size)
+        {
+            rp::hal::AutoLocker l(_locker);
+            if (!_file) return -1;
+
+            _onCommandLocked((const _u8*)data, size);
+            _wakeup.set();
+            return (int)size;
+        }
+
+        int read(void* buffer, size_t size)
+        {
+            rp::hal::AutoLocker l(_locker);
+            size_t available = _pending.size() - _pendingOffset;
+            size_t count = std::min(size, available);
+            if (count) {
+                memcpy(buffer, &_pending[_pendingOffset], count);
+                _pendingOffset += count;
+            }
+            return (int)count;
+        }
+
+        void clearReadCache()
+        {
+            rp::hal::AutoLocker l(_locker);
+            _pending.clear();
+            _pendingOffset = 0;
+        }
+
+        int getChannelType()
+        {
+            return CHANNEL_TYPE_REPLAY;
+        }
+
+    protected:
+        struct Record {
+            _u64 payload_offset;
+            _u64 timestamp_us;
+            _u32 size;
+            _u8  type;
+        };
+
+        struct Command {
+            size_t record;
+            std::vector<_u8> bytes;
+        };
+
+        void _closeLocked()
+        {
+            if (_file) {
+                fclose(_file);
+                _file = NULL;
+            }
+            _records.clear();
+            _commands.clear();
+            _hasSession = false;
+            _resetReplay();
+        }
+
+        void _resetReplay()
+        {
+            _cursor = _end = _loopBegin = 0;
+            _loopSkip = _skipBytes = 0;
+            _replayingScan = false;
+            _baseRecordUs = _baseWallUs = 0;
+            _searchFrom = 0;
+            _pending.clear();
+            _pendingOffset = 0;
+        }
+
+        bool _loadRecords()
+        {
+            sl_lidar_recording_file_header_t header;
+            if (fread(&header, sizeof(header), 1, _file) != 1) return false;
+            if (header.magic != SL_LIDAR_RECORDING_MAGIC || header.version != SL_LIDAR_RECORDING_VERSION) return false;
+            if (fseek(_file, header.header_size, SEEK_SET) != 0) return false;
+
+            _u64 offset = header.header_size;
+            sl_lidar_record_header_t recordHeader;
+            // a recording cut short ends at the last complete header
+            while (fread(&recordHeader, sizeof(recordHeader), 1, _file) == 1) {
+                if (recordHeader.sync != SL_LIDAR_RECORD_SYNC) break;
+                offset += sizeof(recordHeader);
+
+                Record record;
+                record.payload_offset = offset;
+                record.timestamp_us = recordHeader.timestamp_us;
+                record.size = recordHeader.payload_size;
+                record.type = recordHeader.type;
+
+                if (record.type == SL_LIDAR_RECORD_TYPE_TX) {
+                    Command command;
+                    command.record = _records.size();
+                    command.bytes.resize(record.size);
+                    if (record.size && fread(&command.bytes[0], record.size, 1, _file) != 1) break;
+                    _commands.push_back(command);
+                    _records.push_back(record);
+                }
+                else {
+                    if (record.type == SL_LIDAR_RECORD_TYPE_SESSION && !_hasSession
+                        && record.size >= sizeof(sl_lidar_record_session_t)) {
+                        if (fread(&_session, sizeof(_session), 1, _file) != 1) break;
+                        _hasSession = true;
+                    }
+                    if (record.type == SL_LIDAR_RECORD_TYPE_RX) _records.push_back(record);
+                    if (record.type == SL_LIDAR_RECORD_TYPE_END) break;
+                }
+
+                offset += record.size;
+                if (fseek(_file, (long)offset, SEEK_SET) != 0) break;
+            }
+            return !_records.empty();
+        }
+
+        _u64 _dueUs(_u64 recordedUs) const
+        {
+            if (_speed <= 0) return 0;
+            return _baseWallUs + (_u64)((recordedUs - _baseRecordUs) / _speed);
+        }
+
+        // moves the next RX record into _pending once its time has come
+        bool _loadDueRecordLocked(_u32& waitMs)
+        {
+            if (_cursor >= _end) {
+                if (!_loop || !_replayingScan || _loopBegin >= _end) return false;
+                _cursor = _loopBegin;
+                _skipBytes = _loopSkip;
+                _baseRecordUs = _records[_cursor].timestamp_us;
+                _baseWallUs = getus();
+            }
+
+            const Record& record = _records[_cursor];
+            _u64 now = getus();
+            _u64 due = _dueUs(record.timestamp_us);
+            if (due > now) {
+                waitMs = (_u32)((due - now) / 1000 + 1);
+                return false;
+            }
+
+            ++_cursor;
+            size_t skip = std::min<size_t>(_skipBytes, record.size);
+            _skipBytes = 0;
+            if (record.size == skip) return _loadDueRecordLocked(waitMs);
+
+            _pending.resize(record.size - skip);
+            _pendingOffset = 0;
+            if (fseek(_file, (long)(record.payload_offset + skip), SEEK_SET) != 0
+                || fread(&_pending[0], _pending.size(), 1, _file) != 1) {
+                _pending.clear();
+                return false;
+            }
+            return true;
+        }
+
+        static bool _isScanCommand(const _u8* data, size_t size)
+        {
+            if (size < 2 || data[0] != SL_LIDAR_CMD_SYNC_BYTE) return false;
+            switch (data[1]) {
+            case SL_LIDAR_CMD_SCAN:
+            case SL_LIDAR_CMD_FORCE_SCAN:
+            case SL_LIDAR_CMD_EXPRESS_SCAN:
+            case SL_LIDAR_CMD_HQ_SCAN:
+                return true;
+            }
+            return false;
+        }
+
+        // the next recorded command with these exact bytes, or failing that
+        // with the same command code, searching onwards from the last match
+        int _findCommandLocked(const _u8* data, size_t size)
+        {
+            if (_commands.empty() || size < 2) return -1;
+
+            size_t start = 0;
+            while (start < _commands.size() && _commands[start].record < _searchFrom) ++start;
+
+            for (int pass = 0; pass < 2; ++pass) {
+                for (size_t i = 0; i < _commands.size(); ++i) {
+                    const Command& command = _commands[(start + i) % _commands.size()];
+                    if (command.bytes.size() < 2) continue;
+
+                    // a conf answer for another query would be rejected, those are made up instead
+                    bool match = pass == 0
+                        ? command.bytes.size() == size && memcmp(&command.bytes[0], data, size) == 0
+                        : command.bytes[1] == data[1] && data[1] != SL_LIDAR_CMD_GET_LIDAR_CONF;
+                    if (match) return (int)((start + i) % _commands.size());
+                }
+            }
+            return -1;
+        }
+
+        void _onCommandLocked(const _u8* data, size_t size)
+        {
+            _pending.clear();
+            _pendingOffset = 0;
+            _replayingScan = _isScanCommand(data, size);
+
+            int found = _findCommandLocked(data, size);
+            if (found < 0) {
+                // recordings started after connect lack the probing commands
+                _synthesizeAnswerLocked(data, size);
+                return;
+            }
+
+            size_t record = _commands[found].record;
+            size_t next = (size_t)found + 1;
+            _cursor = _loopBegin = record + 1;
+            _end = next < _commands.size() ? _commands[next].record : _records.size();
+            _searchFrom = record + 1;
+            _baseRecordUs = _records[record].timestamp_us;
+            _baseWallUs = getus();
+
+            // the answer descriptor is only sent once, later rounds start at the data
+            if (_replayingScan && _loopBegin < _end) {
+                _loopSkip = _answerHeaderBytesLocked(_records[_loopBegin]);
+                if (_loopSkip == _records[_loopBegin].size) {
+                    ++_loopBegin;
+                    _loopSkip = 0;
+                }
+            }
+        }
+
+        // sizeof(sl_lidar_ans_header_t) if the record starts with one, else 0
+        size_t _answerHeaderBytesLocked(const Record& record)
+        {
+            sl_lidar_ans_header_t header;
+            if (record.type != SL_LIDAR_RECORD_TYPE_RX || record.size < sizeof(header)) return 0;
+            if (fseek(_file, (long)record.payload_offset, SEEK_SET) != 0
+                || fread(&header, sizeof(header), 1, _file) != 1) {
+                return 0;
+            }
+            if (header.syncByte1 != SL_LIDAR_ANS_SYNC_BYTE1 || header.syncByte2 != SL_LIDAR_ANS_SYNC_BYTE2) return 0;
+            return sizeof(header);
+        }
+
+        static size_t _scanPacketSize(_u8 ansType)
+        {
+            switch (ansType) {
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT: return sizeof(sl_lidar_response_measurement_node_t);
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED: return sizeof(sl_lidar_response_capsule_measurement_nodes_t);
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_CAPSULED_ULTRA: return sizeof(sl_lidar_response_ultra_capsule_measurement_nodes_t);
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED: return sizeof(sl_lidar_response_dense_capsule_measurement_nodes_t);
+            case SL_LIDAR_ANS_TYPE_MEASUREMENT_HQ: return sizeof(sl_lidar_response_hq_capsule_measurement_nodes_t);
+            }
+            return 0;
+        }
+
+        void _synthesizeAnswerLocked(const _u8* data, size_t size)
+        {
+            _cursor = _end = _loopBegin = 0;
+            _loopSkip = _skipBytes = 0;
+            if (size < 2 || data[0] != SL_LIDAR_CMD_SYNC_BYTE) return;
+
+            switch (data[1]) {
+            case SL_LIDAR_CMD_GET_DEVICE_INFO:
+                if (_hasSession) {
+                    _queueAnswerLocked(SL_LIDAR_ANS_TYPE_DEVINFO, &_session.device_info, sizeof(_session.device_info));
+                }
+                break;
+            case SL_LIDAR_CMD_GET_DEVICE_HEALTH: {
+                sl_lidar_response_device_health_t health;
+                memset(&health, 0, sizeof(health));
+                health.status = SL_LIDAR_STATUS_OK;
+                _queueAnswerLocked(SL_LIDAR_ANS_TYPE_DEVHEALTH, &health, sizeof(health));
+                break;
+            }
+            case SL_LIDAR_CMD_GET_LIDAR_CONF:
+                // A5, command, payload size, then the query
+                if (size >= 3 + sizeof(sl_lidar_payload_get_scan_conf_t)) {
+                    _synthesizeConfLocked(data + 3, size - 3);
+                }
+                break;
+            case SL_LIDAR_CMD_SCAN:
+            case SL_LIDAR_CMD_FORCE_SCAN:
+            case SL_LIDAR_CMD_EXPRESS_SCAN:
+            case SL_LIDAR_CMD_HQ_SCAN:
+                _synthesizeScanLocked();
+                break;
+            }
+        }
+
+        // only the mode the recording was made in exists
+        void _synthesizeConfLocked(const _u8* query, size_t size)
+        {
+            if (!_hasSession) return;
+
+            _u32 type;
+            memcpy(&type, query, sizeof(type));
+            _u16 modeId = 0;
+            if (size >= sizeof(type) + sizeof(modeId)) memcpy(&modeId, query + sizeof(type), sizeof(modeId));
+            bool recordedMode = modeId == _session.scan_mode_id;
+
+            std::vector<_u8> reply((const _u8*)&type, (const _u8*)&type + sizeof(type));
+            switch (type) {
+            case SL_LIDAR_CONF_SCAN_MODE_COUNT: {
+                _u16 count = _session.scan_mode_id + 1;
+                reply.insert(reply.end(), (const _u8*)&count, (const _u8*)&count + sizeof(count));
+                break;
+            }
+            case SL_LIDAR_CONF_SCAN_MODE_TYPICAL:
+                reply.insert(reply.end(), (const _u8*)&_session.scan_mode_id, (const _u8*)&_session.scan_mode_id + sizeof(_u16));
+                break;
+            case SL_LIDAR_CONF_SCAN_MODE_US_PER_SAMPLE:
+            case SL_LIDAR_CONF_SCAN_MODE_MAX_DISTANCE: {
+                if (!recordedMode) break;
+                float value = type == SL_LIDAR_CONF_SCAN_MODE_US_PER_SAMPLE ? _session.us_per_sample : _session.max_distance;
+                _u32 q8 = (_u32)(value * 256.0f);
+                reply.insert(reply.end(), (const _u8*)&q8, (const _u8*)&q8 + sizeof(q8));
+                break;
+            }
+            case SL_LIDAR_CONF_SCAN_MODE_ANS_TYPE:
+                if (recordedMode) reply.push_back(_session.ans_type);
+                break;
+            case SL_LIDAR_CONF_SCAN_MODE_NAME:
+                if (recordedMode) {
+                    size_t length = strnlen(_session.scan_mode_name, sizeof(_session.scan_mode_name) - 1);
+                    reply.insert(reply.end(), _session.scan_mode_name, _session.scan_mode_name + length);
+                    reply.push_back(0);
+                }
+                break;
+            }
+            // a bare type is what a device answers for a query it does not support
+            _queueAnswerLocked(SL_LIDAR_ANS_TYPE_GET_LIDAR_CONF, &reply[0], reply.size());
+        }
+
+        // the recorded stream from its first RX record, behind a made-up descriptor
+        void _synthesizeScanLocked()
+        {
+            size_t packetSize = _hasSession ? _scanPacketSize(_session.ans_type) : 0;
+            if (!packetSize) return;
+
+            size_t first = 0;
+            while (first < _records.size() && _records[first].type != SL_LIDAR_RECORD_TYPE_RX) ++first;
+            size_t end = first;
+            while (end < _records.size() && _records[end].type == SL_LIDAR_RECORD_TYPE_RX) ++end;
+            if (first == end) return;
+
+            _queueAnswerLocked(_session.ans_type, NULL, packetSize, true);
+            _cursor = _loopBegin = first;
+            _end = end;
+            _baseRecordUs = _records[first].timestamp_us;
+            _baseWallUs = getus();
+        }
+
+        // a looping answer's size describes each packet that follows, not a payload
+        void _queueAnswerLocked(_u8 type, const void* payload, size_t size, bool loop = false)
+        {
+            sl_lidar_ans_header_t header;
+            header.syncByte1 = SL_LIDAR_ANS_SYNC_BYTE1;
+            header.syncByte2 = SL_LIDAR_ANS_SYNC_BYTE2;
+            header.size_q30_subtype = (sl_u32)size | (loop ? (SL_LIDAR_ANS_PKTFLAG_LOOP << SL_LIDAR_ANS_HEADER_SUBTYPE_SHIFT) : 0);
+            header.type = type;
+
+            size_t payloadSize = payload ? size : 0;
+            _pending.resize(sizeof(header) + payloadSize);
+            memcpy(&_pending[0], &header, sizeof(header));
+            if (payloadSize) memcpy(&_pending[sizeof(header)], payload, payloadSize);
+            _pendingOffset = 0;
+        }
+
+    private:
+        std::string _path;
+        float _speed;
+        bool _loop;
+
+        rp::hal::Locker _locker;
+        rp::hal::Event _wakeup;
+        FILE* _file;
+
+        std::vector<Record> _records;
+        std::vector<Command> _commands;
+        // the first session of the recording
+        sl_lidar_record_session_t _session;
+        bool _hasSession;
+
+        // RX records [_cursor, _end) answer the last command
+        size_t _cursor;
+        size_t _end;
+        // where a looping scan starts over, past its answer descriptor
+        size_t _loopBegin;
+        size_t _loopSkip;
+        size_t _skipBytes;
+        bool _replayingScan;
+        size_t _searchFrom;
+        _u64 _baseRecordUs;
+        _u64 _baseWallUs;
+
+        std::vector<_u8> _pending;
+        size_t _pendingOffset;
+    };
+
+    Result<IChannel*> createReplayChannel(const std::string& path, float speed, bool loop)
+    {
+        return new ReplayChannel(path, speed, loop);
+    }
+}
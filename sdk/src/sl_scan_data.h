@@ -0,0 +1,504 @@
+/*
+ * Slamtec LIDAR SDK
+ *
+ *  Copyright (c) 2014 - 2023 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+ /*
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  *
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  */
+
+#pragma once
+
+#include "sdkcommon.h"
+#include "hal/locker.h"
+#include "hal/event.h"
+#include "sl_lidar_driver.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+// Scan assembly shared by the driver and the benchmarks: node angle helpers,
+// the ascending reorder, and the buffers the decoder feeds scans into.
+
+namespace sl {
+
+    static inline float getAngle(const sl_lidar_response_measurement_node_t& node)
+    {
+        return (node.angle_q6_checkbit >> SL_LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT) / 64.f;
+    }
+
+    static inline void setAngle(sl_lidar_response_measurement_node_t& node, float v)
+    {
+        sl_u16 checkbit = node.angle_q6_checkbit & SL_LIDAR_RESP_MEASUREMENT_CHECKBIT;
+        node.angle_q6_checkbit = (((sl_u16)(v * 64.0f)) << SL_LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT) | checkbit;
+    }
+
+    static inline float getAngle(const sl_lidar_response_measurement_node_hq_t& node)
+    {
+        return node.angle_z_q14 * 90.f / 16384.f;
+    }
+
+    static inline void setAngle(sl_lidar_response_measurement_node_hq_t& node, float v)
+    {
+        node.angle_z_q14 = sl_u32(v * 16384.f / 90.f);
+    }
+
+    static inline sl_u16 getDistanceQ2(const sl_lidar_response_measurement_node_t& node)
+    {
+        return node.distance_q2;
+    }
+
+    static inline sl_u32 getDistanceQ2(const sl_lidar_response_measurement_node_hq_t& node)
+    {
+        return node.dist_mm_q2;
+    }
+   
+    template <class TNode>
+    static bool angleLessThan(const TNode& a, const TNode& b)
+    {
+        return getAngle(a) < getAngle(b);
+    }
+
+    template < class TNode >
+    static sl_result ascendScanData_(TNode * nodebuffer, size_t count)
+    {
+        float inc_origin_angle = 360.f / count;
+        size_t i = 0;
+
+        //Tune head
+        for (i = 0; i < count; i++) {
+            if (getDistanceQ2(nodebuffer[i]) == 0) {
+                continue;
+            }
+            else {
+                while (i != 0) {
+                    i--;
+                    float expect_angle = getAngle(nodebuffer[i + 1]) - inc_origin_angle;
+                    if (expect_angle < 0.0f) expect_angle = 0.0f;
+                    setAngle(nodebuffer[i], expect_angle);
+                }
+                break;
+            }
+        }
+
+        // all the data is invalid
+        if (i == count) return SL_RESULT_OPERATION_FAIL;
+
+        //Tune tail
+        for (i = count - 1; i < count; i--) {
+            // To avoid array overruns, use the i < count condition
+            if (getDistanceQ2(nodebuffer[i]) == 0) {
+                continue;
+            }
+            else {
+                while (i != (count - 1)) {
+                    i++;
+                    float expect_angle = getAngle(nodebuffer[i - 1]) + inc_origin_angle;
+                    if (expect_angle > 360.0f) expect_angle -= 360.0f;
+                    setAngle(nodebuffer[i], expect_angle);
+                }
+                break;
+            }
+        }
+
+        //Fill invalid angle in the scan
+        float frontAngle = getAngle(nodebuffer[0]);
+        for (i = 1; i < count; i++) {
+            if (getDistanceQ2(nodebuffer[i]) == 0) {
+                float expect_angle = frontAngle + i * inc_origin_angle;
+                if (expect_angle > 360.0f) expect_angle -= 360.0f;
+                setAngle(nodebuffer[i], expect_angle);
+            }
+        }
+
+        // Reorder the scan according to the angle value
+        std::sort(nodebuffer, nodebuffer + count, &angleLessThan<TNode>);
+
+        return SL_RESULT_OK;
+    }
+
+    template<typename T>
+    class RawSampleNodeHolder
+    {
+    public:
+        RawSampleNodeHolder(size_t maxcount = 8192)
+            : _max_count(maxcount)
+        {
+           
+        }
+        void clear()
+        {
+            rp::hal::AutoLocker l(_locker);
+            _data_waiter.set(false);
+            _data_queue.clear();
+        }
+
+        void pushNode(_u64 timestamp_uS, const T* node)
+        {
+            rp::hal::AutoLocker l(_locker);
+            _data_queue.push_back(*node);
+            if (_data_queue.size() > _max_count) {
+                _data_queue.pop_front();
+            }
+            _data_waiter.set();
+        }
+
+        size_t waitAndFetch(T* node, size_t maxcount, _u32 timeout)
+        {
+            if (_data_waiter.wait(timeout) == rp::hal::Event::EVENT_OK)
+            {
+                rp::hal::AutoLocker l(_locker);
+
+                size_t copiedCount = 0;
+
+                while (maxcount--) {
+                    node[copiedCount++] = _data_queue.front();
+                    _data_queue.pop_front();
+                }
+
+                return copiedCount;
+            }
+            return 0;
+        }
+    protected:
+        size_t          _max_count;
+        rp::hal::Locker _locker;
+        rp::hal::Event  _data_waiter;
+        std::deque<T>   _data_queue;
+        
+    };
+
+    // Triple-buffered scan store between the decoder thread and one grabbing
+    // thread. The decoder fills its own buffer and, on the sync bit, swaps it
+    // with the shared middle slot; the grabber swaps the middle slot with the
+    // buffer it reads. Both swaps are single atomic exchanges, so copying a
+    // scan out never stalls the decoder, and the grabber always gets the
+    // newest complete scan, older unread ones are overwritten. The only lock
+    // the decoder touches is the event it sets to wake a waiting grabber.
+    //
+    // Buffers are reference counted so scans can also be lent out as
+    // LidarScanPtr handles: a slot holds one reference, each handle another.
+    // When the decoder gets back a buffer that is still lent out it leaves it
+    // to the handles, which return it to a lock-free stack of spares after the
+    // last one is dropped, and continues in a spare. Spares are allocated on
+    // the consuming side (reserveSpares, borrowNewestScan), so the decoder
+    // only allocates when consumers hold on to more scans than were reserved.
+    template<typename T>
+    class ScanDataHolder
+    {
+    public:
+        ScanDataHolder(size_t maxcount = 8192) 
+            : _scan_node_buffer_size(maxcount)
+            , _pool(std::make_shared<BufferPool>(maxcount))
+            , _new_scan_ready(false)
+            , _reset_requested(false)
+        {
+            _write_buffer = _pool->acquire();
+            _middle = (uintptr_t)_pool->acquire();
+            _read_buffer = _pool->acquire();
+            _pool->reserve(1);
+            _scans_completed = 0;
+            _nodes_dropped = 0;
+        }
+
+        ~ScanDataHolder()
+        {
+            _pool->unref(_write_buffer);
+            _pool->unref((ScanBuffer*)(_middle.load() & ~BUFFER_FRESH));
+            _pool->unref(_read_buffer);
+        }
+
+        size_t getMaxCacheCount() const {
+            return _scan_node_buffer_size;
+        }
+
+        // Drops the published scan and, on the decoder's next node, the one
+        // being assembled. Safe to call while the decoder is running.
+        void reset() {
+            _reset_requested.store(true, std::memory_order_release);
+            _middle.fetch_and(~BUFFER_FRESH, std::memory_order_acq_rel);
+            _new_scan_ready = false;
+            _data_waiter.set(false);
+        }
+
+        _u64 getScansCompleted() const {
+            return _scans_completed.load(std::memory_order_relaxed);
+        }
+
+        _u64 getNodesDropped() const {
+            return _nodes_dropped.load(std::memory_order_relaxed);
+        }
+
+        // Makes sure at least count spare buffers are ready for the decoder.
+        // Call it from the consuming side before holding on to that many scans.
+        void reserveSpares(size_t count) {
+            _pool->reserve(count);
+        }
+
+        bool checkNewScanSignalAndReset()
+        {
+            return _new_scan_ready.exchange(false);
+        }
+
+        // decoder thread only. When out_completed is given and the node
+        // completes a scan, it also receives a handle to that scan.
+        void pushScanNodeData(_u64 currentSampleTsUs, const T* hqNode, _u64 rxTimestampUs = 0,
+                              LidarScanPtr* out_completed = nullptr)
+        {
+            if (_reset_requested.load(std::memory_order_relaxed)
+                && _reset_requested.exchange(false, std::memory_order_acquire)) {
+                // a scan published while the reset was pending is stale too
+                _middle.fetch_and(~BUFFER_FRESH, std::memory_order_acq_rel);
+                _write_buffer->nodes.clear();
+            }
+
+            ScanBuffer* operational = _write_buffer;
+
+            if (hqNode->flag & RPLIDAR_RESP_HQ_FLAG_SYNCBIT) {
+                _u64 now = getus();
+                if (operational->nodes.size()) {
+                    operational->timing.completed_us = now;
+                    operational->sequence = _scans_completed.load(std::memory_order_relaxed) + 1;
+                    _fillView(operational);
+                    if (out_completed) *out_completed = _makeHandle(operational);
+                    operational = _publishCurrentScan();
+
+                    _new_scan_ready = true;
+                    _data_waiter.set();
+                    _scans_completed.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                assert(operational->nodes.size() == 0);
+
+                operational->timing.timestamp_us = currentSampleTsUs;
+                operational->timing.first_rx_us = rxTimestampUs;
+                operational->timing.first_decoded_us = now;
+                operational->timing.completed_us = 0;
+            }
+            else {
+                if (operational->nodes.size() == 0) {
+                    //discard the data, do not form partial scan
+                    return;
+                }
+            }
+
+            if (operational->nodes.size() >= _scan_node_buffer_size) {
+                //replace the last entry if buffer is full
+                operational->nodes.back() = *hqNode;
+                _nodes_dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            else {
+                operational->nodes.push_back(*hqNode);
+            }
+        }
+
+        // decoder thread only
+        void rewindCurrentScanData() {
+            _write_buffer->nodes.clear();
+        }
+
+        // Waits for a scan newer than the last one returned. The buffer stays
+        // untouched by the decoder until the next call, which must come from
+        // the same thread or be serialized with this one.
+        const std::vector<T>* waitForNewestScan(_u32 timeout, LidarScanTiming * out_timing = nullptr)
+        {
+            if (!_takeNewestScan(timeout)) return nullptr;
+            if (out_timing) {
+                *out_timing = _read_buffer->timing;
+            }
+            return &_read_buffer->nodes;
+        }
+
+        // Same as waitForNewestScan, but the scan is handed over for as long
+        // as the caller holds it.
+        bool borrowNewestScan(_u32 timeout, LidarScanPtr& out_scan)
+        {
+            if (!_takeNewestScan(timeout)) {
+                out_scan.reset();
+                return false;
+            }
+
+            out_scan = _makeHandle(_read_buffer);
+            // the decoder needs a spare once this buffer comes back still lent
+            _pool->reserve(1);
+            return true;
+        }
+
+    protected:
+        enum {
+            // tags the middle slot's pointer while it holds an unread scan
+            BUFFER_FRESH = 0x1,
+        };
+
+        struct ScanBuffer {
+            std::vector<T>  nodes;
+            LidarScanTiming timing;
+            _u64            sequence;
+            LidarScan       view;
+            std::atomic<int> refs;
+            ScanBuffer*     next_free;
+        };
+
+        // Spare scan buffers. Outlives the holder while scans are borrowed.
+        // Any thread may put buffers back, only the decoder (or the holder
+        // before it starts) takes them out, which keeps the stack free of ABA.
+        class BufferPool {
+        public:
+            BufferPool(size_t capacity) : _capacity(capacity), _free(nullptr), _spares(0) {}
+
+            ~BufferPool() {
+                while (ScanBuffer* buffer = _free.load()) {
+                    _free = buffer->next_free;
+                    delete buffer;
+                }
+            }
+
+            // decoder thread only
+            ScanBuffer* acquire() {
+                ScanBuffer* buffer = _free.load(std::memory_order_acquire);
+                while (buffer && !_free.compare_exchange_weak(buffer, buffer->next_free,
+                                                              std::memory_order_acquire, std::memory_order_acquire)) {
+                }
+                if (!buffer) return _allocate();
+                _spares.fetch_sub(1, std::memory_order_relaxed);
+                return buffer;
+            }
+
+            // the last reference puts the buffer back among the spares
+            void unref(ScanBuffer* buffer) {
+                if (buffer->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+                _push(buffer);
+            }
+
+            // tops the spares up to count, never called on the decoder thread
+            void reserve(size_t count) {
+                while ((size_t)_spares.load(std::memory_order_relaxed) < count) {
+                    _push(_allocate());
+                }
+            }
+
+        private:
+            ScanBuffer* _allocate() {
+                ScanBuffer* buffer = new ScanBuffer();
+                buffer->nodes.reserve(_capacity);
+                memset(&buffer->timing, 0, sizeof(buffer->timing));
+                buffer->sequence = 0;
+                buffer->refs = 1;
+                buffer->next_free = nullptr;
+                return buffer;
+            }
+
+            void _push(ScanBuffer* buffer) {
+                buffer->refs.store(1, std::memory_order_relaxed);
+                ScanBuffer* head = _free.load(std::memory_order_relaxed);
+                do {
+                    buffer->next_free = head;
+                } while (!_free.compare_exchange_weak(head, buffer, std::memory_order_release, std::memory_order_relaxed));
+                _spares.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            size_t                   _capacity;
+            std::atomic<ScanBuffer*> _free;
+            std::atomic<int>         _spares;
+        };
+
+        void _fillView(ScanBuffer* buffer) {
+            buffer->view.nodes = buffer->nodes.data();
+            buffer->view.count = buffer->nodes.size();
+            buffer->view.timestamp_us = buffer->timing.timestamp_us;
+            buffer->view.sequence = buffer->sequence;
+            buffer->view.timing = buffer->timing;
+        }
+
+        LidarScanPtr _makeHandle(ScanBuffer* buffer) {
+            buffer->refs.fetch_add(1, std::memory_order_relaxed);
+            std::shared_ptr<BufferPool> pool = _pool;
+            std::shared_ptr<ScanBuffer> owner(buffer, [pool](ScanBuffer* released) {
+                pool->unref(released);
+            });
+            return LidarScanPtr(owner, &buffer->view);
+        }
+
+        // hands the finished scan over and returns the buffer to assemble into
+        ScanBuffer* _publishCurrentScan() {
+            uintptr_t previous = _middle.exchange((uintptr_t)_write_buffer | BUFFER_FRESH, std::memory_order_acq_rel);
+            ScanBuffer* reclaimed = (ScanBuffer*)(previous & ~BUFFER_FRESH);
+
+            // drop the slot's reference; if it was the last one nobody holds
+            // the scan and the buffer is reused as is
+            if (reclaimed->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                reclaimed->refs.store(1, std::memory_order_relaxed);
+                _write_buffer = reclaimed;
+            }
+            else {
+                _write_buffer = _pool->acquire();
+            }
+            _write_buffer->nodes.clear();
+            return _write_buffer;
+        }
+
+        // swaps the newest scan into _read_buffer, waiting up to timeout
+        bool _takeNewestScan(_u32 timeout)
+        {
+            _u64 deadline = (_u64)getms() + timeout;
+            for (;;) {
+                if (_middle.load(std::memory_order_relaxed) & BUFFER_FRESH) {
+                    uintptr_t previous = _middle.exchange((uintptr_t)_read_buffer, std::memory_order_acq_rel);
+                    _read_buffer = (ScanBuffer*)(previous & ~BUFFER_FRESH);
+                    _new_scan_ready = false;
+                    return true;
+                }
+
+                // a wakeup can be for a scan an earlier call already took
+                _u64 now = getms();
+                _u32 remaining = now < deadline ? (_u32)(deadline - now) : 0;
+                if (_data_waiter.wait(remaining) != rp::hal::Event::EVENT_OK) {
+                    if (!(_middle.load(std::memory_order_relaxed) & BUFFER_FRESH)) return false;
+                }
+            }
+        }
+
+        rp::hal::Event  _data_waiter;
+
+        size_t _scan_node_buffer_size;
+        std::shared_ptr<BufferPool> _pool;
+
+        // owned by the decoder, the middle slot shared, owned by the grabber
+        ScanBuffer*            _write_buffer;
+        std::atomic<uintptr_t> _middle;
+        ScanBuffer*            _read_buffer;
+
+        std::atomic<bool>   _new_scan_ready;
+        std::atomic<bool>   _reset_requested;
+        std::atomic<_u64>   _scans_completed;
+        std::atomic<_u64>   _nodes_dropped;
+    };
+
+}